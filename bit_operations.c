@@ -8,12 +8,27 @@
  */
 
 #include <limits.h>
+#include <string.h>
 #include "bit_operations.h"
 
 #if CLICK
 #include <click/config.h>
 #endif
 
+#if SCHC_BIT_SIMD == 1
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BIT_OPS_SSE2		1
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define BIT_OPS_AVX2		1
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BIT_OPS_NEON		1
+#endif
+#endif
+
 /*
  * copy the contents of a uint32_t to a uint8_t array
  * with little endianess
@@ -55,15 +70,7 @@ void set_bits(uint8_t A[], uint32_t pos, uint32_t len) {
  *
  */
 uint32_t get_bits(const uint8_t A[], uint32_t pos, uint8_t len) {
-	uint32_t i; uint32_t j = (len - 1); uint32_t number = 0;
-
-	for(i = pos; i < (len + pos); i++) {
-		uint8_t bit = A[i / 8] & 128 >> (i % 8);
-		number |= (!!bit << j);
-		j--;
-	}
-
-	return number;
+	return (uint32_t) get_bits64(A, pos, len);
 }
 
 /**
@@ -82,31 +89,515 @@ void clear_bits(uint8_t A[], uint32_t pos, uint32_t len) {
 	}
 }
 
+/*
+ * load 8 bytes from a byte array as a big endian 64 bit word
+ * (compilers reduce this to a single load and byte swap)
+ *
+ * @param p				pointer to the first byte
+ *
+ * @return	the 64 bit word
+ */
+static inline uint64_t load_be64(const uint8_t* p) {
+	return ((uint64_t) p[0] << 56) | ((uint64_t) p[1] << 48)
+			| ((uint64_t) p[2] << 40) | ((uint64_t) p[3] << 32)
+			| ((uint64_t) p[4] << 24) | ((uint64_t) p[5] << 16)
+			| ((uint64_t) p[6] << 8) | (uint64_t) p[7];
+}
+
+/*
+ * store a 64 bit word as 8 big endian bytes
+ * the word is or-ed into the array when SCHC_COPY_BITS_OR is set
+ *
+ * @param p				pointer to the first byte
+ * @param w				the 64 bit word
+ */
+static inline void store_be64(uint8_t* p, uint64_t w) {
+	uint8_t i;
+	for (i = 0; i < 8; i++) {
+#if SCHC_COPY_BITS_OR == 1
+		p[i] |= (uint8_t) (w >> (56 - 8 * i));
+#else
+		p[i] = (uint8_t) (w >> (56 - 8 * i));
+#endif
+	}
+}
+
+/*
+ * get up to 8 bits from a byte array, left aligned in the returned byte
+ * only reads the second byte if the bits cross the byte boundary
+ *
+ * @param SRC			the array to read from
+ * @param pos			the bit position in the first byte (0 - 7)
+ * @param len			the number of bits to get (1 - 8)
+ */
+static inline uint8_t fetch_byte(const uint8_t SRC[], uint8_t pos, uint8_t len) {
+	if ((pos + len) <= 8) {
+		return (uint8_t) (SRC[0] << pos);
+	}
+	return (uint8_t) ((SRC[0] << pos) | (SRC[1] >> (8 - pos)));
+}
+
+/*
+ * write up to 8 left aligned bits to a position in a byte
+ * leaving the surrounding bits untouched
+ *
+ * @param DST			the byte to write to
+ * @param pos			the bit position in the byte (0 - 7)
+ * @param len			the number of bits to write (1 - 8)
+ * @param value			the bits to write, left aligned
+ */
+static inline void write_partial_byte(uint8_t* DST, uint8_t pos, uint8_t len,
+		uint8_t value) {
+	uint8_t mask = (uint8_t) ((0xFF >> pos) & ~(0xFF >> (pos + len)));
+#if SCHC_COPY_BITS_OR == 1
+	*DST |= (value >> pos) & mask;
+#else
+	*DST = (*DST & ~mask) | ((value >> pos) & mask);
+#endif
+}
+
+/*
+ * bulk kernels
+ * selected once by bit_operations_init(), the scalar versions are used until then
+ *
+ * shift left:	DST[i] = SRC[i] << shift | SRC[i + 1] >> (8 - shift), from first to last byte
+ * shift right:	DST[i] = SRC[i] >> shift | SRC[i - 1] << (8 - shift), from last to first byte
+ * xor/and:		DST[i] |= SRC1[i] ^ SRC2[i] (or &)
+ *
+ * shift is 1 - 7, the shift kernels may be used in place
+ */
+static void shift_left_scalar(uint8_t DST[], const uint8_t SRC[], uint32_t bytes, uint8_t shift) {
+	while (bytes >= 8) {
+		uint64_t word = (load_be64(SRC) << shift) | (SRC[8] >> (8 - shift));
+		uint8_t i;
+		for (i = 0; i < 8; i++) {
+			DST[i] = (uint8_t) (word >> (56 - 8 * i));
+		}
+		DST += 8; SRC += 8; bytes -= 8;
+	}
+	while (bytes--) {
+		*DST++ = (uint8_t) ((SRC[0] << shift) | (SRC[1] >> (8 - shift)));
+		SRC++;
+	}
+}
+
+static void shift_right_scalar(uint8_t DST[], const uint8_t SRC[], uint32_t bytes, uint8_t shift) {
+	while (bytes >= 8) {
+		bytes -= 8;
+		uint64_t word = (load_be64(SRC + bytes) >> shift)
+				| ((uint64_t) SRC[(int32_t) bytes - 1] << (64 - shift));
+		uint8_t i;
+		for (i = 0; i < 8; i++) {
+			DST[bytes + i] = (uint8_t) (word >> (56 - 8 * i));
+		}
+	}
+	while (bytes--) {
+		DST[bytes] = (uint8_t) ((SRC[bytes] >> shift) | (SRC[(int32_t) bytes - 1] << (8 - shift)));
+	}
+}
+
+static void xor_scalar(uint8_t DST[], const uint8_t SRC1[], const uint8_t SRC2[], uint32_t bytes) {
+	uint32_t i;
+	for (i = 0; i < bytes; i++) {
+		DST[i] |= SRC1[i] ^ SRC2[i];
+	}
+}
+
+static void and_scalar(uint8_t DST[], const uint8_t SRC1[], const uint8_t SRC2[], uint32_t bytes) {
+	uint32_t i;
+	for (i = 0; i < bytes; i++) {
+		DST[i] |= SRC1[i] & SRC2[i];
+	}
+}
+
+#if BIT_OPS_SSE2
+/* SSE2 has no byte shifts, shift 16 bit lanes and mask the bits crossing the byte */
+static void shift_left_sse2(uint8_t DST[], const uint8_t SRC[], uint32_t bytes, uint8_t shift) {
+	const __m128i cnt_l = _mm_cvtsi32_si128(shift);
+	const __m128i cnt_r = _mm_cvtsi32_si128(8 - shift);
+	const __m128i mask_l = _mm_set1_epi8((char) (0xFF << shift));
+	const __m128i mask_r = _mm_set1_epi8((char) (0xFF >> (8 - shift)));
+
+	while (bytes >= 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*) SRC);
+		__m128i b = _mm_loadu_si128((const __m128i*) (SRC + 1));
+		a = _mm_and_si128(_mm_sll_epi16(a, cnt_l), mask_l);
+		b = _mm_and_si128(_mm_srl_epi16(b, cnt_r), mask_r);
+		_mm_storeu_si128((__m128i*) DST, _mm_or_si128(a, b));
+		DST += 16; SRC += 16; bytes -= 16;
+	}
+	shift_left_scalar(DST, SRC, bytes, shift);
+}
+
+static void shift_right_sse2(uint8_t DST[], const uint8_t SRC[], uint32_t bytes, uint8_t shift) {
+	const __m128i cnt_r = _mm_cvtsi32_si128(shift);
+	const __m128i cnt_l = _mm_cvtsi32_si128(8 - shift);
+	const __m128i mask_r = _mm_set1_epi8((char) (0xFF >> shift));
+	const __m128i mask_l = _mm_set1_epi8((char) (0xFF << (8 - shift)));
+
+	while (bytes >= 16) {
+		bytes -= 16;
+		__m128i a = _mm_loadu_si128((const __m128i*) (SRC + bytes));
+		__m128i b = _mm_loadu_si128((const __m128i*) (SRC + bytes - 1));
+		a = _mm_and_si128(_mm_srl_epi16(a, cnt_r), mask_r);
+		b = _mm_and_si128(_mm_sll_epi16(b, cnt_l), mask_l);
+		_mm_storeu_si128((__m128i*) (DST + bytes), _mm_or_si128(a, b));
+	}
+	shift_right_scalar(DST, SRC, bytes, shift);
+}
+
+static void xor_sse2(uint8_t DST[], const uint8_t SRC1[], const uint8_t SRC2[], uint32_t bytes) {
+	while (bytes >= 16) {
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*) SRC1),
+				_mm_loadu_si128((const __m128i*) SRC2));
+		_mm_storeu_si128((__m128i*) DST, _mm_or_si128(_mm_loadu_si128((const __m128i*) DST), v));
+		DST += 16; SRC1 += 16; SRC2 += 16; bytes -= 16;
+	}
+	xor_scalar(DST, SRC1, SRC2, bytes);
+}
+
+static void and_sse2(uint8_t DST[], const uint8_t SRC1[], const uint8_t SRC2[], uint32_t bytes) {
+	while (bytes >= 16) {
+		__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*) SRC1),
+				_mm_loadu_si128((const __m128i*) SRC2));
+		_mm_storeu_si128((__m128i*) DST, _mm_or_si128(_mm_loadu_si128((const __m128i*) DST), v));
+		DST += 16; SRC1 += 16; SRC2 += 16; bytes -= 16;
+	}
+	and_scalar(DST, SRC1, SRC2, bytes);
+}
+#endif
+
+#if BIT_OPS_AVX2
+__attribute__((target("avx2")))
+static void shift_left_avx2(uint8_t DST[], const uint8_t SRC[], uint32_t bytes, uint8_t shift) {
+	const __m128i cnt_l = _mm_cvtsi32_si128(shift);
+	const __m128i cnt_r = _mm_cvtsi32_si128(8 - shift);
+	const __m256i mask_l = _mm256_set1_epi8((char) (0xFF << shift));
+	const __m256i mask_r = _mm256_set1_epi8((char) (0xFF >> (8 - shift)));
+
+	while (bytes >= 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*) SRC);
+		__m256i b = _mm256_loadu_si256((const __m256i*) (SRC + 1));
+		a = _mm256_and_si256(_mm256_sll_epi16(a, cnt_l), mask_l);
+		b = _mm256_and_si256(_mm256_srl_epi16(b, cnt_r), mask_r);
+		_mm256_storeu_si256((__m256i*) DST, _mm256_or_si256(a, b));
+		DST += 32; SRC += 32; bytes -= 32;
+	}
+	_mm256_zeroupper(); /* avoid the avx - sse transition penalty in the remainder */
+	shift_left_sse2(DST, SRC, bytes, shift);
+}
+
+__attribute__((target("avx2")))
+static void shift_right_avx2(uint8_t DST[], const uint8_t SRC[], uint32_t bytes, uint8_t shift) {
+	const __m128i cnt_r = _mm_cvtsi32_si128(shift);
+	const __m128i cnt_l = _mm_cvtsi32_si128(8 - shift);
+	const __m256i mask_r = _mm256_set1_epi8((char) (0xFF >> shift));
+	const __m256i mask_l = _mm256_set1_epi8((char) (0xFF << (8 - shift)));
+
+	while (bytes >= 32) {
+		bytes -= 32;
+		__m256i a = _mm256_loadu_si256((const __m256i*) (SRC + bytes));
+		__m256i b = _mm256_loadu_si256((const __m256i*) (SRC + bytes - 1));
+		a = _mm256_and_si256(_mm256_srl_epi16(a, cnt_r), mask_r);
+		b = _mm256_and_si256(_mm256_sll_epi16(b, cnt_l), mask_l);
+		_mm256_storeu_si256((__m256i*) (DST + bytes), _mm256_or_si256(a, b));
+	}
+	_mm256_zeroupper(); /* avoid the avx - sse transition penalty in the remainder */
+	shift_right_sse2(DST, SRC, bytes, shift);
+}
+
+__attribute__((target("avx2")))
+static void xor_avx2(uint8_t DST[], const uint8_t SRC1[], const uint8_t SRC2[], uint32_t bytes) {
+	while (bytes >= 32) {
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) SRC1),
+				_mm256_loadu_si256((const __m256i*) SRC2));
+		_mm256_storeu_si256((__m256i*) DST, _mm256_or_si256(_mm256_loadu_si256((const __m256i*) DST), v));
+		DST += 32; SRC1 += 32; SRC2 += 32; bytes -= 32;
+	}
+	_mm256_zeroupper(); /* avoid the avx - sse transition penalty in the remainder */
+	xor_sse2(DST, SRC1, SRC2, bytes);
+}
+
+__attribute__((target("avx2")))
+static void and_avx2(uint8_t DST[], const uint8_t SRC1[], const uint8_t SRC2[], uint32_t bytes) {
+	while (bytes >= 32) {
+		__m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) SRC1),
+				_mm256_loadu_si256((const __m256i*) SRC2));
+		_mm256_storeu_si256((__m256i*) DST, _mm256_or_si256(_mm256_loadu_si256((const __m256i*) DST), v));
+		DST += 32; SRC1 += 32; SRC2 += 32; bytes -= 32;
+	}
+	_mm256_zeroupper(); /* avoid the avx - sse transition penalty in the remainder */
+	and_sse2(DST, SRC1, SRC2, bytes);
+}
+#endif
+
+#if BIT_OPS_NEON
+/* NEON shifts bytes directly, a negative count shifts to the right */
+static void shift_left_neon(uint8_t DST[], const uint8_t SRC[], uint32_t bytes, uint8_t shift) {
+	const int8x16_t cnt_l = vdupq_n_s8((int8_t) shift);
+	const int8x16_t cnt_r = vdupq_n_s8((int8_t) shift - 8);
+
+	while (bytes >= 16) {
+		uint8x16_t a = vld1q_u8(SRC);
+		uint8x16_t b = vld1q_u8(SRC + 1);
+		vst1q_u8(DST, vorrq_u8(vshlq_u8(a, cnt_l), vshlq_u8(b, cnt_r)));
+		DST += 16; SRC += 16; bytes -= 16;
+	}
+	shift_left_scalar(DST, SRC, bytes, shift);
+}
+
+static void shift_right_neon(uint8_t DST[], const uint8_t SRC[], uint32_t bytes, uint8_t shift) {
+	const int8x16_t cnt_r = vdupq_n_s8(-(int8_t) shift);
+	const int8x16_t cnt_l = vdupq_n_s8(8 - (int8_t) shift);
+
+	while (bytes >= 16) {
+		bytes -= 16;
+		uint8x16_t a = vld1q_u8(SRC + bytes);
+		uint8x16_t b = vld1q_u8(SRC + bytes - 1);
+		vst1q_u8(DST + bytes, vorrq_u8(vshlq_u8(a, cnt_r), vshlq_u8(b, cnt_l)));
+	}
+	shift_right_scalar(DST, SRC, bytes, shift);
+}
+
+static void xor_neon(uint8_t DST[], const uint8_t SRC1[], const uint8_t SRC2[], uint32_t bytes) {
+	while (bytes >= 16) {
+		uint8x16_t v = veorq_u8(vld1q_u8(SRC1), vld1q_u8(SRC2));
+		vst1q_u8(DST, vorrq_u8(vld1q_u8(DST), v));
+		DST += 16; SRC1 += 16; SRC2 += 16; bytes -= 16;
+	}
+	xor_scalar(DST, SRC1, SRC2, bytes);
+}
+
+static void and_neon(uint8_t DST[], const uint8_t SRC1[], const uint8_t SRC2[], uint32_t bytes) {
+	while (bytes >= 16) {
+		uint8x16_t v = vandq_u8(vld1q_u8(SRC1), vld1q_u8(SRC2));
+		vst1q_u8(DST, vorrq_u8(vld1q_u8(DST), v));
+		DST += 16; SRC1 += 16; SRC2 += 16; bytes -= 16;
+	}
+	and_scalar(DST, SRC1, SRC2, bytes);
+}
+#endif
+
+static void (*shift_left_kernel)(uint8_t DST[], const uint8_t SRC[], uint32_t bytes,
+		uint8_t shift) = shift_left_scalar;
+static void (*shift_right_kernel)(uint8_t DST[], const uint8_t SRC[], uint32_t bytes,
+		uint8_t shift) = shift_right_scalar;
+static void (*xor_kernel)(uint8_t DST[], const uint8_t SRC1[], const uint8_t SRC2[],
+		uint32_t bytes) = xor_scalar;
+static void (*and_kernel)(uint8_t DST[], const uint8_t SRC1[], const uint8_t SRC2[],
+		uint32_t bytes) = and_scalar;
+
+/**
+ * select the bulk kernels for the instruction sets supported by the cpu
+ * SSE2 and NEON are selected at compile time, AVX2 is detected at run time
+ *
+ */
+void bit_operations_init(void) {
+#if BIT_OPS_SSE2
+	shift_left_kernel = shift_left_sse2;
+	shift_right_kernel = shift_right_sse2;
+	xor_kernel = xor_sse2;
+	and_kernel = and_sse2;
+#endif
+#if BIT_OPS_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		shift_left_kernel = shift_left_avx2;
+		shift_right_kernel = shift_right_avx2;
+		xor_kernel = xor_avx2;
+		and_kernel = and_avx2;
+	}
+#endif
+#if BIT_OPS_NEON
+	shift_left_kernel = shift_left_neon;
+	shift_right_kernel = shift_right_neon;
+	xor_kernel = xor_neon;
+	and_kernel = and_neon;
+#endif
+}
+
 /**
  * copy bits to a certain position in a bit array
  * from another array
  * big endian
  *
+ * the destination is first aligned on a byte boundary,
+ * the bulk is then moved with the shift kernel if the source is not aligned
+ * or with memmove if both positions are byte aligned
+ *
  * @param DST			the array to copy to
  * @param dst_pos		which bit to start from
  * @param SRC			the array to copy from
  * @param src_pos		which bit to start from
- * @param len			the number of consecutive bits to check
+ * @param len			the number of consecutive bits to copy
+ *
+ * @note	the bits are written over the destination, set SCHC_COPY_BITS_OR
+ * 			to or the source bits into the destination instead
  *
  */
 void copy_bits(uint8_t DST[], uint32_t dst_pos, const uint8_t SRC[], uint32_t src_pos,
 		uint32_t len) {
-	uint32_t i;
-	uint32_t k = 0;
+	uint8_t dst_shift = dst_pos % 8;
+	uint8_t src_shift = src_pos % 8;
+	uint32_t bytes;
+
+	if (len == 0) {
+		return;
+	}
+
+	DST += dst_pos / 8;
+	SRC += src_pos / 8;
+
+	/* align the destination on a byte boundary */
+	if (dst_shift) {
+		uint8_t n = (len < (uint32_t) (8 - dst_shift)) ? len : (uint32_t) (8 - dst_shift);
+		write_partial_byte(DST, dst_shift, n, fetch_byte(SRC, src_shift, n));
+		DST++;
+		len -= n;
+		src_shift += n;
+		if (src_shift >= 8) {
+			src_shift -= 8;
+			SRC++;
+		}
+	}
+
+	bytes = len / 8;
+	if (src_shift == 0) { /* both byte aligned */
+#if SCHC_COPY_BITS_OR == 1
+		while (bytes >= 8) {
+			store_be64(DST, load_be64(SRC));
+			DST += 8; SRC += 8; bytes -= 8;
+		}
+		while (bytes--) {
+			*DST++ |= *SRC++;
+		}
+#else
+		memmove(DST, SRC, bytes);
+		DST += bytes; SRC += bytes;
+#endif
+	} else {
+#if SCHC_COPY_BITS_OR == 1
+		while (bytes >= 8) {
+			store_be64(DST, (load_be64(SRC) << src_shift) | (SRC[8] >> (8 - src_shift)));
+			DST += 8; SRC += 8; bytes -= 8;
+		}
+		while (bytes--) {
+			*DST++ |= (uint8_t) ((SRC[0] << src_shift) | (SRC[1] >> (8 - src_shift)));
+			SRC++;
+		}
+#else
+		shift_left_kernel(DST, SRC, bytes, src_shift);
+		DST += bytes; SRC += bytes;
+#endif
+	}
+
+	/* remaining bits */
+	if (len % 8) {
+		write_partial_byte(DST, 0, len % 8, fetch_byte(SRC, src_shift, len % 8));
+	}
+}
+
+/**
+ * get up to 64 bits at a certain position in a bit array
+ * only the bytes holding the requested bits are read
+ *
+ * @param A				the bit array
+ * @param pos			the position to start from
+ * @param len			the number of consecutive bits to get
+ *
+ * @return	the bits, right aligned
+ *
+ */
+uint64_t get_bits64(const uint8_t A[], uint32_t pos, uint8_t len) {
+	uint8_t shift = pos % 8;
+	uint8_t bytes = (shift + len + 7) / 8;
+	uint64_t value = 0;
+	uint8_t i;
+
+	if (len == 0) {
+		return 0;
+	}
+
+	A += pos / 8;
+	if (bytes >= 8) {
+		value = load_be64(A);
+	} else {
+		for (i = 0; i < bytes; i++) {
+			value |= (uint64_t) A[i] << (56 - 8 * i);
+		}
+	}
+	value <<= shift;
+	if (bytes > 8) {
+		value |= A[8] >> (8 - shift);
+	}
+
+	return value >> (64 - len);
+}
+
+/**
+ * write the least significant bits of a value at a certain position
+ * in a bit array
+ * big endian
+ *
+ * @param A				the bit array
+ * @param pos			the position to start from
+ * @param value			the value to write
+ * @param len			the number of bits to write (up to 64)
+ *
+ */
+void put_bits64(uint8_t A[], uint32_t pos, uint64_t value, uint8_t len) {
+	uint8_t shift = pos % 8;
+
+	if (len == 0) {
+		return;
+	}
+
+	A += pos / 8;
+	if (shift) {
+		uint8_t n = (len < (8 - shift)) ? len : (8 - shift);
+		len -= n;
+		write_partial_byte(A, shift, n, (uint8_t) ((value >> len) << (8 - n)));
+		A++;
+	}
+	while (len >= 8) {
+		len -= 8;
+#if SCHC_COPY_BITS_OR == 1
+		*A++ |= (uint8_t) (value >> len);
+#else
+		*A++ = (uint8_t) (value >> len);
+#endif
+	}
+	if (len) {
+		write_partial_byte(A, 0, len, (uint8_t) (value << (8 - len)));
+	}
+}
 
-	for(i = 0; i < len; i++) { // for each bit
-		uint8_t src_val = ((128 >> ( (k + src_pos) % 8)) & SRC[((k + src_pos) / 8)]);
-		if(src_val) {
-			// DEBUG_PRINTF("set bits for %d at position %d len is %d \n", DST[i+dst_pos], i+dst_pos, len);
-			set_bits(DST, i + dst_pos, 1);
+/*
+ * compare two bit sequences on 64 bit lanes
+ * both sequences are shifted to the left of a word,
+ * pulling in the high bits of the next byte, and xor-ed
+ * only the bytes holding the compared bits are read
+ *
+ * @param 	s1			the first sequence, s1_off < 8
+ * @param 	s2			the second sequence, s2_off < 8
+ * @param 	length		the number of consecutive bits to compare, > 0
+ *
+ * @return	1			both sequences match
+ * 			0			the sequences differ
+ */
+static uint8_t do_compare(const uint8_t s1[], uint8_t s1_off, const uint8_t s2[],
+		uint8_t s2_off, uint32_t length) {
+	while (length > 64) {
+		uint64_t w1 = (load_be64(s1) << s1_off) | (s1[8] >> (8 - s1_off));
+		uint64_t w2 = (load_be64(s2) << s2_off) | (s2[8] >> (8 - s2_off));
+		if (w1 ^ w2) {
+			return 0;
 		}
-		k++;
+		s1 += 8; s2 += 8;
+		length -= 64;
 	}
+
+	return get_bits64(s1, s1_off, length) == get_bits64(s2, s2_off, length);
 }
 
 /**
@@ -121,15 +612,7 @@ void copy_bits(uint8_t DST[], uint32_t dst_pos, const uint8_t SRC[], uint32_t sr
  *
  */
 uint8_t compare_bits(const uint8_t SRC1[], const uint8_t SRC2[], uint32_t len) {
-	uint32_t i;
-
-	for (i = 0; i < len; i++) {
-		if ( (SRC1[i / 8] & (128 >> (i % 8) )) != (SRC2[i / 8] & (128 >> (i % 8) )) ) {
-			return 0;
-		}
-	}
-
-	return 1;
+	return compare_bit_sequence(SRC1, 0, SRC2, 0, len);
 }
 
 /**
@@ -147,74 +630,12 @@ uint8_t compare_bits(const uint8_t SRC1[], const uint8_t SRC2[], uint32_t len) {
  */
 uint8_t compare_bits_aligned(const uint8_t SRC1[], uint16_t pos1,
 		const uint8_t SRC2[], uint16_t pos2, uint32_t len) {
-	uint8_t shift1, shift2;
-
-	shift1 = pos1 % 8;
-	shift2 = pos2 % 8;
-
-	// todo no copy
-	uint8_t SRC1_copy[MAX_FIELD_LENGTH] = { 0 };
-	uint8_t SRC2_copy[MAX_FIELD_LENGTH] = { 0 };
-
-	copy_bits(SRC1_copy, 0, SRC1, shift1, len);
-	copy_bits(SRC2_copy, 0, SRC2, shift2, len);
-
-	return compare_bits(SRC1_copy, SRC2_copy, len);
-}
-/* do_compare()
- *
- * Does the actual comparison, but has some preconditions on parameters to
- * simplify things:
- * https://stackoverflow.com/questions/1575142/comparing-arbitrary-bit-sequences-in-a-byte-array-in-c
- *
- *     length > 0
- *     8 > s1_off >= s2_off
- */
-int do_compare(const uint8_t s1[], const unsigned s1_off, const uint8_t s2[],
-		const unsigned s2_off, const unsigned length) {
-	const uint8_t mask_lo_bits[] = { 0xff, 0x01, 0x03, 0x07, 0x0f, 0x1f, 0x3f,
-			0x7f, 0xff };
-	const uint8_t mask_hi_bits[] = { 0x00, 0x80, 0xc0, 0xe0, 0xf0, 0xf8, 0xfc,
-			0xfe, 0xff };
-	const unsigned msb = (length + s1_off - 1) / 8;
-	const unsigned s2_shl = s1_off - s2_off;
-	const unsigned s2_shr = 8 - s2_shl;
-	unsigned n;
-	uint8_t s1s2_diff, lo_bits = 0;
-
-	for (n = 0; n <= msb; n++) {
-		/* Shift s2 so it is aligned with s1, pulling in low bits from
-		 * the high bits of the previous byte, and store in s1s2_diff */
-		s1s2_diff = lo_bits | (s2[n] << s2_shl);
-
-		/* Save the bits needed to fill in the low-order bits of the next
-		 * byte.  HERE BE DRAGONS - since s2_shr can be 8, this below line
-		 * only works because uint8_t is promoted to int, and we know that
-		 * the width of int is guaranteed to be >= 16.  If you change this
-		 * routine to work with a wider type than uint8_t, you will need
-		 * to special-case this line so that if s2_shr is the width of the
-		 * type, you get lo_bits = 0.  Don't say you weren't warned. */
-		lo_bits = s2[n] >> s2_shr;
-
-		/* XOR with s1[n] to determine bits that differ between s1 and s2 */
-		s1s2_diff ^= s1[n];
-
-		/* Look only at differences in the high bits in the first byte */
-		if (n == 0)
-			s1s2_diff &= mask_hi_bits[8 - s1_off];
-
-		/* Look only at differences in the low bits of the last byte */
-		if (n == msb)
-			s1s2_diff &= mask_lo_bits[(length + s1_off) % 8];
-
-		if (s1s2_diff)
-			return 0;
-	}
-
-	return 1;
+	return compare_bit_sequence(SRC1, pos1, SRC2, pos2, len);
 }
+
 /**
  * compare two bit arrays with starting point
+ * all other comparisons end up here
  *
  * @param 	SRC1		the array to compare
  * @param	pos1		position to start for src1
@@ -232,18 +653,7 @@ uint8_t compare_bit_sequence(const uint8_t s1[], uint16_t s1_off,
 	if (length == 0)
 		return 1;
 
-	/* Makes sure the offsets are less than 8 bits */
-	s1 += s1_off / 8;
-	s1_off %= 8;
-
-	s2 += s2_off / 8;
-	s2_off %= 8;
-
-	/* Make sure s2 is the sequence with the shorter offset */
-	if (s1_off >= s2_off)
-		return do_compare(s1, s1_off, s2, s2_off, length);
-	else
-		return do_compare(s2, s2_off, s1, s1_off, length);
+	return do_compare(s1 + s1_off / 8, s1_off % 8, s2 + s2_off / 8, s2_off % 8, length);
 }
 
 // remain backward compatible
@@ -256,66 +666,71 @@ uint8_t compare_bit_sequence(const uint8_t s1[], uint16_t s1_off,
 *
 */
 uint8_t compare_bits_little_endian(uint8_t* SRC1, uint8_t* SRC2, uint32_t len) {
-	uint32_t i;
-
 	uint8_t pos = get_position_in_first_byte(len);
-	for (i = pos; i < (len + pos); i++) {
-		if ((SRC1[i / 8] & (128 >> (i % 8))) != (SRC2[i / 8] & (128 >> (i % 8)))) {
-			return 0;
-		}
-	}
-
-	return 1;
+	return compare_bit_sequence(SRC1, pos, SRC2, pos, len);
 }
 
 /**
  * shift a number of bits to the left
+ * the vacated bits on the right are set to 0
  *
  * @param 	SRC			the array to shift
- * @param	len			the length of the array
+ * @param	len			the length of the array in bytes
  * @param 	shift		the number of consecutive bits to shift
  *
  */
 void shift_bits_left(uint8_t SRC[], uint16_t len, uint32_t shift) {
-	uint32_t i = 0; uint32_t j = 0;
-
-	uint8_t start = shift / 8;
+	uint32_t start = shift / 8;
 	uint8_t rest = shift % 8;
+	uint32_t n;
 
-	for(i = start; i < len; i++) {
-		uint8_t value = (SRC[i] << rest) | (SRC[i + 1] >> (8 - rest));
-		SRC[j] = value;
-		j++;
+	if (start >= len) {
+		memset(SRC, 0, len);
+		return;
 	}
 
+	n = len - start; // the number of bytes that keep bits
+	if (rest == 0) {
+		memmove(SRC, SRC + start, n);
+	} else {
+		shift_left_kernel(SRC, SRC + start, n - 1, rest);
+		SRC[n - 1] = (uint8_t) (SRC[len - 1] << rest);
+	}
+	memset(SRC + n, 0, start);
 }
 
 /**
  * shift a number of bits to the right
+ * the vacated bits on the left are set to 0
  *
  * @param 	SRC			the array to shift
- * @param	len			the length of the array
+ * @param	len			the length of the array in bytes
  * @param 	shift		the number of consecutive bits to shift
  *
  */
 void shift_bits_right(uint8_t SRC[], uint16_t len, uint32_t shift) {
-	uint32_t i = 0;
-
-	uint8_t start = shift / 8;
+	uint32_t start = shift / 8;
 	uint8_t rest = shift % 8;
-	uint8_t previous = 0;
+	uint32_t n;
 
-	for(i = 0; i < len; i++) {
-		if(start <= i) {
-			previous = SRC[i - start];
-		}
-		uint8_t value = (previous << (8 - rest)) | SRC[i + start] >> rest;
-		SRC[i + start] = value;
+	if (start >= len) {
+		memset(SRC, 0, len);
+		return;
+	}
+
+	n = len - start; // the number of bytes that keep bits
+	if (rest == 0) {
+		memmove(SRC + start, SRC, n);
+	} else {
+		shift_right_kernel(SRC + start + 1, SRC + 1, n - 1, rest);
+		SRC[start] = SRC[0] >> rest;
 	}
+	memset(SRC, 0, start);
 }
 
 /**
  * logical XOR two bit arrays
+ * the result is or-ed into the destination
  *
  * @param 	DST			the array to save the result in
  * @param 	SRC1		the array to compare with
@@ -324,15 +739,17 @@ void shift_bits_right(uint8_t SRC[], uint16_t len, uint32_t shift) {
  *
  */
 void xor_bits(uint8_t DST[], uint8_t SRC1[], uint8_t SRC2[], uint32_t len) {
-	uint32_t i;
+	uint32_t bytes = len / 8;
 
-	for(i = 0; i < len; i++) {
-		DST[i / 8] |= (SRC1[i / 8] & (128 >> (i % 8) )) ^ (SRC2[i / 8] & (128 >> (i % 8) ));
+	xor_kernel(DST, SRC1, SRC2, bytes);
+	if (len % 8) {
+		DST[bytes] |= (SRC1[bytes] ^ SRC2[bytes]) & (uint8_t) (0xFF << (8 - (len % 8)));
 	}
 }
 
 /**
  * logical AND two bit arrays
+ * the result is or-ed into the destination
  *
  * @param 	DST			the array to save the result in
  * @param 	SRC1		the array to compare with
@@ -341,10 +758,11 @@ void xor_bits(uint8_t DST[], uint8_t SRC1[], uint8_t SRC2[], uint32_t len) {
  *
  */
 void and_bits(uint8_t DST[], uint8_t SRC1[], uint8_t SRC2[], uint32_t len) {
-	uint32_t i;
+	uint32_t bytes = len / 8;
 
-	for(i = 0; i < len; i++) {
-		DST[i / 8] |= (SRC1[i / 8] & (128 >> (i % 8) )) & (SRC2[i / 8] & (128 >> (i % 8) ));
+	and_kernel(DST, SRC1, SRC2, bytes);
+	if (len % 8) {
+		DST[bytes] |= (SRC1[bytes] & SRC2[bytes]) & (uint8_t) (0xFF << (8 - (len % 8)));
 	}
 }
 
@@ -420,6 +838,231 @@ uint8_t padded(schc_bitarray_t* bit_array) {
 	return 0;
 }
 
+/**
+ * initialize a bit writer
+ * the bits in front of the offset are preserved
+ *
+ * @param 	w			the bit writer
+ * @param 	ptr			the bit array to write to
+ * @param 	offset		the bit position of the first value
+ *
+ */
+void schc_bitwriter_init(schc_bitwriter_t* w, uint8_t* ptr, uint32_t offset) {
+	w->ptr = ptr;
+	w->byte = offset / 8;
+	w->count = offset % 8;
+	w->acc = 0;
+	if (w->count) {
+		w->acc = ptr[w->byte] >> (8 - w->count);
+	}
+}
+
+/**
+ * append a value to a bit writer
+ * a 64 bit word is stored as soon as the accumulator is full
+ *
+ * @param 	w			the bit writer
+ * @param 	value		the value to append
+ * @param 	len			the number of least significant bits of @p value to append (up to 64)
+ *
+ */
+void schc_bitwriter_put(schc_bitwriter_t* w, uint64_t value, uint8_t len) {
+	uint8_t free_bits = 64 - w->count;
+	uint8_t rest;
+	uint64_t word;
+	uint8_t i;
+
+	if (len == 0) {
+		return;
+	}
+	if (len < 64) {
+		value &= (((uint64_t) 1) << len) - 1;
+	}
+
+	if (len < free_bits) {
+		w->acc = (w->acc << len) | value;
+		w->count += len;
+		return;
+	}
+
+	rest = len - free_bits;
+	word = (w->count == 0) ? value : ((w->acc << free_bits) | (value >> rest));
+	for (i = 0; i < 8; i++) {
+		w->ptr[w->byte + i] = (uint8_t) (word >> (56 - 8 * i));
+	}
+	w->byte += 8;
+	w->acc = value;
+	w->count = rest;
+}
+
+/**
+ * append a bit sequence of arbitrary length to a bit writer
+ *
+ * @param 	w			the bit writer
+ * @param 	SRC			the array to copy from
+ * @param 	src_pos		which bit to start from
+ * @param 	len			the number of consecutive bits to copy
+ *
+ */
+void schc_bitwriter_put_array(schc_bitwriter_t* w, const uint8_t SRC[], uint32_t src_pos,
+		uint32_t len) {
+	uint32_t offset;
+
+	if (len <= 64) {
+		schc_bitwriter_put(w, get_bits64(SRC, src_pos, len), len);
+		return;
+	}
+
+	offset = schc_bitwriter_flush(w);
+	copy_bits(w->ptr, offset, SRC, src_pos, len);
+	schc_bitwriter_init(w, w->ptr, offset + len);
+}
+
+/**
+ * store the pending bits of a bit writer
+ * the writer can be used afterwards
+ *
+ * @param 	w			the bit writer
+ *
+ * @return	offset		the number of bits written to the array
+ *
+ */
+uint32_t schc_bitwriter_flush(schc_bitwriter_t* w) {
+	while (w->count >= 8) {
+		w->count -= 8;
+		w->ptr[w->byte++] = (uint8_t) (w->acc >> w->count);
+	}
+	if (w->count) {
+		uint8_t shift = 8 - w->count;
+		w->ptr[w->byte] = (w->ptr[w->byte] & ((1 << shift) - 1))
+				| (uint8_t) (w->acc << shift);
+	}
+
+	return schc_bitwriter_offset(w);
+}
+
+/**
+ * get the current position of a bit writer
+ *
+ * @param 	w			the bit writer
+ *
+ * @return	offset		the bit position of the next value
+ *
+ */
+uint32_t schc_bitwriter_offset(const schc_bitwriter_t* w) {
+	return (w->byte * 8) + w->count;
+}
+
+/*
+ * load the next bytes of the array in the accumulator of a bit reader
+ * a whole word is loaded if the array is long enough
+ *
+ * @param 	r			the bit reader
+ *
+ */
+static void schc_bitreader_refill(schc_bitreader_t* r) {
+	if ((r->byte + 8) <= r->len) {
+		uint8_t bytes = (64 - r->count) / 8;
+		r->acc |= load_be64(r->ptr + r->byte) >> r->count;
+		r->byte += bytes;
+		r->count += bytes * 8;
+		r->acc &= ~((uint64_t) 0) << (64 - r->count);
+		return;
+	}
+	while (r->count <= 56 && r->byte < r->len) {
+		r->acc |= (uint64_t) r->ptr[r->byte++] << (56 - r->count);
+		r->count += 8;
+	}
+}
+
+/**
+ * initialize a bit reader
+ *
+ * @param 	r			the bit reader
+ * @param 	ptr			the bit array to read from
+ * @param 	offset		the bit position of the first value
+ * @param 	len			the length of the array in bytes
+ *
+ */
+void schc_bitreader_init(schc_bitreader_t* r, const uint8_t* ptr, uint32_t offset, uint32_t len) {
+	uint8_t skip = offset % 8;
+
+	r->ptr = ptr;
+	r->len = len;
+	r->offset = offset;
+	r->byte = offset / 8;
+	r->acc = 0;
+	r->count = 0;
+	if (skip) {
+		schc_bitreader_refill(r);
+		r->acc <<= skip;
+		r->count = (r->count > skip) ? (r->count - skip) : 0;
+	}
+}
+
+/**
+ * consume a value from a bit reader
+ * bits beyond the end of the array are read as 0
+ *
+ * @param 	r			the bit reader
+ * @param 	len			the number of bits to read (up to 64)
+ *
+ * @return	the value, right aligned
+ *
+ */
+uint64_t schc_bitreader_get(schc_bitreader_t* r, uint8_t len) {
+	uint64_t value;
+
+	if (len == 0) {
+		return 0;
+	}
+	if (len > 56) {
+		value = schc_bitreader_get(r, len - 32) << 32;
+		return value | schc_bitreader_get(r, 32);
+	}
+
+	if (r->count < len) {
+		schc_bitreader_refill(r);
+	}
+	value = r->acc >> (64 - len);
+	r->acc <<= len;
+	r->count = (r->count > len) ? (r->count - len) : 0;
+	r->offset += len;
+
+	return value;
+}
+
+/**
+ * consume a bit sequence of arbitrary length from a bit reader
+ *
+ * @param 	r			the bit reader
+ * @param 	DST			the array to copy to
+ * @param 	dst_pos		which bit to start from
+ * @param 	len			the number of consecutive bits to copy
+ *
+ */
+void schc_bitreader_get_array(schc_bitreader_t* r, uint8_t DST[], uint32_t dst_pos, uint32_t len) {
+	if (len <= 64) {
+		put_bits64(DST, dst_pos, schc_bitreader_get(r, len), len);
+		return;
+	}
+
+	copy_bits(DST, dst_pos, r->ptr, r->offset, len);
+	schc_bitreader_init(r, r->ptr, r->offset + len, r->len);
+}
+
+/**
+ * get the current position of a bit reader
+ *
+ * @param 	r			the bit reader
+ *
+ * @return	offset		the bit position of the next value
+ *
+ */
+uint32_t schc_bitreader_offset(const schc_bitreader_t* r) {
+	return r->offset;
+}
+
 #if CLICK
 ELEMENT_PROVIDES(schcBIT)
 #endif
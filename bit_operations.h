@@ -20,6 +20,39 @@ extern "C" {
 #define BYTES_TO_BITS(x)	(x * 8)
 #define BITS_TO_BYTES(x)	(((x) == 0) ? 0 : (((x) - 1) / 8 + 1)) // bytes required for a number of bits
 
+// copy_bits() overwrites the destination bits unless set to 1
+#ifndef SCHC_COPY_BITS_OR
+#define SCHC_COPY_BITS_OR	0
+#endif
+
+// use the SSE2/AVX2 or NEON kernels for bulk shifting and bitmap logic when available
+#ifndef SCHC_BIT_SIMD
+#define SCHC_BIT_SIMD		1
+#endif
+
+/* bit writer: appends values of up to 64 bits to a bit array,
+ * whole 64 bit words are stored at once */
+typedef struct schc_bitwriter_t {
+	uint8_t* ptr;
+	uint32_t byte; // the next byte to store
+	uint64_t acc; // pending bits, right aligned
+	uint8_t count; // number of pending bits in the accumulator
+} schc_bitwriter_t;
+
+/* bit reader: consumes values of up to 64 bits from a bit array,
+ * never reads beyond len bytes */
+typedef struct schc_bitreader_t {
+	const uint8_t* ptr;
+	uint32_t len; // in bytes
+	uint32_t offset; // in bits
+	uint32_t byte; // the next byte to load
+	uint64_t acc; // loaded bits, left aligned
+	uint8_t count; // number of loaded bits in the accumulator
+} schc_bitreader_t;
+
+// select the bulk kernels for this cpu
+void bit_operations_init(void);
+
 void little_end_uint8_from_uint32 (uint8_t A[4], uint32_t u32);
 
 // sets bits at a certain position in a bit array
@@ -28,6 +61,12 @@ void set_bits(uint8_t A[], uint32_t pos, uint32_t len);
 // get bits at a certain position in a bit array
 uint32_t get_bits(const uint8_t A[], uint32_t pos, uint8_t len);
 
+// get up to 64 bits at a certain position in a bit array
+uint64_t get_bits64(const uint8_t A[], uint32_t pos, uint8_t len);
+
+// write the len least significant bits of a value at a certain position in a bit array
+void put_bits64(uint8_t A[], uint32_t pos, uint64_t value, uint8_t len);
+
 // clear bits at a certain position in a bit array
 void clear_bits(uint8_t A[], uint32_t pos, uint32_t len);
 
@@ -41,10 +80,10 @@ uint8_t compare_bits_aligned(const uint8_t SRC1[], uint16_t pos1, const uint8_t
 uint8_t compare_bit_sequence(const uint8_t SRC1[], uint16_t pos1, const uint8_t SRC2[], uint16_t pos2, uint32_t len);
 uint8_t compare_bits_little_endian(uint8_t SRC1[], uint8_t SRC2[], uint32_t len);
 
-// shift a number of bits to the left
+// shift a number of bits to the left, zero filled
 void shift_bits_left(uint8_t SRC[], uint16_t len, uint32_t shift);
 
- // shift a number of bits to the right
+// shift a number of bits to the right, zero filled
 void shift_bits_right(uint8_t SRC[], uint16_t len, uint32_t shift);
 
 // logic xor two bit arrays
@@ -68,6 +107,19 @@ uint8_t get_position_in_first_byte(uint8_t value);
 // remove padding
 uint8_t padded(schc_bitarray_t* bit_array);
 
+// bit writer
+void schc_bitwriter_init(schc_bitwriter_t* w, uint8_t* ptr, uint32_t offset);
+void schc_bitwriter_put(schc_bitwriter_t* w, uint64_t value, uint8_t len);
+void schc_bitwriter_put_array(schc_bitwriter_t* w, const uint8_t SRC[], uint32_t src_pos, uint32_t len);
+uint32_t schc_bitwriter_flush(schc_bitwriter_t* w);
+uint32_t schc_bitwriter_offset(const schc_bitwriter_t* w);
+
+// bit reader
+void schc_bitreader_init(schc_bitreader_t* r, const uint8_t* ptr, uint32_t offset, uint32_t len);
+uint64_t schc_bitreader_get(schc_bitreader_t* r, uint8_t len);
+void schc_bitreader_get_array(schc_bitreader_t* r, uint8_t DST[], uint32_t dst_pos, uint32_t len);
+uint32_t schc_bitreader_offset(const schc_bitreader_t* r);
+
 
 #ifdef __cplusplus
 }
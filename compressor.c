@@ -20,8 +20,9 @@
 #include <click/config.h>
 #endif
 
-jsmn_parser json_parser;
-jsmntok_t json_token[JSON_TOKENS];
+/* the scratch buffers of the compressor are kept per thread */
+SCHC_THREAD_LOCAL jsmn_parser json_parser;
+SCHC_THREAD_LOCAL jsmntok_t json_token[JSON_TOKENS];
 
 ////////////////////////////////////////////////////////////////////////////////////
 //                                LOCAL FUNCIONS                                  //
@@ -51,68 +52,6 @@ int8_t set_rule_id(struct schc_compression_rule_t* schc_rule, struct schc_device
 	return 1;
 }
 
-/*
- * Combine the different layers to find the SCHC rule entry
- *
- * @param 	ip_rule_id 		the rule id for the IP layer
- * @param 	udp_rule_id		the rule id for the UDP layer
- * @param 	coap_rule_id	the rule id for the CoAP layer
- * @param 	device			the device to find a rule for
- * @param 	mode			the mode for which a rule should be found
- *
- * @return 	schc_rule		the rule that was found
- * 			NULL			if no rule was found
- *
- */
-static struct schc_compression_rule_t* get_schc_rule_by_layer_ids(struct schc_layer_rule_t *ipv6_rule,
-		struct schc_layer_rule_t *udp_rule, struct schc_layer_rule_t *coap_rule, struct schc_device* device) {
-	int i;
-
-	uint8_t rule_mask;
-
-	/* the rule selection is independent from the compiler flags.
-	 * The decompressor's rules MUST match the one selected at the compressor side. */
-	uint8_t layer_mask = (ipv6_rule == NULL) ? 0x00 : 0x04;
-	if (layer_mask != 0x00) {
-		layer_mask |= (udp_rule == NULL) ? 0x00 : 0x02;
-		if (layer_mask & 0x02) {
-			layer_mask |= (coap_rule == NULL) ? 0x00 : 0x01;
-		}
-	}
-
-	if(layer_mask == 0x00) {
-		return NULL; /* all layers are set to NULL, return */
-	}
-
-	for (i = 0; i < device->compression_rule_count; i++) {
-		const struct schc_compression_rule_t* curr_rule = (*device->compression_context)[i];
-        rule_mask = 0x00;
-#if USE_IP6 == 1
-		if (curr_rule->ipv6_rule != NULL &&
-				curr_rule->ipv6_rule == (struct schc_ipv6_rule_t*) ipv6_rule) {
-			rule_mask |= 0x04;
-		}
-#endif
-#if USE_UDP == 1
-		if (curr_rule->udp_rule != NULL &&
-				curr_rule->udp_rule == (struct schc_udp_rule_t*) udp_rule) {
-			rule_mask |= 0x02;
-		}
-#endif
-#if USE_COAP == 1
-		if (curr_rule->coap_rule != NULL &&
-				curr_rule->coap_rule == (struct schc_coap_rule_t*) coap_rule) {
-			rule_mask |= 0x01;
-		}
-#endif
-		if (rule_mask == layer_mask) {
-			return (struct schc_compression_rule_t*) (curr_rule);
-		}
-	}
-
-	return NULL;
-}
-
 /*
  * Find a SCHC rule entry for a device
  *
@@ -124,25 +63,19 @@ static struct schc_compression_rule_t* get_schc_rule_by_layer_ids(struct schc_la
  *
  */
 static struct schc_compression_rule_t* get_compression_rule_by_rule_id(uint8_t* rule_arr, struct schc_device *device) {
-	int i;
+	struct schc_compression_rule_t* rule;
 
 	if (device == NULL) {
 		DEBUG_PRINTF("get_schc_rule(): no device was found for this id \n");
 		return NULL;
 	}
 
-	for (i = 0; i < device->compression_rule_count; i++) {
-		struct schc_compression_rule_t* curr_rule = (struct schc_compression_rule_t*) (*device->compression_context)[i];
-		uint8_t curr_rule_pos = get_position_in_first_byte(device->profile->RULE_ID_SIZE);
-		uint8_t rule_id[4] = { 0 };
-		little_end_uint8_from_uint32(rule_id, curr_rule->rule_id); /* copy the uint32_t to a uint8_t array */
-		if( compare_bits_aligned(rule_id, curr_rule_pos, rule_arr, 0, device->profile->RULE_ID_SIZE)) {
-			DEBUG_PRINTF("get_compression_rule(): curr rule %p \n", (void*) curr_rule);
-			return curr_rule;
-		}
+	get_rules_by_rule_id(rule_arr, device, &rule, NULL);
+	if (rule != NULL) {
+		DEBUG_PRINTF("get_compression_rule(): curr rule %p \n", (void*) rule);
 	}
 
-	return NULL;
+	return rule;
 }
 
 static int _addr_offset(const struct schc_field *field, direction DI)
@@ -184,9 +117,494 @@ static int _addr_offset(const struct schc_field *field, direction DI)
     return 0;
 }
 
-static void compress_action(schc_bitarray_t* dst, schc_bitarray_t* src,
+#if SCHC_MATCHMAP_INDEX == 1 || (SCHC_GENERATED_RULES == 1 && !defined(SCHC_RULEGEN)) \
+		|| SCHC_COMPACT_RULES == 1 || SCHC_COAP_OPTION_ORDER == 1
+/*
+ * Find the slot of a pointer in an open addressing hash table
+ * the tables built at init map a field or rule on what was computed for it, the value
+ * of a key is kept at the index of its slot, in an array next to the keys
+ * a table holds more slots than entries, so the probe always ends on the key or an empty slot
+ *
+ * @param keys			the key of each slot, NULL for an empty slot
+ * @param slot_count	the number of slots
+ * @param key			the pointer to look for
+ *
+ * @return the slot holding the key, or the empty slot to add the key in
+ */
+static uint16_t ptr_table_slot(const void* const* keys, uint16_t slot_count, const void* key) {
+	uintptr_t hash = (uintptr_t) key;
+	uint16_t slot = (uint16_t) ((hash ^ (hash >> 7) ^ (hash >> 13)) % slot_count);
+
+	while (keys[slot] != NULL && keys[slot] != key) {
+		slot = (slot + 1) % slot_count;
+	}
+
+	return slot;
+}
+#endif
+
+#if SCHC_MATCHMAP_INDEX == 1
+/*
+ * The lists of the match-mapping fields are indexed at init.
+ * The entries are sorted on their value, so mo_matchmap() finds the index with a binary search.
+ * The index found by mo_matchmap() is kept, so the MAPPINGSENT action sends it
+ * without searching the list again.
+ */
+#define MATCHMAP_SLOTS				(2 * SCHC_MATCHMAP_TABLES)
+
+typedef struct matchmap_table_t {
+	const struct schc_field* field;
+	/* the list indices, sorted on the value of the entry */
+	uint8_t order[MAX_FIELD_LENGTH];
+	uint8_t count;
+	/* the number of bits to send the index */
+	uint8_t list_len;
+} matchmap_table_t;
+
+/* the index found by the last match of a table, -1 if the value was not in the list */
+typedef struct matchmap_match_t {
+	const uint8_t* ptr;
+	uint16_t offset;
+	int16_t index;
+} matchmap_match_t;
+
+static matchmap_table_t matchmap_tables[SCHC_MATCHMAP_TABLES];
+/* the tables are read only after init, every thread keeps its own matches */
+static SCHC_THREAD_LOCAL matchmap_match_t matchmap_matches[SCHC_MATCHMAP_TABLES];
+static uint16_t matchmap_table_count;
+/* open addressing hash table on the field pointer */
+static const void* matchmap_keys[MATCHMAP_SLOTS];
+static matchmap_table_t* matchmap_slots[MATCHMAP_SLOTS];
+
+/*
+ * Get the value of a list entry
+ */
+static uint64_t matchmap_entry(const struct schc_field* field, uint8_t index) {
+	uint8_t ptr = index;
+	if (!(field->field_length % 8)) // only support byte aligned matchmap
+		ptr = index * get_number_of_bytes_from_bits(field->field_length);
+
+	return get_bits64((uint8_t*) (field->target_value + ptr),
+			get_position_in_first_byte(field->field_length), field->field_length);
+}
+
+/*
+ * Get the index table of a match-mapping field
+ *
+ * @return the table
+ *         NULL if the list of the field is not indexed
+ */
+static matchmap_table_t* matchmap_get(const struct schc_field* field) {
+	return matchmap_slots[ptr_table_slot(matchmap_keys, MATCHMAP_SLOTS, field)];
+}
+
+/*
+ * Index the list of a match-mapping field
+ * fields longer than 64 bits, or with entries outside the target value, are not indexed
+ */
+static void matchmap_add_field(const struct schc_field* field) {
+	uint8_t i, j;
+
+	if (field->MO != &mo_matchmap || field->field_length == 0 || field->field_length > 64
+			|| field->MO_param_length == 0 || field->MO_param_length > MAX_FIELD_LENGTH
+			|| matchmap_get(field) != NULL) {
+		return;
+	}
+	if (matchmap_table_count >= SCHC_MATCHMAP_TABLES) {
+		DEBUG_PRINTF("matchmap_add_field(): no table left, the list is searched entry by entry\n");
+		return;
+	}
+	uint8_t entry_bytes = (field->field_length % 8) ? 1 : get_number_of_bytes_from_bits(field->field_length);
+	if (((field->MO_param_length - 1) * entry_bytes + get_number_of_bytes_from_bits(field->field_length))
+			> MAX_FIELD_LENGTH) {
+		return;
+	}
+
+	matchmap_table_t* table = &matchmap_tables[matchmap_table_count++];
+	table->field = field;
+	table->count = field->MO_param_length;
+	table->list_len = get_required_number_of_bits((field->MO_param_length - 1)); // start from index 0
+	matchmap_matches[table - matchmap_tables] = (matchmap_match_t) { .ptr = NULL, .index = -1 };
+
+	/* insertion sort, equal values keep the list order so the first index is found */
+	for (i = 0; i < table->count; i++) {
+		uint64_t value = matchmap_entry(field, i);
+		for (j = i; j > 0 && matchmap_entry(field, table->order[j - 1]) > value; j--) {
+			table->order[j] = table->order[j - 1];
+		}
+		table->order[j] = i;
+	}
+
+	uint16_t slot = ptr_table_slot(matchmap_keys, MATCHMAP_SLOTS, field);
+	matchmap_keys[slot] = field;
+	matchmap_slots[slot] = table;
+}
+
+/*
+ * Find the list index of a value
+ *
+ * @return the index
+ *         -1 if the value is not in the list
+ */
+static int16_t matchmap_find(const matchmap_table_t* table, uint64_t value) {
+	uint8_t lo = 0, hi = table->count;
+
+	while (lo < hi) {
+		uint8_t mid = (lo + hi) / 2;
+		if (matchmap_entry(table->field, table->order[mid]) < value) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo < table->count && matchmap_entry(table->field, table->order[lo]) == value) {
+		return table->order[lo];
+	}
+
+	return -1;
+}
+#endif
+
+/*
+ * Get the list index of a header field for a match-mapping field
+ *
+ * @param field			the field from the rule
+ * @param field_value	the header, starting at the byte holding the field
+ * @param field_offset	the bit offset of the field in the first byte
+ *
+ * @return the index
+ *         -1 if the value is not in the list
+ */
+static int16_t get_mapping_index(const struct schc_field *field, const uint8_t* field_value,
+		uint16_t field_offset) {
+	uint8_t j;
+
+#if SCHC_MATCHMAP_INDEX == 1
+	/* use the index found by mo_matchmap() for this header */
+	matchmap_table_t* table = matchmap_get(field);
+	if (table != NULL) {
+		const matchmap_match_t* match = &matchmap_matches[table - matchmap_tables];
+		if (match->index >= 0 && match->ptr == field_value && match->offset == field_offset) {
+			return match->index;
+		}
+	}
+#endif
+	uint8_t target_value_offset = get_position_in_first_byte(field->field_length);
+	for (j = 0; j < field->MO_param_length; j++) {
+		uint8_t ptr = j;
+		if (!(field->field_length % 8)) // only support byte aligned matchmap
+			ptr = j * get_number_of_bytes_from_bits(field->field_length); // for multiple byte entry
+
+		if (compare_bit_sequence(field_value, field_offset,
+				(uint8_t*) (field->target_value + ptr), target_value_offset, field->field_length)) {
+			return j; /* found the mapping index */
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Get the number of bits to send the list index of a match-mapping field
+ */
+static uint8_t get_mapping_length(const struct schc_field *field) {
+#if SCHC_MATCHMAP_INDEX == 1
+	matchmap_table_t* table = matchmap_get(field);
+	if (table != NULL) {
+		return table->list_len;
+	}
+#endif
+	return get_required_number_of_bits((field->MO_param_length - 1)); // start from index 0
+}
+
+/*
+ * A match record holds the residue of a layer rule that matched the packet,
+ * as found while matching. It is used to compress the layer without walking the rule again.
+ * The records are kept for the packet that is being compressed.
+ */
+#define MATCH_RECORD_SPANS			((IP6_FIELDS > UDP_FIELDS) ? \
+		((IP6_FIELDS > COAP_FIELDS) ? IP6_FIELDS : COAP_FIELDS) : \
+		((UDP_FIELDS > COAP_FIELDS) ? UDP_FIELDS : COAP_FIELDS))
+
+typedef struct schc_residue_span_t {
+	/* the bit position in the header, or the residue itself */
+	uint32_t value;
+	uint16_t length;
+	uint8_t from_header;
+} schc_residue_span_t;
+
+typedef struct schc_match_record_t {
+	const struct schc_layer_rule_t* rule;
+	uint8_t span_count;
+	schc_residue_span_t spans[MATCH_RECORD_SPANS];
+} schc_match_record_t;
+
+static SCHC_THREAD_LOCAL schc_match_record_t match_records[3][SCHC_MATCH_RECORDS];
+static SCHC_THREAD_LOCAL uint8_t match_record_count[3];
+
+/*
+ * Get the record of a layer rule that matched the packet
+ *
+ * @return the record
+ *         NULL if the layer rule has no record
+ */
+static schc_match_record_t* match_record_get(schc_layer_t layer, const struct schc_layer_rule_t* rule) {
+	uint8_t i;
+
+	for (i = 0; i < match_record_count[layer]; i++) {
+		if (match_records[layer][i].rule == rule) {
+			return &match_records[layer][i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Get a free record to fill while matching a layer rule
+ * the record is only kept once match_record_commit() is called
+ *
+ * @return the record
+ *         NULL if all records are in use
+ */
+static schc_match_record_t* match_record_new(schc_layer_t layer) {
+	if (match_record_count[layer] >= SCHC_MATCH_RECORDS) {
+		return NULL;
+	}
+	match_records[layer][match_record_count[layer]].span_count = 0;
+
+	return &match_records[layer][match_record_count[layer]];
+}
+
+static void match_record_commit(schc_layer_t layer, const struct schc_layer_rule_t* rule) {
+	match_records[layer][match_record_count[layer]++].rule = rule;
+}
+
+/*
+ * Append a residue span to a record
+ * adjacent header bits are sent as a single span
+ */
+static void match_record_span(schc_match_record_t* record, schc_residue_span_t span) {
+	if (span.length == 0) {
+		return;
+	}
+
+	if (record->span_count > 0) {
+		schc_residue_span_t* last = &record->spans[record->span_count - 1];
+		if (span.from_header && last->from_header && (last->value + last->length) == span.value) {
+			last->length += span.length;
+			return;
+		}
+	}
+	record->spans[record->span_count++] = span;
+}
+
+/*
+ * Add the residue of a matched field to a record
+ *
+ * @param record		the record
+ * @param src			the header
+ * @param field			the field from the rule
+ * @param src_offset	the position of the field in the header
+ */
+static void match_record_add(schc_match_record_t* record, const schc_bitarray_t* src,
+		const struct schc_field *field, uint32_t src_offset) {
+	schc_residue_span_t span = { 0, 0, 1 };
+
+	switch (field->action) {
+	case VALUESENT: {
+		span.value = src_offset;
+		span.length = field->field_length;
+	} break;
+	case MAPPINGSENT: {
+		int16_t index = get_mapping_index(field, src->ptr + (src_offset / 8), src_offset % 8);
+		if (index >= 0) {
+			span.value = index;
+			span.length = get_mapping_length(field);
+			span.from_header = 0;
+		}
+	} break;
+	case LSB: {
+		span.value = src_offset + field->MO_param_length;
+		span.length = field->field_length - field->MO_param_length;
+	} break;
+	default:
+		break;
+	}
+	match_record_span(record, span);
+}
+
+/*
+ * The IPv6 interface identifiers of a device, for the DEVIID and APPIID actions
+ * derived from the L2 identifiers of the device for every packet
+ */
+typedef struct schc_iid_t {
+	uint8_t dev[8];
+	uint8_t app[8];
+} schc_iid_t;
+
+/*
+ * Derive an interface identifier from a 64-bit L2 identifier (EUI-64)
+ * as a modified EUI-64, the universal/local bit is inverted (RFC 4291, appendix A)
+ */
+static void iid_from_l2(uint8_t iid[8], uint64_t l2_id) {
+	uint8_t i;
+
+	for (i = 0; i < 8; i++) {
+		iid[i] = (uint8_t) (l2_id >> (56 - 8 * i));
+	}
+	iid[0] ^= 0x02;
+}
+
+/*
+ * Get the interface identifiers of a device
+ * the identifiers are kept per thread, until the next packet
+ *
+ * @return the identifiers
+ */
+static const schc_iid_t* iid_get(const struct schc_device* device) {
+	static SCHC_THREAD_LOCAL schc_iid_t iid;
+
+	iid_from_l2(iid.dev, device->dev_l2_id ? device->dev_l2_id : device->device_id);
+	iid_from_l2(iid.app, device->app_l2_id);
+
+	return &iid;
+}
+
+/*
+ * Get the value of a field derived from the L2 identifiers, the field holds the last bits of the identifier
+ *
+ * @param field 		the field with the DEVIID or APPIID action
+ * @param iid 			the interface identifiers of the device, can be NULL
+ * @param pos 			set to the bit position of the field value in the identifier
+ *
+ * @return the identifier
+ *         NULL if the field is not derived or no identifiers are known
+ */
+static const uint8_t* iid_field(const struct schc_field* field, const schc_iid_t* iid, uint8_t* pos) {
+	if (iid == NULL || field->field_length > 64) {
+		return NULL;
+	}
+	*pos = 64 - field->field_length;
+
+	return (field->action == DEVIID) ? iid->dev : (field->action == APPIID) ? iid->app : NULL;
+}
+
+/**
+ * Compress a layer from the record made while matching
+ *
+ * @param dst	 				the bit writer to append the residue to
+ * @param src	 				the original header
+ * @param record 				the record of the layer rule
+ */
+static void compress_record(schc_bitwriter_t* dst, const schc_bitarray_t* src,
+		const schc_match_record_t* record) {
+	uint8_t i;
+
+	for (i = 0; i < record->span_count; i++) {
+		const schc_residue_span_t* span = &record->spans[i];
+		if (span->from_header) {
+			schc_bitwriter_put_array(dst, src->ptr, span->value, span->length);
+		} else {
+			schc_bitwriter_put(dst, span->value, span->length);
+		}
+	}
+}
+
+#if SCHC_GENERATED_RULES == 1 || defined(SCHC_RULEGEN)
+static uint64_t rulegen_digest_add(uint64_t digest, const uint8_t* data, uint16_t len) {
+	uint16_t i;
+
+	for (i = 0; i < len; i++) {
+		digest = (digest ^ data[i]) * 0x100000001B3ULL; /* FNV-1a */
+	}
+
+	return digest;
+}
+
+/*
+ * Get the digest of a layer rule, over everything the generated code of the rule depends on
+ * the generated code is only used for a rule with the same digest
+ *
+ * @param rule				the layer rule
+ * @param max_layer_fields	the maximum number of fields of the layer
+ *
+ * @return the digest
+ */
+static uint64_t rulegen_digest(const struct schc_layer_rule_t* rule, uint8_t max_layer_fields) {
+	uint8_t head[4] = { rule->up, rule->down, rule->length, max_layer_fields };
+	uint64_t digest = rulegen_digest_add(0xCBF29CE484222325ULL, head, sizeof(head));
+	uint8_t i;
+
+	for (i = 0; i < rule->length; i++) {
+		const struct schc_field* field = &rule->content[i];
+		/* other matching operators are called through the rule */
+		uint8_t mo = (field->MO == &mo_ignore) ? 1 : (field->MO == &mo_equal) ? 2 :
+				(field->MO == &mo_MSB) ? 3 : (field->MO == &mo_matchmap) ? 4 : 0;
+		uint8_t desc[8] = { (uint8_t) (field->field >> 8), (uint8_t) field->field, field->MO_param_length,
+				field->field_length, field->field_pos, (uint8_t) field->dir, (uint8_t) field->action, mo };
+		digest = rulegen_digest_add(digest, desc, sizeof(desc));
+		digest = rulegen_digest_add(digest, field->target_value, MAX_FIELD_LENGTH);
+	}
+
+	return digest;
+}
+#endif
+
+#if SCHC_GENERATED_RULES == 1 && !defined(SCHC_RULEGEN)
+/*
+ * The code generated from the rules by examples/rulegen.c holds a match, compress and decompress
+ * function per layer rule and direction, with the positions, lengths and target values as constants.
+ * A layer rule is bound to its functions at init on its digest, so a rule that was changed
+ * after the code was generated is walked field by field as before.
+ * examples/rulegen.c includes this file with SCHC_RULEGEN defined and does not use the generated code,
+ * so the generator builds before rules/rules_generated.h exists.
+ */
+typedef int8_t (*rulegen_match_t)(const struct schc_layer_rule_t* rule, schc_bitarray_t* src,
+		schc_match_record_t* record, const schc_iid_t* iid);
+typedef void (*rulegen_compress_t)(const struct schc_layer_rule_t* rule, schc_bitwriter_t* dst,
+		schc_bitarray_t* src);
+typedef void (*rulegen_decompress_t)(const struct schc_layer_rule_t* rule, schc_bitreader_t* src,
+		schc_bitarray_t* dst, const schc_iid_t* iid);
+
+typedef struct rulegen_entry_t {
+	uint64_t digest;
+	/* per direction, NULL if the code could not be generated for the direction */
+	rulegen_match_t match[2];
+	rulegen_compress_t compress[2];
+	rulegen_decompress_t decompress[2];
+} rulegen_entry_t;
+
+/*
+ * Report a field the generated code does not match
+ */
+static int8_t rulegen_mismatch(uint16_t field) {
+	DEBUG_PRINTF("match_layer_rule(): %s does not match\n", schc_header_field_names[field]);
+	return 0;
+}
+
+#include "rules/rules_generated.h"
+
+#define RULEGEN_SLOTS				(2 * SCHC_GENERATED_RULE_COUNT + 1)
+
+static uint16_t rulegen_binding_count;
+/* open addressing hash table on the rule pointer */
+static const void* rulegen_keys[RULEGEN_SLOTS];
+static const rulegen_entry_t* rulegen_slots[RULEGEN_SLOTS];
+
+/*
+ * Get the generated code of a layer rule
+ *
+ * @return the entry
+ *         NULL if the rule is not bound to generated code
+ */
+static const rulegen_entry_t* rulegen_get(const struct schc_layer_rule_t* rule) {
+	return rulegen_slots[ptr_table_slot(rulegen_keys, RULEGEN_SLOTS, rule)];
+}
+#endif
+
+static void compress_action(schc_bitwriter_t* dst, schc_bitarray_t* src,
 		const struct schc_field *field, direction DI) {
-	uint8_t j = 0;
 	uint8_t json_result;
 	uint8_t field_length = field->field_length;
 	uint32_t src_offset = src->offset + _addr_offset(field, DI);
@@ -196,8 +614,7 @@ static void compress_action(schc_bitarray_t* dst, schc_bitarray_t* src,
 	}
 		break;
 	case VALUESENT: {
-		copy_bits(dst->ptr, dst->offset, src->ptr, src_offset, field_length);
-		dst->offset += field_length;
+		schc_bitwriter_put_array(dst, src->ptr, src_offset, field_length);
 	}
 		break;
 	case MAPPINGSENT: {
@@ -212,21 +629,9 @@ static void compress_action(schc_bitarray_t* dst, schc_bitarray_t* src,
 
 		/* if the output of the jsmn parser is 0, the array is formatted as a normal unsigned char array */
 		if (json_result == 0) { // formatted as a normal unsigned char array
-			uint8_t list_len = get_required_number_of_bits(
-					(field->MO_param_length - 1)); // start from index 0
-			for (j = 0; j < field->MO_param_length; j++) {
-				uint8_t ptr = j;
-				if (!(field_length % 8)) // only support byte aligned matchmap
-					ptr = j * get_number_of_bytes_from_bits(field_length); // for multiple byte entry
-
-				if(compare_bit_sequence(
-						src->ptr, src_offset, (uint8_t*) (field->target_value + ptr), 0, field_length)) {
-					uint8_t ind[1] = { j }; // room for 255 indices
-					uint8_t src_pos = get_position_in_first_byte(list_len);
-					copy_bits(dst->ptr, dst->offset, ind, src_pos, list_len);
-					dst->offset += list_len;
-					break; /* found the mapping index */
-				}
+			int16_t index = get_mapping_index(field, src->ptr + (src_offset / 8), src_offset % 8);
+			if (index >= 0) {
+				schc_bitwriter_put(dst, index, get_mapping_length(field)); // room for 255 indices
 			}
 
 		} else {
@@ -261,9 +666,7 @@ static void compress_action(schc_bitarray_t* dst, schc_bitarray_t* src,
 		break;
 	case LSB: {
 		uint16_t lsb_len = field->field_length - field->MO_param_length;
-		copy_bits(dst->ptr, dst->offset, (uint8_t*) (src->ptr),
-				field->MO_param_length + src_offset, lsb_len);
-		dst->offset += lsb_len;
+		schc_bitwriter_put_array(dst, src->ptr, field->MO_param_length + src_offset, lsb_len);
 	}
 		break;
 	case COMPLENGTH:
@@ -271,12 +674,9 @@ static void compress_action(schc_bitarray_t* dst, schc_bitarray_t* src,
 		// do nothing
 	}
 		break;
-	case DEVIID: {
-		// ToDo
-	}
-		break;
+	case DEVIID:
 	case APPIID: {
-		// ToDo
+		// do nothing, the value is derived from the L2 identifier
 	}
 		break;
 	}
@@ -286,19 +686,26 @@ static void compress_action(schc_bitarray_t* dst, schc_bitarray_t* src,
 /**
  * The compression mechanism
  *
- * @param dst_arr	 			the bit array in which to copy the contents to
+ * @param dst	 				the bit writer to append the residue to
  * @param src_arr 				the original header
  * @param rule 					the rule to match the compression with
  *
  * @return the length 			length of the compressed header
  *
  */
-static uint8_t compress(schc_bitarray_t* dst, schc_bitarray_t* src,
+static uint8_t compress(schc_bitwriter_t* dst, schc_bitarray_t* src,
 		const struct schc_layer_rule_t *rule, direction DI) {
 	uint8_t i = 0;
 	if(rule == NULL) {
 		return 0;
 	}
+#if SCHC_GENERATED_RULES == 1 && !defined(SCHC_RULEGEN)
+	const rulegen_entry_t* generated = rulegen_get(rule);
+	if (generated != NULL && generated->compress[DI] != NULL) {
+		generated->compress[DI](rule, dst, src);
+		return 1;
+	}
+#endif
 
 	for (i = 0; i < rule->length; i++) {
 		// exclude fields in other direction
@@ -309,8 +716,45 @@ static uint8_t compress(schc_bitarray_t* dst, schc_bitarray_t* src,
 	return 1;
 }
 
-static void decompress_action(struct schc_field *field, schc_bitarray_t* src,
-		schc_bitarray_t *dst, direction DI)
+/**
+ * Get the length of the residue a rule sends
+ * the residue of each action has a fixed length
+ *
+ * @param rule 					the rule
+ * @param DI					the direction
+ *
+ * @return the length 			the number of residue bits
+ *
+ */
+static uint16_t get_residue_length(const struct schc_layer_rule_t *rule, direction DI) {
+	uint16_t length = 0;
+	uint8_t i = 0;
+
+	for (i = 0; i < rule->length; i++) {
+		const struct schc_field *field = &rule->content[i];
+		if (field->dir != BI && field->dir != DI) {
+			continue;
+		}
+		switch (field->action) {
+		case VALUESENT:
+			length += field->field_length;
+			break;
+		case MAPPINGSENT:
+			length += get_required_number_of_bits((field->MO_param_length - 1));
+			break;
+		case LSB:
+			length += field->field_length - field->MO_param_length;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return length;
+}
+
+static void decompress_action(struct schc_field *field, schc_bitreader_t* src,
+		schc_bitarray_t *dst, direction DI, const schc_iid_t* iid)
 {
 	uint8_t field_length; int8_t json_result = -1;
 	uint32_t dst_offset = dst->offset + _addr_offset(field, DI);
@@ -325,8 +769,7 @@ static void decompress_action(struct schc_field *field, schc_bitarray_t* src,
 	} break;
 	case VALUESENT: {
 		// build from received value
-		copy_bits(dst->ptr, dst_offset, src->ptr, src->offset, field_length);
-		src->offset += field_length;
+		schc_bitreader_get_array(src, dst->ptr, dst_offset, field_length);
 	} break;
 	case MAPPINGSENT: {
 		// reset the parser
@@ -340,21 +783,18 @@ static void decompress_action(struct schc_field *field, schc_bitarray_t* src,
 		// if result is 0,
 		if (json_result == 0) { // formatted as a normal unsigned uint8_t array
 			uint32_t list_len = get_required_number_of_bits( (field->MO_param_length - 1) ); // start from index 0
-			uint8_t src_pos = get_position_in_first_byte(list_len);
 
-			uint8_t map_index[1] = { 0 }; /* variable to store the index */
-			copy_bits((uint8_t*) (map_index), src_pos, src->ptr, src->offset, list_len); /* copy the index from the received header */
+			uint8_t map_index = schc_bitreader_get(src, list_len); /* get the index from the received header */
 			if( ! (field_length % 8) ) // multiply with byte alligned field length
-				map_index[0] = map_index[0] * get_number_of_bytes_from_bits(field_length);
+				map_index = map_index * get_number_of_bytes_from_bits(field_length);
 
 			uint8_t target_value_offset = (field_length % 8);
 			if(target_value_offset)
 				target_value_offset = 8 - target_value_offset;
 
 			copy_bits(dst->ptr, dst_offset,
-					(uint8_t*) (field->target_value + map_index[0]),
+					(uint8_t*) (field->target_value + map_index),
 					target_value_offset, field_length);
-			src->offset += list_len;
 		}
 
 //		} else if(json_result > 0) {
@@ -382,37 +822,22 @@ static void decompress_action(struct schc_field *field, schc_bitarray_t* src,
 		copy_bits(dst->ptr, dst_offset, field->target_value, 0, msb_len);
 
 		// .. and from received value
-		copy_bits(dst->ptr, dst_offset + msb_len, src->ptr, src->offset, lsb_len);
-		src->offset += lsb_len;
+		schc_bitreader_get_array(src, dst->ptr, dst_offset + msb_len, lsb_len);
 	} break;
 	case COMPLENGTH:
 	case COMPCHK: {
 		clear_bits(dst->ptr, dst_offset, field_length); // set to 0, to indicate that it will be calculated after decompression
 	} break;
-	case DEVIID: {
-//		if (!strcmp(field->field, "src iid")) {
-//
-//			schc_ipaddr_t node_ip;
-//			get_node_ip(node_ip);
-//
-//			unsigned char ip_addr[8] = {
-//					(node_ip[4] & 0xFF),
-//					(node_ip[4] & 0xFF00) >> 8,
-//					(node_ip[5] & 0xFF),
-//					(node_ip[5] & 0xFF00) >> 8,
-//					(node_ip[6] & 0xFF),
-//					(node_ip[6] & 0xFF00) >> 8,
-//					(node_ip[7] & 0xFF),
-//					(node_ip[7] & 0xFF00) >> 8,
-//			};
-//
-//			for (j = 0; j < field_length; j++) {
-//				schc_header[index + j] = ip_addr[j];
-//			}
-//		}
-	} break;
+	case DEVIID:
 	case APPIID: {
-		// build iid from L2 server address
+		// build the iid from the L2 identifier of the device or the application
+		uint8_t pos;
+		const uint8_t* value = iid_field(field, iid, &pos);
+		if (value != NULL) {
+			copy_bits(dst->ptr, dst_offset, value, pos, field_length);
+		} else {
+			clear_bits(dst->ptr, dst_offset, field_length);
+		}
 	} break;
 	}
 
@@ -423,192 +848,1697 @@ static void decompress_action(struct schc_field *field, schc_bitarray_t* src,
  * The decompression mechanism
  *
  * @param rule 			pointer to the rule to use during the decompression
- * @param src			the received SCHC bit buffer
+ * @param src			the bit reader on the received SCHC residue
  * @param dst			the buffer to store the decompressed, original packet
+ * @param iid			the interface identifiers of the device, can be NULL
  *
  * @return the length of the decompressed header
  *
  */
-static uint8_t decompress(struct schc_layer_rule_t* rule, schc_bitarray_t* src,
-		schc_bitarray_t* dst, direction DI) {
+static uint8_t decompress(struct schc_layer_rule_t* rule, schc_bitreader_t* src,
+		schc_bitarray_t* dst, direction DI, const schc_iid_t* iid) {
 	uint8_t i = 0;
 
 	/* rule for layer can be set to NULL */
 	if(rule == NULL)
 		return 0;
-
-	for (i = 0; i < rule->length; i++) {
+#if SCHC_GENERATED_RULES == 1 && !defined(SCHC_RULEGEN)
+	const rulegen_entry_t* generated = rulegen_get(rule);
+	if (generated != NULL && generated->decompress[DI] != NULL) {
+		generated->decompress[DI](rule, src, dst, iid);
+		return 1;
+	}
+#endif
+
+	for (i = 0; i < rule->length; i++) {
 		// exclude fields in other direction
 		if (((rule->content[i].dir) == BI) || ((rule->content[i].dir) == DI)) {
-			decompress_action(&rule->content[i], src, dst, DI);
+			decompress_action(&rule->content[i], src, dst, DI, iid);
+		}
+	}
+
+	return 1;
+}
+
+static int _do_mo(schc_bitarray_t *src, struct schc_field *field, direction DI, const schc_iid_t* iid) {
+	uint32_t src_offset = src->offset + _addr_offset(field, DI);
+
+	/* the field must be present in the header */
+	if ((src_offset + field->field_length) > BYTES_TO_BITS(src->len)) {
+		return 0;
+	}
+	if (field->MO(field,
+			(uint8_t*) (src->ptr + (src_offset / 8)), (src_offset % 8))) { // compare header field and rule field using the matching operator
+		if (field->action == DEVIID || field->action == APPIID) {
+			/* the field is elided, so it must equal the value derived from the L2 identifier */
+			uint8_t pos;
+			const uint8_t* value = iid_field(field, iid, &pos);
+			if (value == NULL || get_bits64(src->ptr, src_offset, field->field_length)
+					!= get_bits64(value, pos, field->field_length)) {
+				return 0;
+			}
+		}
+		src->offset += field->field_length;
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Get the maximum number of fields in a rule for a layer
+ *
+ * @param layer				the layer
+ *
+ * @return the maximum number of fields
+ */
+static uint8_t get_layer_field_count(schc_layer_t layer) {
+	switch (layer) {
+#if USE_IP6 == 1
+	case SCHC_IPV6:
+		return IP6_FIELDS;
+#endif
+#if USE_UDP == 1
+	case SCHC_UDP:
+		return UDP_FIELDS;
+#endif
+#if USE_COAP == 1
+	case SCHC_COAP:
+		return COAP_FIELDS;
+#endif
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Get the rule for a layer from a compression rule
+ *
+ * @param rule				the compression rule
+ * @param layer				the layer to get the rule for
+ *
+ * @return the layer rule
+ *         NULL if the compression rule has no rule for this layer
+ */
+static struct schc_layer_rule_t* get_layer_rule(const struct schc_compression_rule_t* rule,
+		schc_layer_t layer) {
+#if USE_IP6 == 1
+	if(layer == SCHC_IPV6) {
+		return (struct schc_layer_rule_t*) rule->ipv6_rule;
+	}
+#endif
+#if USE_UDP == 1
+	if(layer == SCHC_UDP) {
+		return (struct schc_layer_rule_t*) rule->udp_rule;
+	}
+#endif
+#if USE_COAP == 1
+	if (layer == SCHC_COAP) {
+		return (struct schc_layer_rule_t*) rule->coap_rule;
+	}
+#endif
+	return NULL;
+}
+
+#if SCHC_COMPACT_RULES == 1
+/*
+ * The layer rules are compiled at init into compact descriptors, which the matcher walks
+ * instead of the rules. A descriptor holds the fields of each direction, with the bit position
+ * of the field in the layer, the matching operator as an enum and the target value as an offset
+ * in a pool shared by all rules, so equal target values are stored once.
+ * The rule itself is only read for match-mapping lists, other matching operators and the residue.
+ */
+#define COMPACT_RULE_SLOTS			(2 * SCHC_COMPACT_RULE_COUNT + 1)
+
+typedef enum {
+	COMPACT_MO_IGNORE = 0,
+	COMPACT_MO_EQUAL = 1,
+	COMPACT_MO_MSB = 2,
+	COMPACT_MO_OTHER = 3 /* called through the matching operator of the rule */
+} compact_mo_t;
+
+typedef struct compact_field_t {
+	/* the bit position of the field, from the start of the layer */
+	uint16_t pos;
+	/* the offset of the target value in the pool */
+	uint16_t value;
+	uint8_t length;
+	uint8_t mo_param;
+	uint8_t mo;
+	uint8_t action;
+	/* the bit position of the target value in its first byte */
+	uint8_t value_pos;
+	/* the index of the field in the rule */
+	uint8_t index;
+} compact_field_t;
+
+typedef struct compact_rule_t {
+	const struct schc_layer_rule_t* rule;
+	uint16_t first[2];
+	uint8_t count[2];
+	/* the number of bits the fields of a direction take */
+	uint16_t length[2];
+} compact_rule_t;
+
+static compact_rule_t compact_rules[SCHC_COMPACT_RULE_COUNT];
+static uint16_t compact_rule_count;
+static compact_field_t compact_fields[SCHC_COMPACT_FIELDS];
+static uint16_t compact_field_count;
+static uint8_t compact_pool[SCHC_COMPACT_POOL_BYTES];
+static uint16_t compact_pool_len;
+/* open addressing hash table on the rule pointer */
+static const void* compact_keys[COMPACT_RULE_SLOTS];
+static compact_rule_t* compact_slots[COMPACT_RULE_SLOTS];
+
+/*
+ * Get the descriptor of a layer rule
+ *
+ * @return the descriptor
+ *         NULL if the rule was not compiled
+ */
+static const compact_rule_t* compact_get(const struct schc_layer_rule_t* rule) {
+	return compact_slots[ptr_table_slot(compact_keys, COMPACT_RULE_SLOTS, rule)];
+}
+
+/*
+ * Store a target value in the pool, a value already in the pool is reused
+ *
+ * @return the offset in the pool
+ *         -1 if the pool is full
+ */
+static int32_t compact_pool_add(const uint8_t* value, uint8_t len) {
+	uint16_t i;
+
+	for (i = 0; i + len <= compact_pool_len; i++) {
+		if (!memcmp(compact_pool + i, value, len)) {
+			return i;
+		}
+	}
+	if (compact_pool_len + len > SCHC_COMPACT_POOL_BYTES) {
+		return -1;
+	}
+	memcpy(compact_pool + compact_pool_len, value, len);
+	compact_pool_len += len;
+
+	return compact_pool_len - len;
+}
+
+/*
+ * Compile the fields of a direction of a layer rule, walked as in match_layer_rule()
+ *
+ * @return 1 on success
+ *         0 if the rule can not be compiled
+ */
+static uint8_t compact_add_direction(compact_rule_t* compact, uint8_t max_layer_fields, direction DI) {
+	const struct schc_layer_rule_t* rule = compact->rule;
+	uint8_t dir_length = (DI == UP) ? rule->up : rule->down;
+	int32_t pos = 0;
+	uint8_t j = 0, k = 0;
+
+	compact->first[DI] = compact_field_count;
+	while (j < dir_length) {
+		if (k >= rule->length) {
+			return 0;
+		}
+		const struct schc_field* field = &rule->content[k];
+		if ((field->dir == BI) || (field->dir == DI)) {
+			int32_t field_pos = pos + _addr_offset(field, DI);
+			if (compact_field_count >= SCHC_COMPACT_FIELDS || field_pos < 0 || field_pos > UINT16_MAX) {
+				return 0;
+			}
+			compact_field_t* f = &compact_fields[compact_field_count];
+			*f = (compact_field_t) { .pos = (uint16_t) field_pos, .length = field->field_length,
+					.mo_param = field->MO_param_length, .action = field->action, .index = k };
+			int32_t value = 0;
+			if (field->MO == &mo_ignore) {
+				f->mo = COMPACT_MO_IGNORE;
+			} else if (field->MO == &mo_equal && BITS_TO_BYTES(field->field_length) <= MAX_FIELD_LENGTH) {
+				f->mo = COMPACT_MO_EQUAL;
+				f->value_pos = get_position_in_first_byte(field->field_length);
+				value = compact_pool_add(field->target_value, BITS_TO_BYTES(field->field_length));
+			} else if (field->MO == &mo_MSB && BITS_TO_BYTES(field->MO_param_length) <= MAX_FIELD_LENGTH) {
+				f->mo = COMPACT_MO_MSB;
+				value = compact_pool_add(field->target_value, BITS_TO_BYTES(field->MO_param_length));
+			} else {
+				f->mo = COMPACT_MO_OTHER;
+			}
+			if (value < 0) {
+				return 0;
+			}
+			f->value = (uint16_t) value;
+			compact_field_count++;
+			pos += field->field_length;
+			j++;
+		}
+		k++;
+		if (k > max_layer_fields) {
+			return 0;
+		}
+	}
+	if (pos > UINT16_MAX) {
+		return 0;
+	}
+	compact->count[DI] = (uint8_t) (compact_field_count - compact->first[DI]);
+	compact->length[DI] = (uint16_t) pos;
+
+	return 1;
+}
+
+/*
+ * Compile a layer rule
+ * a rule that does not fit or holds more fields than the layer allows is matched as is
+ */
+static void compact_add_rule(const struct schc_layer_rule_t* rule, uint8_t max_layer_fields) {
+	if (rule == NULL || compact_get(rule) != NULL) {
+		return;
+	}
+	if (compact_rule_count >= SCHC_COMPACT_RULE_COUNT) {
+		DEBUG_PRINTF("compact_add_rule(): no descriptor left, the rule is matched as is\n");
+		return;
+	}
+
+	uint16_t field_count = compact_field_count;
+	uint16_t pool_len = compact_pool_len;
+	compact_rule_t* compact = &compact_rules[compact_rule_count];
+	compact->rule = rule;
+	if (!compact_add_direction(compact, max_layer_fields, UP)
+			|| !compact_add_direction(compact, max_layer_fields, DOWN)) {
+		DEBUG_PRINTF("compact_add_rule(): the rule is matched as is\n");
+		compact_field_count = field_count;
+		compact_pool_len = pool_len;
+		return;
+	}
+	compact_rule_count++;
+
+	uint16_t slot = ptr_table_slot(compact_keys, COMPACT_RULE_SLOTS, rule);
+	compact_keys[slot] = rule;
+	compact_slots[slot] = compact;
+}
+
+/*
+ * Match the header against a compiled layer rule, as match_layer_rule() does
+ * on a match, the bit array offset is moved to the end of the layer
+ *
+ * @return 1 if all fields match
+ *         0 if a field doesn't match
+ */
+static int8_t compact_match(const compact_rule_t* compact, schc_bitarray_t* src, direction DI,
+		schc_match_record_t* record, const schc_iid_t* iid) {
+	const compact_field_t* f = &compact_fields[compact->first[DI]];
+	const compact_field_t* last = f + compact->count[DI];
+	uint32_t start = src->offset;
+	uint32_t end = BYTES_TO_BITS(src->len);
+
+	for (; f < last; f++) {
+		uint32_t pos = start + f->pos;
+		uint8_t match;
+
+		/* the field must be present in the header */
+		if ((pos + f->length) > end) {
+			return 0;
+		}
+		switch (f->mo) {
+		case COMPACT_MO_IGNORE:
+			match = 1;
+			break;
+		case COMPACT_MO_EQUAL:
+			if (f->length <= 64) {
+				match = (get_bits64(src->ptr, pos, f->length)
+						== get_bits64(compact_pool + f->value, f->value_pos, f->length));
+			} else {
+				match = compare_bit_sequence(compact_pool + f->value, f->value_pos, src->ptr, pos, f->length);
+			}
+			break;
+		case COMPACT_MO_MSB:
+			match = compare_bit_sequence(compact_pool + f->value, 0, src->ptr, pos, f->mo_param);
+			break;
+		default: {
+			struct schc_field* field = (struct schc_field*) &compact->rule->content[f->index];
+			match = field->MO(field, (uint8_t*) (src->ptr + (pos / 8)), (pos % 8));
+		} break;
+		}
+		if (match && (f->action == DEVIID || f->action == APPIID)) {
+			/* the field is elided, so it must equal the value derived from the L2 identifier */
+			uint8_t value_pos;
+			const uint8_t* value = iid_field(&compact->rule->content[f->index], iid, &value_pos);
+			match = (value != NULL && get_bits64(src->ptr, pos, f->length) == get_bits64(value, value_pos, f->length));
+		}
+		if (!match) {
+			DEBUG_PRINTF("match_layer_rule(): %s does not match\n",
+					schc_header_field_names[compact->rule->content[f->index].field]);
+			return 0;
+		}
+		if (record != NULL) {
+			match_record_add(record, src, &compact->rule->content[f->index], pos);
+		}
+	}
+	src->offset = start + compact->length[DI];
+
+	return 1;
+}
+
+/*
+ * Compile the layer rules of all devices
+ */
+static void compact_init(void) {
+	struct schc_device* device;
+	uint32_t i = 0;
+	uint16_t j;
+
+	compact_rule_count = 0; compact_field_count = 0; compact_pool_len = 0;
+	memset(compact_keys, 0, sizeof(compact_keys));
+	memset(compact_slots, 0, sizeof(compact_slots));
+
+	while ((device = get_context_by_index(i++)) != NULL) {
+		for (j = 0; j < device->compression_rule_count; j++) {
+			const struct schc_compression_rule_t* rule = (*device->compression_context)[j];
+			schc_layer_t layer;
+			for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+				compact_add_rule(get_layer_rule(rule, layer), get_layer_field_count(layer));
+			}
+		}
+	}
+
+	DEBUG_PRINTF("compact_init(): %d rules, %d fields, %d target value bytes\n",
+			compact_rule_count, compact_field_count, compact_pool_len);
+}
+#endif
+
+#if SCHC_GENERATED_RULES == 1 && !defined(SCHC_RULEGEN)
+/*
+ * Bind the layer rules of all devices to the generated code with the same digest
+ */
+static void rulegen_init(void) {
+	struct schc_device* device;
+	uint32_t i = 0;
+	uint16_t j, k, skipped = 0;
+
+	rulegen_binding_count = 0;
+	memset(rulegen_keys, 0, sizeof(rulegen_keys));
+	memset(rulegen_slots, 0, sizeof(rulegen_slots));
+
+	while ((device = get_context_by_index(i++)) != NULL) {
+		for (j = 0; j < device->compression_rule_count; j++) {
+			schc_layer_t layer;
+			for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+				const struct schc_layer_rule_t* rule = get_layer_rule((*device->compression_context)[j], layer);
+				if (rule == NULL || rulegen_get(rule) != NULL) {
+					continue;
+				}
+				uint64_t digest = rulegen_digest(rule, get_layer_field_count(layer));
+				k = 0;
+				while (k < RULEGEN_ENTRY_COUNT && rulegen_entries[k].digest != digest) {
+					k++;
+				}
+				if (k == RULEGEN_ENTRY_COUNT || rulegen_binding_count >= SCHC_GENERATED_RULE_COUNT) {
+					skipped++;
+					continue;
+				}
+				uint16_t slot = ptr_table_slot(rulegen_keys, RULEGEN_SLOTS, rule);
+				rulegen_keys[slot] = rule;
+				rulegen_slots[slot] = &rulegen_entries[k];
+				rulegen_binding_count++;
+			}
+		}
+	}
+
+	DEBUG_PRINTF("rulegen_init(): %d layer rules use generated code, %d are walked field by field\n",
+			rulegen_binding_count, skipped);
+}
+#endif
+
+/**
+ * Match the header against a single layer rule
+ * on a match, the bit array offset is moved to the end of the layer
+ *
+ * @param src				the bit array holding the header
+ * @param rule				the layer rule
+ * @param max_layer_fields	the maximum number of fields for the layer
+ * @param DI				the direction
+ * @param record			filled with the residue of the matched fields, can be NULL
+ * @param iid				the interface identifiers of the device, can be NULL
+ *
+ * @return 1 if all fields match
+ *         0 if a field doesn't match
+ *        -1 if the rule holds more fields than the layer allows
+ */
+static int8_t match_layer_rule(schc_bitarray_t* src, struct schc_layer_rule_t* rule,
+		uint8_t max_layer_fields, direction DI, schc_match_record_t* record, const schc_iid_t* iid) {
+#if SCHC_GENERATED_RULES == 1 && !defined(SCHC_RULEGEN)
+	const rulegen_entry_t* generated = rulegen_get(rule);
+	if (generated != NULL && generated->match[DI] != NULL) {
+		return generated->match[DI](rule, src, record, iid);
+	}
+#endif
+#if SCHC_COMPACT_RULES == 1
+	const compact_rule_t* compact = compact_get(rule);
+	if (compact != NULL) {
+		return compact_match(compact, src, DI, record, iid);
+	}
+#endif
+	uint32_t prev_offset = src->offset;
+	uint8_t j = 0; uint8_t k = 0;
+	uint8_t dir_length = (DI == UP) ? rule->up : rule->down;
+
+	while (j < dir_length) {
+		// exclude fields in other direction
+		if ((rule->content[k].dir == BI) || (rule->content[k].dir == DI)) {
+			uint32_t src_offset = src->offset + _addr_offset(&rule->content[k], DI);
+			if (!_do_mo(src, &rule->content[k], DI, iid)) {
+				DEBUG_PRINTF(
+						"match_layer_rule(): %s does not match\n", schc_header_field_names[rule->content[k].field]);
+				src->offset = prev_offset; // reset offset
+				return 0;
+			}
+			if (record != NULL) {
+				match_record_add(record, src, &rule->content[k], src_offset);
+			}
+			j++;
+		}
+		k++; // increment to skip other directions
+		if(k > max_layer_fields) { // todo coap <-> ipv6
+			DEBUG_PRINTF("match_layer_rule(): more fields present than LAYER_FIELDS \n");
+			src->offset = prev_offset;
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+#if SCHC_MATCHMAP_INDEX == 1
+/*
+ * Index the match-mapping lists of all rules
+ */
+static void matchmap_init(void) {
+	struct schc_device* device;
+	uint32_t i = 0;
+	uint16_t j;
+	uint8_t k;
+
+	matchmap_table_count = 0;
+	memset(matchmap_keys, 0, sizeof(matchmap_keys));
+	memset(matchmap_slots, 0, sizeof(matchmap_slots));
+
+	while ((device = get_context_by_index(i++)) != NULL) {
+		for (j = 0; j < device->compression_rule_count; j++) {
+			schc_layer_t layer;
+			for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+				struct schc_layer_rule_t* rule = get_layer_rule((*device->compression_context)[j], layer);
+				if (rule == NULL) {
+					continue;
+				}
+				for (k = 0; k < rule->length && k < get_layer_field_count(layer); k++) {
+					matchmap_add_field(&rule->content[k]);
+				}
+			}
+		}
+	}
+
+	DEBUG_PRINTF("matchmap_init(): %d match-mapping lists indexed\n", matchmap_table_count);
+}
+#endif
+
+#if SCHC_RULE_TREE == 1
+/*
+ * The layer rules of a device are compiled into a decision tree per layer and direction.
+ * An inner node reads a key from the header, i.e. the bits at an offset relative to the
+ * start of the layer, and branches on the values the rules expect for that key.
+ * Rules that don't constrain the key are part of every branch.
+ * The rules left in a leaf are matched field by field.
+ *
+ * Each compression rule is stored as the index of its layer rules in the per layer lists
+ * of the device, so the compression rule is found by testing the matching layer rules.
+ * The residue length of each layer rule is stored next to it.
+ */
+#define RULE_TREE_NONE				-2 /* no tree, search rule by rule */
+#define RULE_TREE_EMPTY				-1 /* no rule can match */
+#define RULE_TREE_MAX_RULES			256
+#define RULE_TREE_MAX_KEYS			64
+#define RULE_TREE_MAX_VALUES		MAX_FIELD_LENGTH
+#define RULE_TREE_MAX_FIELDS		(IP6_FIELDS + UDP_FIELDS + COAP_FIELDS)
+#define RULE_TREE_NO_RULE			0xFF /* the compression rule has no rule for the layer */
+
+typedef struct rule_tree_node_t {
+	/* the key offset in bits, relative to the start of the layer */
+	uint16_t offset;
+	/* the key length in bits, 0 for a leaf */
+	uint8_t length;
+	/* the node to continue with if no branch matches */
+	int16_t wildcard;
+	/* the first branch, or the first rule for a leaf */
+	uint16_t first;
+	/* the number of branches, or the number of rules for a leaf */
+	uint16_t count;
+} rule_tree_node_t;
+
+typedef struct rule_tree_branch_t {
+	uint64_t value;
+	int16_t child;
+} rule_tree_branch_t;
+
+typedef struct rule_tree_key_t {
+	uint16_t offset;
+	uint8_t length;
+} rule_tree_key_t;
+
+typedef struct rule_tree_t {
+	const struct schc_device* device;
+	/* the root node for each layer and direction */
+	int16_t root[3][2];
+	/* the distinct layer rules of the device, for each layer */
+	uint16_t layer_first[3];
+	uint8_t layer_count[3];
+	/* the layer rule indices of the first compression rule */
+	uint16_t rule_first;
+} rule_tree_t;
+
+typedef struct rule_tree_set_t {
+	uint32_t bits[RULE_TREE_MAX_RULES / 32];
+} rule_tree_set_t;
+
+static rule_tree_t rule_trees[SCHC_RULE_TREE_DEVICES];
+static uint8_t rule_tree_count;
+static rule_tree_node_t rule_tree_nodes[SCHC_RULE_TREE_NODES];
+static uint16_t rule_tree_node_count;
+static rule_tree_branch_t rule_tree_branches[SCHC_RULE_TREE_BRANCHES];
+static uint16_t rule_tree_branch_count;
+static uint8_t rule_tree_leaves[SCHC_RULE_TREE_LEAF_ENTRIES];
+static uint16_t rule_tree_leaf_count;
+static struct schc_layer_rule_t* rule_tree_layer_rules[3 * SCHC_RULE_TREE_RULES];
+static uint16_t rule_tree_residue_lengths[3 * SCHC_RULE_TREE_RULES][2];
+static uint16_t rule_tree_layer_rule_count;
+static uint8_t rule_tree_rules[SCHC_RULE_TREE_RULES][3];
+static uint16_t rule_tree_rule_count;
+
+/* scratch space, only used while building a tree */
+static struct {
+	struct schc_layer_rule_t** rules;
+	uint16_t rule_count;
+	uint64_t rule_keys[RULE_TREE_MAX_RULES]; /* the keys constrained by each rule */
+	rule_tree_key_t keys[RULE_TREE_MAX_KEYS];
+	uint8_t key_count;
+	uint8_t max_layer_fields;
+	direction DI;
+	uint8_t full;
+} rule_tree_build;
+
+/*
+ * Get the key a field constrains and the accepted values
+ * only the equal, MSB and match-map operators constrain a key
+ *
+ * @param field			the field from the rule
+ * @param offset		the offset of the field, relative to the start of the layer
+ * @param key			set to the key
+ * @param values		set to the values the key can take, can be NULL
+ *
+ * @return the number of values
+ *         0 if the field doesn't constrain a key
+ */
+static uint8_t rule_tree_field_key(struct schc_field* field, int32_t offset,
+		rule_tree_key_t* key, uint64_t* values) {
+	uint8_t i, count = 1;
+
+	if (offset < 0 || offset > UINT16_MAX) {
+		return 0;
+	}
+	key->offset = offset;
+
+	if (field->MO == &mo_equal || field->MO == &mo_matchmap) {
+		key->length = field->field_length;
+	} else if (field->MO == &mo_MSB) {
+		key->length = field->MO_param_length;
+	} else {
+		return 0;
+	}
+	if (key->length == 0 || key->length > 64) {
+		return 0;
+	}
+
+	if (field->MO == &mo_equal) {
+		if (values) {
+			values[0] = get_bits64(field->target_value,
+					get_position_in_first_byte(field->field_length), field->field_length);
+		}
+	} else if (field->MO == &mo_MSB) {
+		if (values) {
+			values[0] = get_bits64(field->target_value, 0, field->MO_param_length);
+		}
+	} else {
+		count = field->MO_param_length;
+		if (count == 0 || count > RULE_TREE_MAX_VALUES) {
+			return 0;
+		}
+		for (i = 0; values && i < count; i++) {
+			uint8_t ptr = i;
+			if (! (field->field_length % 8) )
+				ptr = i * get_number_of_bytes_from_bits(field->field_length);
+			if ((ptr + get_number_of_bytes_from_bits(field->field_length)) > MAX_FIELD_LENGTH) {
+				return 0;
+			}
+			values[i] = get_bits64((uint8_t*) (field->target_value + ptr),
+					get_position_in_first_byte(field->field_length), field->field_length);
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Get the fields of a layer rule for a direction, with their offset
+ * relative to the start of the layer, as matched by match_layer_rule()
+ *
+ * @param rule			the layer rule
+ * @param fields		set to the fields
+ * @param offsets		set to the field offsets
+ *
+ * @return the number of fields
+ *         -1 if the rule holds more fields than the layer allows
+ */
+static int16_t rule_tree_fields(struct schc_layer_rule_t* rule,
+		struct schc_field** fields, int32_t* offsets) {
+	direction DI = rule_tree_build.DI;
+	uint8_t j = 0; uint8_t k = 0;
+	uint8_t dir_length = (DI == UP) ? rule->up : rule->down;
+	int32_t offset = 0;
+
+	while (j < dir_length) {
+		if (k >= rule_tree_build.max_layer_fields || j >= RULE_TREE_MAX_FIELDS) {
+			return -1;
+		}
+		if ((rule->content[k].dir == BI) || (rule->content[k].dir == DI)) {
+			fields[j] = &rule->content[k];
+			offsets[j] = offset + _addr_offset(&rule->content[k], DI);
+			offset += rule->content[k].field_length;
+			j++;
+		}
+		k++;
+	}
+
+	return j;
+}
+
+/*
+ * Get the values a rule accepts for a key
+ *
+ * @return the number of values
+ *         0 if the rule doesn't constrain the key
+ */
+static uint8_t rule_tree_rule_values(uint16_t rule, uint8_t key, uint64_t* values) {
+	struct schc_field* fields[RULE_TREE_MAX_FIELDS];
+	int32_t offsets[RULE_TREE_MAX_FIELDS];
+	int16_t i, count;
+
+	if (!(rule_tree_build.rule_keys[rule] & (1ULL << key))) {
+		return 0;
+	}
+
+	count = rule_tree_fields(rule_tree_build.rules[rule], fields, offsets);
+	for (i = 0; i < count; i++) {
+		rule_tree_key_t field_key;
+		uint8_t n = rule_tree_field_key(fields[i], offsets[i], &field_key, values);
+		if (n && field_key.offset == rule_tree_build.keys[key].offset
+				&& field_key.length == rule_tree_build.keys[key].length) {
+			return n;
+		}
+	}
+
+	return 0;
+}
+
+static uint8_t rule_tree_set_has(const rule_tree_set_t* set, uint16_t rule) {
+	return (set->bits[rule / 32] >> (rule % 32)) & 1;
+}
+
+static void rule_tree_set_add(rule_tree_set_t* set, uint16_t rule) {
+	set->bits[rule / 32] |= (1UL << (rule % 32));
+}
+
+static uint8_t rule_tree_has_value(const uint64_t* values, uint8_t count, uint64_t value) {
+	uint8_t i;
+	for (i = 0; i < count; i++) {
+		if (values[i] == value) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Score a key for a set of rules
+ * the score is the number of rules left in the largest branch
+ *
+ * @param set			the rules to split
+ * @param key			the key to split on
+ * @param values		set to the distinct values of the key
+ * @param value_count	set to the number of distinct values
+ *
+ * @return the score
+ *         RULE_TREE_MAX_RULES if the key can't be used
+ */
+static uint16_t rule_tree_score(const rule_tree_set_t* set, uint8_t key,
+		uint64_t* values, uint8_t* value_count) {
+	uint64_t rule_values[RULE_TREE_MAX_VALUES];
+	uint16_t hits[RULE_TREE_MAX_VALUES] = { 0 };
+	uint16_t wildcards = 0, max_hits = 0, i;
+	uint8_t j, n;
+
+	*value_count = 0;
+	for (i = 0; i < rule_tree_build.rule_count; i++) {
+		if (!rule_tree_set_has(set, i)) {
+			continue;
+		}
+		n = rule_tree_rule_values(i, key, rule_values);
+		if (!n) {
+			wildcards++;
+			continue;
+		}
+		for (j = 0; j < n; j++) {
+			uint8_t v;
+			if (rule_tree_has_value(rule_values, j, rule_values[j])) {
+				continue; /* listed twice by the same rule */
+			}
+			for (v = 0; v < *value_count; v++) {
+				if (values[v] == rule_values[j]) {
+					break;
+				}
+			}
+			if (v == *value_count) {
+				if (*value_count == RULE_TREE_MAX_VALUES) {
+					return RULE_TREE_MAX_RULES;
+				}
+				values[v] = rule_values[j];
+				(*value_count)++;
+			}
+			hits[v]++;
+			if (hits[v] > max_hits) {
+				max_hits = hits[v];
+			}
+		}
+	}
+
+	return wildcards + max_hits;
+}
+
+static int16_t rule_tree_build_node(const rule_tree_set_t* set, uint16_t set_count,
+		uint64_t used_keys);
+
+/*
+ * Build the node for the rules in a set, which can be empty
+ */
+static int16_t rule_tree_build_child(const rule_tree_set_t* set, uint64_t used_keys) {
+	uint16_t i, count = 0;
+
+	for (i = 0; i < rule_tree_build.rule_count; i++) {
+		count += rule_tree_set_has(set, i);
+	}
+	if (count == 0) {
+		return RULE_TREE_EMPTY;
+	}
+
+	return rule_tree_build_node(set, count, used_keys);
+}
+
+/*
+ * Build a node for a set of rules
+ *
+ * @param set			the rules
+ * @param set_count		the number of rules in the set
+ * @param used_keys		the keys already tested on the path to this node
+ *
+ * @return the node index
+ */
+static int16_t rule_tree_build_node(const rule_tree_set_t* set, uint16_t set_count,
+		uint64_t used_keys) {
+	uint64_t values[RULE_TREE_MAX_VALUES];
+	uint8_t value_count = 0;
+	uint16_t best_score = set_count;
+	int16_t best_key = -1;
+	uint16_t i, j;
+	uint8_t k;
+
+	if (rule_tree_node_count >= SCHC_RULE_TREE_NODES) {
+		rule_tree_build.full = 1;
+		return RULE_TREE_EMPTY;
+	}
+	int16_t index = rule_tree_node_count++;
+	rule_tree_node_t* node = &rule_tree_nodes[index];
+
+	/* pick the key that leaves the fewest rules in the largest branch */
+	for (k = 0; set_count > 1 && k < rule_tree_build.key_count; k++) {
+		if (used_keys & (1ULL << k)) {
+			continue;
+		}
+		uint16_t score = rule_tree_score(set, k, values, &value_count);
+		if (score < best_score) {
+			best_score = score;
+			best_key = k;
+		}
+	}
+
+	if (best_key < 0) { /* leaf */
+		node->length = 0;
+		node->wildcard = RULE_TREE_EMPTY;
+		node->first = rule_tree_leaf_count;
+		node->count = 0;
+		for (i = 0; i < rule_tree_build.rule_count; i++) {
+			if (!rule_tree_set_has(set, i)) {
+				continue;
+			}
+			if (rule_tree_leaf_count >= SCHC_RULE_TREE_LEAF_ENTRIES) {
+				rule_tree_build.full = 1;
+				return RULE_TREE_EMPTY;
+			}
+			rule_tree_leaves[rule_tree_leaf_count++] = i;
+			node->count++;
+		}
+		return index;
+	}
+
+	rule_tree_score(set, best_key, values, &value_count);
+	if ((rule_tree_branch_count + value_count) > SCHC_RULE_TREE_BRANCHES) {
+		rule_tree_build.full = 1;
+		return RULE_TREE_EMPTY;
+	}
+	node->offset = rule_tree_build.keys[best_key].offset;
+	node->length = rule_tree_build.keys[best_key].length;
+	node->first = rule_tree_branch_count;
+	node->count = value_count;
+	rule_tree_branch_count += value_count;
+
+	/* sort the values for a binary search */
+	for (i = 1; i < value_count; i++) {
+		uint64_t value = values[i];
+		for (j = i; j > 0 && values[j - 1] > value; j--) {
+			values[j] = values[j - 1];
+		}
+		values[j] = value;
+	}
+
+	used_keys |= (1ULL << best_key);
+	for (j = 0; j <= value_count; j++) {
+		rule_tree_set_t child = { { 0 } };
+		for (i = 0; i < rule_tree_build.rule_count; i++) {
+			uint64_t rule_values[RULE_TREE_MAX_VALUES];
+			if (!rule_tree_set_has(set, i)) {
+				continue;
+			}
+			uint8_t n = rule_tree_rule_values(i, best_key, rule_values);
+			/* the rules that don't constrain the key are added to every child,
+			 * the last child holds only these rules */
+			if (!n || (j < value_count && rule_tree_has_value(rule_values, n, values[j]))) {
+				rule_tree_set_add(&child, i);
+			}
+		}
+		int16_t child_index = rule_tree_build_child(&child, used_keys);
+		if (j == value_count) {
+			rule_tree_nodes[index].wildcard = child_index;
+		} else {
+			rule_tree_branches[node->first + j].value = values[j];
+			rule_tree_branches[node->first + j].child = child_index;
+		}
+	}
+
+	return index;
+}
+
+/*
+ * Build the tree for a layer and direction of a device
+ *
+ * @return the root node
+ *         RULE_TREE_NONE if no tree could be built
+ */
+static int16_t rule_tree_build_layer(const rule_tree_t* tree, schc_layer_t layer, direction DI) {
+	struct schc_field* fields[RULE_TREE_MAX_FIELDS];
+	int32_t offsets[RULE_TREE_MAX_FIELDS];
+	rule_tree_set_t set = { { 0 } };
+	uint16_t i, j;
+
+	uint16_t node_count = rule_tree_node_count;
+	uint16_t branch_count = rule_tree_branch_count;
+	uint16_t leaf_count = rule_tree_leaf_count;
+
+	rule_tree_build.rules = &rule_tree_layer_rules[tree->layer_first[layer]];
+	rule_tree_build.rule_count = tree->layer_count[layer];
+	rule_tree_build.key_count = 0;
+	rule_tree_build.max_layer_fields = get_layer_field_count(layer);
+	rule_tree_build.DI = DI;
+	rule_tree_build.full = 0;
+
+	if (rule_tree_build.rule_count == 0) {
+		return RULE_TREE_EMPTY;
+	}
+
+	for (i = 0; i < rule_tree_build.rule_count; i++) {
+		int16_t count = rule_tree_fields(rule_tree_build.rules[i], fields, offsets);
+		if (count < 0) {
+			return RULE_TREE_NONE; /* let match_layer_rule() handle it */
+		}
+		rule_tree_build.rule_keys[i] = 0;
+		for (j = 0; j < count; j++) {
+			rule_tree_key_t key;
+			uint8_t k;
+			if (!rule_tree_field_key(fields[j], offsets[j], &key, NULL)) {
+				continue;
+			}
+			for (k = 0; k < rule_tree_build.key_count; k++) {
+				if (rule_tree_build.keys[k].offset == key.offset
+						&& rule_tree_build.keys[k].length == key.length) {
+					break;
+				}
+			}
+			if (k == rule_tree_build.key_count) {
+				if (k == RULE_TREE_MAX_KEYS) {
+					continue; /* not used to branch, still matched in the leaf */
+				}
+				rule_tree_build.keys[rule_tree_build.key_count++] = key;
+			}
+			rule_tree_build.rule_keys[i] |= (1ULL << k);
+		}
+		rule_tree_set_add(&set, i);
+	}
+
+	int16_t root = rule_tree_build_node(&set, rule_tree_build.rule_count, 0);
+	if (rule_tree_build.full) {
+		/* release the pool entries of this tree */
+		rule_tree_node_count = node_count;
+		rule_tree_branch_count = branch_count;
+		rule_tree_leaf_count = leaf_count;
+		DEBUG_PRINTF("rule_tree_build_layer(): pool is full, layer %d uses the rule by rule search\n", layer);
+		return RULE_TREE_NONE;
+	}
+
+	return root;
+}
+
+/*
+ * Store the distinct layer rules of a device and the layer rule indices
+ * of each compression rule
+ *
+ * @return 1 on success
+ *         0 if the pools are full
+ */
+static uint8_t rule_tree_add_rules(rule_tree_t* tree, const struct schc_device* device) {
+	uint16_t i, j;
+
+	if ((rule_tree_rule_count + device->compression_rule_count) > SCHC_RULE_TREE_RULES
+			|| device->compression_rule_count >= RULE_TREE_NO_RULE) {
+		return 0;
+	}
+	tree->rule_first = rule_tree_rule_count;
+
+	schc_layer_t layer;
+	for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+		tree->layer_first[layer] = rule_tree_layer_rule_count;
+		tree->layer_count[layer] = 0;
+		for (i = 0; i < device->compression_rule_count; i++) {
+			struct schc_layer_rule_t* rule = get_layer_rule((*device->compression_context)[i], layer);
+			uint8_t* index = &rule_tree_rules[tree->rule_first + i][layer];
+			*index = RULE_TREE_NO_RULE;
+			if (rule == NULL) {
+				continue;
+			}
+			/* layer rules can be shared by compression rules */
+			for (j = 0; j < tree->layer_count[layer]; j++) {
+				if (rule_tree_layer_rules[tree->layer_first[layer] + j] == rule) {
+					break;
+				}
+			}
+			if (j == tree->layer_count[layer]) {
+				rule_tree_residue_lengths[rule_tree_layer_rule_count][UP] = get_residue_length(rule, UP);
+				rule_tree_residue_lengths[rule_tree_layer_rule_count][DOWN] = get_residue_length(rule, DOWN);
+				rule_tree_layer_rules[rule_tree_layer_rule_count++] = rule;
+				tree->layer_count[layer]++;
+			}
+			*index = j;
+		}
+	}
+	rule_tree_rule_count += device->compression_rule_count;
+
+	return 1;
+}
+
+static rule_tree_t* rule_tree_get(struct schc_device* device);
+
+/*
+ * Build the rule trees for all devices, devices with the same compression rules share a tree
+ */
+static void rule_tree_init(void) {
+	struct schc_device* device;
+	uint32_t i = 0;
+
+	rule_tree_count = 0; rule_tree_node_count = 0;
+	rule_tree_branch_count = 0; rule_tree_leaf_count = 0;
+	rule_tree_layer_rule_count = 0; rule_tree_rule_count = 0;
+
+	while ((device = get_context_by_index(i++)) != NULL) {
+		if (rule_tree_get(device) != NULL) {
+			continue;
+		}
+		rule_tree_t* tree = &rule_trees[rule_tree_count];
+		if (rule_tree_count >= SCHC_RULE_TREE_DEVICES || !rule_tree_add_rules(tree, device)) {
+			DEBUG_PRINTF("rule_tree_init(): device %02" PRIu64 " uses the rule by rule search\n", device->device_id);
+			continue;
+		}
+		tree->device = device;
+		rule_tree_count++;
+
+		schc_layer_t layer;
+		for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+			tree->root[layer][UP] = rule_tree_build_layer(tree, layer, UP);
+			tree->root[layer][DOWN] = rule_tree_build_layer(tree, layer, DOWN);
+		}
+	}
+
+	DEBUG_PRINTF("rule_tree_init(): %d nodes, %d branches, %d leaf entries\n",
+			rule_tree_node_count, rule_tree_branch_count, rule_tree_leaf_count);
+}
+
+/*
+ * Get the rule tree of a device, i.e. of the device or context with the same compression rules
+ *
+ * @return the tree
+ *         NULL if the device has no tree
+ */
+static rule_tree_t* rule_tree_get(struct schc_device* device) {
+	uint8_t i;
+
+	for (i = 0; i < rule_tree_count; i++) {
+		const struct schc_device* owner = rule_trees[i].device;
+		if (owner == device || (owner->compression_context == device->compression_context
+				&& owner->compression_rule_count == device->compression_rule_count)) {
+			return &rule_trees[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Match a layer rule of a tree, leaving the bit array offset untouched
+ */
+static void rule_tree_match_rule(const rule_tree_t* tree, schc_layer_t layer, uint8_t index,
+		schc_bitarray_t* src, direction DI, const schc_iid_t* iid, rule_tree_set_t* matches) {
+	uint32_t offset = src->offset;
+	struct schc_layer_rule_t* rule = rule_tree_layer_rules[tree->layer_first[layer] + index];
+
+	schc_match_record_t* record = match_record_new(layer);
+
+	if (match_layer_rule(src, rule, get_layer_field_count(layer), DI, record, iid) == 1) {
+		rule_tree_set_add(matches, index);
+		if (record != NULL) {
+			match_record_commit(layer, rule);
+		}
+	}
+	src->offset = offset;
+}
+
+/*
+ * Find all layer rules matching the header of a layer
+ * the tree is walked and the rules in the leaf that is reached are matched
+ *
+ * @param tree			the rule tree of the device
+ * @param layer			the layer
+ * @param src			the bit array, with the offset at the start of the layer
+ * @param DI			the direction
+ * @param iid			the interface identifiers of the device, can be NULL
+ * @param matches		set to the indices of the matching layer rules
+ */
+static void rule_tree_match_layer(const rule_tree_t* tree, schc_layer_t layer,
+		schc_bitarray_t* src, direction DI, const schc_iid_t* iid, rule_tree_set_t* matches) {
+	int16_t index = tree->root[layer][DI];
+	uint32_t end = BYTES_TO_BITS(src->len);
+	uint16_t i;
+
+	if (index == RULE_TREE_NONE) {
+		for (i = 0; i < tree->layer_count[layer]; i++) {
+			rule_tree_match_rule(tree, layer, i, src, DI, iid, matches);
+		}
+		return;
+	}
+
+	while (index >= 0 && rule_tree_nodes[index].length) {
+		const rule_tree_node_t* node = &rule_tree_nodes[index];
+		uint32_t pos = src->offset + node->offset;
+
+		index = node->wildcard;
+		if ((pos + node->length) <= end) {
+			uint64_t value = get_bits64(src->ptr, pos, node->length);
+			uint16_t lo = node->first, hi = node->first + node->count;
+			while (lo < hi) {
+				uint16_t mid = (lo + hi) / 2;
+				if (rule_tree_branches[mid].value < value) {
+					lo = mid + 1;
+				} else {
+					hi = mid;
+				}
+			}
+			if (lo < node->first + node->count && rule_tree_branches[lo].value == value) {
+				index = rule_tree_branches[lo].child;
+			}
+		}
+	}
+
+	if (index < 0) {
+		return;
+	}
+	for (i = 0; i < rule_tree_nodes[index].count; i++) {
+		rule_tree_match_rule(tree, layer, rule_tree_leaves[rule_tree_nodes[index].first + i],
+				src, DI, iid, matches);
+	}
+}
+#endif
+
+/*
+ * How a layer of the packet takes part in the rule selection
+ */
+typedef enum {
+	LAYER_ABSENT = 0, /* the header is not present, the layer rule must be NULL */
+	LAYER_PRESENT = 1, /* the header is present, the layer rule must match or be NULL */
+	LAYER_IGNORED = 2 /* the layer rule is not used by the decompressor */
+} schc_layer_state_t;
+
+/**
+ * Find the compression rule for a packet
+ * all layers are matched at once: a rule is a candidate when every layer rule matches
+ * the header, as long as the decompressor can rebuild the packet with it
+ * when a layer rule is NULL for a present header, that header and the following ones
+ * are sent as payload, so the following layer rules must be NULL as well
+ * the IPv6 rule can not be NULL
+ * of the candidates, the rule sending the least bits is used,
+ * the first one in the context on a tie
+ *
+ * @param device		the device to find a rule for
+ * @param src			the bit arrays holding the header of each layer, indexed by schc_layer_t
+ * @param state			the state of each layer, indexed by schc_layer_t
+ * @param DI			the direction
+ *
+ * @return the rule
+ *         NULL if no rule is found
+ */
+static struct schc_compression_rule_t* schc_find_compression_rule(struct schc_device *device,
+		schc_bitarray_t* src[3], const schc_layer_state_t state[3], direction DI) {
+	struct schc_compression_rule_t* best_rule = NULL;
+	uint32_t best_length = UINT32_MAX;
+	uint32_t offset[3] = { 0 };
+	const schc_iid_t* iid = iid_get(device);
+	uint16_t i;
+
+	schc_layer_t layer;
+	for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+		if (state[layer] == LAYER_PRESENT) {
+			offset[layer] = src[layer]->offset;
+		}
+		match_record_count[layer] = 0;
+	}
+
+#if SCHC_RULE_TREE == 1
+	rule_tree_t* tree = rule_tree_get(device);
+	rule_tree_set_t matches[3] = { { { 0 } } };
+	if (tree != NULL) {
+		for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+			if (state[layer] == LAYER_PRESENT) {
+				rule_tree_match_layer(tree, layer, src[layer], DI, iid, &matches[layer]);
+			}
+		}
+	}
+#endif
+
+	for (i = 0; i < device->compression_rule_count; i++) {
+		const struct schc_compression_rule_t* rule = (*device->compression_context)[i];
+		uint8_t rule_is_found = 1, raw = 0;
+		uint32_t length = 0; /* the residue and the headers sent as payload */
+
+		for (layer = SCHC_IPV6; rule_is_found && layer <= SCHC_COAP; layer++) {
+			struct schc_layer_rule_t* layer_rule = get_layer_rule(rule, layer);
+			if (state[layer] == LAYER_IGNORED) {
+				continue;
+			}
+			if (layer_rule == NULL) {
+#if USE_IP6 == 1
+				rule_is_found = (layer != SCHC_IPV6);
+#endif
+				if (state[layer] == LAYER_PRESENT) {
+					length += BYTES_TO_BITS((layer == SCHC_UDP) ? UDP_HLEN : src[layer]->len);
+				}
+				raw = 1;
+				continue;
+			}
+			if (raw || state[layer] == LAYER_ABSENT) {
+				rule_is_found = 0;
+				continue;
+			}
+#if SCHC_RULE_TREE == 1
+			if (tree != NULL) {
+				uint8_t index = rule_tree_rules[tree->rule_first + i][layer];
+				rule_is_found = rule_tree_set_has(&matches[layer], index);
+				length += rule_tree_residue_lengths[tree->layer_first[layer] + index][DI];
+				continue;
+			}
+#endif
+			/* a layer rule with a record is known to match */
+			if (match_record_get(layer, layer_rule) == NULL) {
+				schc_match_record_t* record = match_record_new(layer);
+				rule_is_found = (match_layer_rule(src[layer], layer_rule,
+						get_layer_field_count(layer), DI, record, iid) == 1);
+				src[layer]->offset = offset[layer];
+				if (rule_is_found && record != NULL) {
+					match_record_commit(layer, layer_rule);
+				}
+			}
+			length += get_residue_length(layer_rule, DI);
+		}
+
+		if (!rule_is_found) {
+			DEBUG_PRINTF("schc_find_compression_rule(): skipped rule %02" PRIu32 "\n", rule->rule_id);
+			continue;
+		}
+		if (length < best_length) {
+			best_rule = (struct schc_compression_rule_t*) rule;
+			best_length = length;
+			if (length == 0) {
+				break; /* can not be improved */
+			}
+		}
+	}
+
+	return best_rule;
+}
+
+#if SCHC_HEADER_CACHE == 1
+/*
+ * The header cache keeps the rule selected for a packet, with the match records of its layers.
+ * An entry holds the header bits any rule of the device matches on, i.e. all fields
+ * but those with the ignore operator, as a mask and the masked value.
+ * A later packet with the same masked header selects the same rule, so it is compressed
+ * from the cached records, only the residue is read from the new packet.
+ * The IPv6 and UDP headers are cached as is, the CoAP header as the matchable bit array.
+ */
+#define HEADER_CACHE_RAW_BYTES		((IP6_HLEN * USE_IP6) + (UDP_HLEN * USE_UDP))
+#define HEADER_CACHE_BYTES			(HEADER_CACHE_RAW_BYTES + SCHC_HEADER_CACHE_COAP_BYTES)
+
+typedef struct header_cache_key_t {
+	const struct schc_device* device;
+	direction dir;
+	schc_layer_state_t state[3];
+	/* the number of IPv6 and UDP header bytes present in the packet */
+	uint16_t header_length;
+	uint16_t coap_length;
+	const uint8_t* header;
+	const uint8_t* coap;
+} header_cache_key_t;
+
+typedef struct header_cache_entry_t {
+	header_cache_key_t key;
+	struct schc_compression_rule_t* rule;
+	uint32_t hash;
+	uint32_t last_use; /* 0 if the entry is free */
+	uint8_t mask[HEADER_CACHE_BYTES];
+	uint8_t value[HEADER_CACHE_BYTES];
+	uint8_t has_record[3];
+	schc_match_record_t records[3];
+} header_cache_entry_t;
+
+/* every thread caches the headers it compresses */
+static SCHC_THREAD_LOCAL header_cache_entry_t header_cache[SCHC_HEADER_CACHE_ENTRIES];
+static SCHC_THREAD_LOCAL uint32_t header_cache_clock;
+static SCHC_THREAD_LOCAL schc_header_cache_stats_t header_cache_stats;
+
+/*
+ * Get a byte of the cached header of a packet
+ */
+static uint8_t header_cache_byte(const header_cache_key_t* key, uint16_t i) {
+	if (i < HEADER_CACHE_RAW_BYTES) {
+		return (i < key->header_length) ? key->header[i] : 0;
+	}
+	i -= HEADER_CACHE_RAW_BYTES;
+
+	return (key->coap != NULL && i < key->coap_length) ? key->coap[i] : 0;
+}
+
+/*
+ * FNV-1a hash of the masked header of a packet
+ */
+static uint32_t header_cache_hash(const header_cache_key_t* key, const uint8_t* mask) {
+	uint32_t hash = 2166136261u;
+	uint16_t i;
+
+	for (i = 0; i < HEADER_CACHE_BYTES; i++) {
+		hash ^= header_cache_byte(key, i) & mask[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static uint8_t header_cache_same_key(const header_cache_key_t* a, const header_cache_key_t* b) {
+	return (a->device == b->device && a->dir == b->dir && a->header_length == b->header_length
+			&& a->coap_length == b->coap_length && a->state[SCHC_IPV6] == b->state[SCHC_IPV6]
+			&& a->state[SCHC_UDP] == b->state[SCHC_UDP] && a->state[SCHC_COAP] == b->state[SCHC_COAP]);
+}
+
+/*
+ * Find the cache entry for a packet
+ * the entries with the same key share the mask, so the header is hashed once
+ *
+ * @return the entry
+ *         NULL if the packet is not cached
+ */
+static header_cache_entry_t* header_cache_lookup(const header_cache_key_t* key) {
+	uint32_t hash = 0;
+	uint8_t hashed = 0;
+	uint16_t i, j;
+
+	for (i = 0; i < SCHC_HEADER_CACHE_ENTRIES; i++) {
+		header_cache_entry_t* entry = &header_cache[i];
+		if (!entry->last_use || !header_cache_same_key(&entry->key, key)) {
+			continue;
+		}
+		if (!hashed) {
+			hash = header_cache_hash(key, entry->mask);
+			hashed = 1;
+		}
+		if (entry->hash != hash) {
+			continue;
+		}
+		for (j = 0; j < HEADER_CACHE_BYTES; j++) {
+			if ((header_cache_byte(key, j) & entry->mask[j]) != entry->value[j]) {
+				break;
+			}
+		}
+		if (j == HEADER_CACHE_BYTES) {
+			entry->last_use = ++header_cache_clock;
+			header_cache_stats.hits++;
+			return entry;
+		}
+	}
+	header_cache_stats.misses++;
+
+	return NULL;
+}
+
+/*
+ * Add the bits a layer rule matches on to the mask
+ * the fields are walked as in match_layer_rule()
+ *
+ * @param mask			the mask
+ * @param start			the position of the layer in the mask
+ * @param end			the end of the layer in the mask
+ * @param capacity		the end of the room for the layer in the mask
+ *
+ * @return 1 on success
+ *         0 if a matched field is outside the mask
+ */
+static uint8_t header_cache_mask_rule(uint8_t* mask, const struct schc_layer_rule_t* rule,
+		uint8_t max_layer_fields, uint32_t start, uint32_t end, uint32_t capacity, direction DI) {
+	uint32_t offset = start;
+	uint8_t j = 0, k = 0;
+	uint8_t dir_length = (DI == UP) ? rule->up : rule->down;
+
+	while (j < dir_length) {
+		const struct schc_field* field = &rule->content[k];
+		if ((field->dir == BI) || (field->dir == DI)) {
+			uint32_t pos = offset + _addr_offset(field, DI);
+			if ((pos + field->field_length) > end) {
+				return 1; /* the field is not present, the rule can't match */
+			}
+			/* the fields derived from the L2 identifiers match on the value of the device */
+			if (field->MO != &mo_ignore || field->action == DEVIID || field->action == APPIID) {
+				if ((pos + field->field_length) > capacity) {
+					return 0;
+				}
+				set_bits(mask, pos, field->field_length);
+			}
+			offset += field->field_length;
+			j++;
+		}
+		k++;
+		if (k > max_layer_fields) {
+			return 1;
 		}
 	}
 
 	return 1;
 }
 
-static int _do_mo(schc_bitarray_t *src, uint32_t prev_offset, struct schc_field *field,
-				  direction DI) {
-    uint32_t src_offset = src->offset + _addr_offset(field, DI);
-	uint8_t src_pos = 0;
-
-	if(src_offset >= 8)
-		src_pos = get_number_of_bytes_from_bits(src_offset);
-	if (src_pos > src->len) {
-		return 0;
-	}
-	if (field->MO(field,
-			(uint8_t*) (src->ptr + src_pos), (src_offset % 8))) { // compare header field and rule field using the matching operator
-		src->offset += field->field_length;
-		return 1;
-	} else {
-		src->offset = prev_offset; // reset offset
-		return 0;
-	}
-}
-
-/**
- * Find a matching rule for a layer
- *
- * @param schc_bitarray the bit array as received from the network
- * 						note: a conversion is required for CoAP to decode the options
- *
- * @param device		the device to find a rule for
- * @param schc_layer	the layer for which to find a rule for
+/*
+ * Store the rule selected for a packet
  *
- * @return the rule
- *         NULL if no rule is found
+ * @return the entry
+ *         NULL if the packet can not be cached
  */
-static struct schc_layer_rule_t* schc_find_rule_from_header(
-		schc_bitarray_t* src, struct schc_device *device, schc_layer_t layer, direction DI) {
-	uint8_t i = 0;
-	// set to 0 when a rule doesn't match
-	uint8_t rule_is_found = 1; uint8_t max_layer_fields = 0; uint32_t prev_offset = src->offset;
+static header_cache_entry_t* header_cache_insert(const header_cache_key_t* key,
+		struct schc_compression_rule_t* schc_rule) {
+	header_cache_entry_t* entry = &header_cache[0];
+	schc_layer_t layer;
+	uint16_t i, j;
 
-	for (i = 0; i < device->compression_rule_count; i++) {
-		struct schc_layer_rule_t* curr_rule = NULL;
-#if USE_IP6 == 1
-		if(layer == SCHC_IPV6) {
-			max_layer_fields = IP6_FIELDS;
-			curr_rule = (struct schc_layer_rule_t*) (*device->compression_context)[i]->ipv6_rule;
-		}
-#endif
-#if USE_UDP == 1 
-		else if(layer == SCHC_UDP) {
-			max_layer_fields = UDP_FIELDS;
-			curr_rule = (struct schc_layer_rule_t*) (*device->compression_context)[i]->udp_rule;
-		}
-#endif
-#if USE_COAP == 1
-		else if (layer == SCHC_COAP) {
-			max_layer_fields = COAP_FIELDS;
-			curr_rule = (struct schc_layer_rule_t*) (*device->compression_context)[i]->coap_rule;
+	if (schc_rule == NULL) {
+		return NULL;
+	}
+	/* a hit is compressed from the records, a layer without a record would be compressed
+	 * from the header, with the match-mapping indices found for another packet */
+	for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+		struct schc_layer_rule_t* layer_rule = get_layer_rule(schc_rule, layer);
+		if (key->state[layer] == LAYER_PRESENT && layer_rule != NULL
+				&& match_record_get(layer, layer_rule) == NULL) {
+			DEBUG_PRINTF("header_cache_insert(): layer %d has no record, the packet is not cached\n", layer);
+			return NULL;
 		}
-#endif
-
-		/* rule for layer can be set to NULL */
-		if(curr_rule == NULL) {
-			DEBUG_PRINTF("schc_find_rule_from_header(): skipped rule %02" PRIu32 ", layer set to NULL \n", (*device->compression_context)[i]->rule_id);
-			continue;
+	}
+	/* replace a free or the least recently used entry */
+	for (i = 1; i < SCHC_HEADER_CACHE_ENTRIES && entry->last_use; i++) {
+		if (header_cache[i].last_use < entry->last_use) {
+			entry = &header_cache[i];
 		}
+	}
 
-		uint8_t j = 0; uint8_t k = 0;
-		uint8_t dir_length = (DI == UP) ? curr_rule->up : curr_rule->down;
-
-		while (j < dir_length) {
-			// exclude fields in other direction
-			if ((curr_rule->content[k].dir == BI) || (curr_rule->content[k].dir == DI)) {
-				if (!(rule_is_found = _do_mo(src, prev_offset, &curr_rule->content[k], DI))) {
-					DEBUG_PRINTF(
-							"schc_find_rule_from_header(): skipped rule %02" PRIu32 ", %s does not match\n", (*device->compression_context)[i]->rule_id, schc_header_field_names[curr_rule->content[k].field]);
-					break;
-				}
-				j++;
+	memset(entry->mask, 0, sizeof(entry->mask));
+	for (i = 0; i < key->device->compression_rule_count; i++) {
+		const struct schc_compression_rule_t* rule = (*key->device->compression_context)[i];
+		for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+			struct schc_layer_rule_t* layer_rule = get_layer_rule(rule, layer);
+			uint32_t start = 0, end = 0, capacity = 0;
+			if (key->state[layer] != LAYER_PRESENT || layer_rule == NULL) {
+				continue;
 			}
-			k++; // increment to skip other directions
-			if(k > max_layer_fields) { // todo coap <-> ipv6
-				DEBUG_PRINTF("schc_find_rule_from_header(): more fields present than LAYER_FIELDS \n");
+			if (layer == SCHC_COAP) {
+				start = BYTES_TO_BITS(HEADER_CACHE_RAW_BYTES);
+				end = start + BYTES_TO_BITS(key->coap_length);
+				capacity = BYTES_TO_BITS(HEADER_CACHE_BYTES);
+			} else {
+				start = (layer == SCHC_IPV6) ? 0 : BYTES_TO_BITS(IP6_HLEN * USE_IP6);
+				end = BYTES_TO_BITS(key->header_length);
+				capacity = BYTES_TO_BITS(HEADER_CACHE_RAW_BYTES);
+			}
+			if (!header_cache_mask_rule(entry->mask, layer_rule, get_layer_field_count(layer),
+					start, end, capacity, key->dir)) {
+				DEBUG_PRINTF("header_cache_insert(): the header is too long to be cached\n");
+				entry->last_use = 0;
 				return NULL;
 			}
 		}
+	}
 
-		if (rule_is_found) {
-			return (struct schc_layer_rule_t*) (curr_rule);
+	entry->key = *key;
+	entry->key.header = NULL; entry->key.coap = NULL;
+	entry->rule = schc_rule;
+	for (j = 0; j < HEADER_CACHE_BYTES; j++) {
+		entry->value[j] = header_cache_byte(key, j) & entry->mask[j];
+	}
+	entry->hash = header_cache_hash(key, entry->mask);
+	entry->last_use = ++header_cache_clock;
+
+	for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+		schc_match_record_t* record = match_record_get(layer, get_layer_rule(schc_rule, layer));
+		entry->has_record[layer] = (record != NULL);
+		if (record != NULL) {
+			entry->records[layer] = *record;
 		}
 	}
+	header_cache_stats.insertions++;
 
-	return NULL;
+	return entry;
 }
+#endif
 
 #if USE_COAP == 1
 /**
  * Generates an unsigned char array, based on the CoAP header provided
+ * the header and the token are followed by the option values, read from the packet
+ * at the positions found by pcoap_index_options()
  *
- * @param header_fields the array to transfer the header to
- * @param dst			the destination array
+ * @param pdu			the CoAP message
+ * @param index			the option index of the message
+ * @param dst			the destination array, of MAX_COAP_MSG_SIZE bytes
  *
  * @return the length of the array, which represents the number of CoAP fields
+ *         0 if the fields do not fit the destination array
  *
  */
-static uint8_t generate_coap_header_fields(pcoap_pdu *pdu, schc_bitarray_t* dst) {
-	uint8_t offset = 0;
+static uint8_t generate_coap_header_fields(pcoap_pdu *pdu, const pcoap_option_index *index,
+		schc_bitarray_t* dst) {
+	uint16_t offset = 4 + pcoap_get_tkl(pdu);
+	uint8_t field_length = 5; // the 5 first fields are always present (!= bytes)
+	uint8_t i;
 
-	if (pcoap_validate_pkt(pdu) != CE_NONE) {
-		DEBUG_PRINTF("schc_find_coap_rule_from_header(): invalid CoAP packet\n");
+	if (index->header_len >= MAX_COAP_MSG_SIZE) {
+		DEBUG_PRINTF("generate_coap_header_fields(): CoAP header too long\n");
 		return 0;
 	}
 
-	uint8_t field_length = 5; // the 5 first fields are always present (!= bytes)
+	/* the header and the token are the first bytes of the packet */
+	memcpy(dst->ptr, pdu->buf, offset);
+	if (offset > 4) {
+		field_length++;
+	}
 
-	memcpy((uint8_t*) (dst->ptr + offset), pdu->buf, 4);
-	offset += 4;
+	for (i = 0; i < index->count; i++) {
+		memcpy((uint8_t*) (dst->ptr + offset), pdu->buf + index->options[i].offset, index->options[i].len);
+		offset += index->options[i].len;
+		field_length++;
+	}
 
-	if (pcoap_get_tkl(pdu) > 0) {
-		uint8_t token[8];
-		pcoap_get_token(pdu, token);
+	if (index->payload_len > 0) {
+		dst->ptr[offset++] = 0xFF; // add payload marker
+		field_length++;
+	}
 
-		memcpy((uint8_t*) (dst->ptr + offset), &token, pcoap_get_tkl(pdu));
+	/* the rules may match fields beyond the header */
+	memset((uint8_t*) (dst->ptr + offset), 0, MAX_COAP_MSG_SIZE - offset);
 
-		field_length++; offset += pcoap_get_tkl(pdu);
-	}
+	return field_length; // the number of CoAP header fields (not bytes)
+}
 
-	pcoap_option option;
-	option = pcoap_get_option(pdu, NULL); // get first option
+/*
+ * The options of a CoAP rule are serialized in option number order.
+ * The order is computed per direction at init, so the option headers are
+ * written one after the other, without searching the options already written.
+ * The offset of a value is relative to the first option value in the decompressed fields.
+ */
+#define COAP_OPTION_ORDER_SLOTS		(2 * SCHC_COAP_OPTION_ORDERS)
+
+typedef struct coap_option_ref_t {
+	uint16_t num;
+	uint16_t offset;
+	uint16_t len;
+} coap_option_ref_t;
+
+typedef struct coap_option_order_t {
+	const struct schc_coap_rule_t* rule;
+	uint8_t count[2];
+	/* the length of all option values, i.e. the offset of the payload marker */
+	uint16_t values_len[2];
+	coap_option_ref_t options[2][COAP_FIELDS];
+} coap_option_order_t;
+
+#if SCHC_COAP_OPTION_ORDER == 1
+static coap_option_order_t coap_option_orders[SCHC_COAP_OPTION_ORDERS];
+static uint16_t coap_option_order_count;
+/* open addressing hash table on the rule pointer */
+static const void* coap_option_order_keys[COAP_OPTION_ORDER_SLOTS];
+static coap_option_order_t* coap_option_order_slots[COAP_OPTION_ORDER_SLOTS];
 
-	while (option.num > 0) {
-		memcpy((uint8_t*) (dst->ptr + offset), option.val, option.len);
+/*
+ * Get the option order of a CoAP rule
+ *
+ * @return the option order
+ *         NULL if the order of the rule was not computed at init
+ */
+static coap_option_order_t* coap_option_order_get(const struct schc_coap_rule_t* rule) {
+	return coap_option_order_slots[ptr_table_slot(coap_option_order_keys, COAP_OPTION_ORDER_SLOTS, rule)];
+}
+#endif
 
+/*
+ * Sort the options of a CoAP rule on their option number,
+ * options with the same number keep the order of the rule
+ *
+ * @param rule			the CoAP rule
+ * @param DI			the direction
+ * @param options		set to the options in option number order
+ * @param values_len	set to the length of all option values
+ *
+ * @return the number of options
+ */
+static uint8_t coap_option_order_build(const struct schc_coap_rule_t* rule, direction DI,
+		coap_option_ref_t* options, uint16_t* values_len) {
+	uint16_t offset = 0;
+	uint8_t i, j, count = 0;
+
+	for (i = 0; i < rule->length && i < COAP_FIELDS; i++) {
+		const struct schc_field* field = &rule->content[i];
+		if ((field->dir != BI && field->dir != DI) || field->field < COAP_IFMATCH
+				|| field->field >= COAP_OPTIONS_MAX) {
+			continue;
+		}
+		coap_option_ref_t option = { field->field, offset, field->field_length / 8 };
+		for (j = count; j > 0 && options[j - 1].num > option.num; j--) {
+			options[j] = options[j - 1];
+		}
+		options[j] = option;
 		offset += option.len;
-		option = pcoap_get_option(pdu, &option); // get next option
-		field_length++;
+		count++;
 	}
+	*values_len = offset;
 
-	pcoap_payload pl = pcoap_get_payload(pdu);
-	if (pl.len > 0) {
-		dst->ptr[offset] = 0xFF; // add payload marker
-		field_length++;
-	}
+	return count;
+}
 
-	return field_length; // the number of CoAP header fields (not bytes)
+#if SCHC_COAP_OPTION_ORDER == 1
+/*
+ * Compute the option order of all CoAP rules
+ */
+static void coap_option_order_init(void) {
+	struct schc_device* device;
+	uint32_t i = 0;
+	uint16_t j;
+
+	coap_option_order_count = 0;
+	memset(coap_option_order_keys, 0, sizeof(coap_option_order_keys));
+	memset(coap_option_order_slots, 0, sizeof(coap_option_order_slots));
+
+	while ((device = get_context_by_index(i++)) != NULL) {
+		for (j = 0; j < device->compression_rule_count; j++) {
+			const struct schc_coap_rule_t* rule = (*device->compression_context)[j]->coap_rule;
+			if (rule == NULL || coap_option_order_get(rule) != NULL) {
+				continue;
+			}
+			if (coap_option_order_count >= SCHC_COAP_OPTION_ORDERS) {
+				DEBUG_PRINTF("coap_option_order_init(): no order left, the options are sorted per packet\n");
+				return;
+			}
+			coap_option_order_t* order = &coap_option_orders[coap_option_order_count++];
+			order->rule = rule;
+			order->count[UP] = coap_option_order_build(rule, UP, order->options[UP], &order->values_len[UP]);
+			order->count[DOWN] = coap_option_order_build(rule, DOWN, order->options[DOWN], &order->values_len[DOWN]);
+
+			uint16_t slot = ptr_table_slot(coap_option_order_keys, COAP_OPTION_ORDER_SLOTS, rule);
+			coap_option_order_keys[slot] = rule;
+			coap_option_order_slots[slot] = order;
+		}
+	}
 }
+#endif
 
 /**
  * Decompress a CoAP rule, based on an input packet
+ * the options are appended in option number order
  *
  * @param rule 			the CoAP rule to use for decompression
- * @param src			the received SCHC bit buffer
+ * @param src			the bit reader on the received SCHC residue
  * @param msg 			pointer to the reconstructed CoAP message
  *
  */
 static uint8_t decompress_coap_rule(struct schc_coap_rule_t* rule,
-		schc_bitarray_t* src, pcoap_pdu *msg, direction DI) {
+		schc_bitreader_t* src, pcoap_pdu *msg, direction DI) {
 	uint8_t buf[MAX_COAP_HEADER_LENGTH] = { 0 };
 
 	schc_bitarray_t dst;
-	dst.ptr = buf; dst.offset = 0; uint8_t field_length = 0;
+	dst.ptr = buf; dst.offset = 0; uint16_t field_length = 0;
 
 	if (rule != NULL) {
-		decompress((struct schc_layer_rule_t*) rule, src, &dst, DI);
+		decompress((struct schc_layer_rule_t*) rule, src, &dst, DI, NULL);
 		pcoap_init_pdu(msg);
 		uint8_t version = get_bits(dst.ptr, 0, 2);
 		pcoap_set_version(msg, version);
@@ -624,27 +2554,40 @@ static uint8_t decompress_coap_rule(struct schc_coap_rule_t* rule,
 			pcoap_set_token(msg, (uint8_t*) (dst.ptr + 4), tkl);
 		}
 
-		uint8_t i;
 		// keep track of the coap_header index
 		field_length = (4 + tkl);
 
-		for(i = 0; i < rule->length; i++) { // now the options
-			if( ( (rule->content[i].dir) == BI) || ( (rule->content[i].dir) == DI)) {
-				COAPO_fields option;
-				// check which options are included in the rule
-				for(option = COAP_IFMATCH; option < COAP_OPTIONS_MAX; option++) { // todo should not take COAP_OPTIONS_MAX iterations
-					if( rule->content[i].field == option ) {
-						// for each matching value, create a new option in the message
-						pcoap_add_option(msg, option,
-								(uint8_t*) (dst.ptr + field_length),
- 								(rule->content[i].field_length / 8));
-						field_length += (rule->content[i].field_length / 8); // increased length matches option length
-					}
-				}
+		const coap_option_ref_t* options;
+		uint8_t option_count;
+		uint16_t values_len;
+#if SCHC_COAP_OPTION_ORDER == 1
+		const coap_option_order_t* order = coap_option_order_get(rule);
+#else
+		const coap_option_order_t* order = NULL;
+#endif
+		coap_option_ref_t sorted[COAP_FIELDS];
+		if (order != NULL) {
+			options = order->options[DI];
+			option_count = order->count[DI];
+			values_len = order->values_len[DI];
+		} else {
+			option_count = coap_option_order_build(rule, DI, sorted, &values_len);
+			options = sorted;
+		}
+
+		uint8_t i; uint16_t last_num = 0;
+		for (i = 0; i < option_count; i++) { // now the options
+			if ((field_length + options[i].offset + options[i].len) > MAX_COAP_HEADER_LENGTH) {
+				break;
+			}
+			if (pcoap_append_option(msg, last_num, options[i].num, (uint8_t*) (dst.ptr + field_length
+					+ options[i].offset), options[i].len) == CE_NONE) {
+				last_num = options[i].num;
 			}
 		}
+		field_length += values_len; // increased length matches option length
 
-		if(dst.ptr[field_length] == 0xFF) { // check if a payload marker is present in the decompressed rule
+		if(field_length < MAX_COAP_HEADER_LENGTH && dst.ptr[field_length] == 0xFF) { // check if a payload marker is present in the decompressed rule
 			msg->buf[msg->len] = 0xFF;
 			msg->len = msg->len + 1;
 		}
@@ -672,8 +2615,7 @@ static uint8_t decompress_coap_rule(struct schc_coap_rule_t* rule,
 uint8_t mo_equal(struct schc_field* target_field, unsigned char* field_value, uint16_t field_offset) {
 	uint8_t bit_pos = get_position_in_first_byte(target_field->field_length);
 
-	// todo no copy w/ compare_bit_sequence()
-	return compare_bits_aligned((uint8_t*) (target_field->target_value), bit_pos,
+	return compare_bit_sequence((uint8_t*) (target_field->target_value), bit_pos,
 			(uint8_t*) (field_value), field_offset, target_field->field_length);
 }
 
@@ -704,14 +2646,16 @@ uint8_t mo_ignore(__attribute__((unused))  struct schc_field *target_field,
  *
  * @param target_field the field from the rule
  * @param field_value the value from the header to compare with the rule value
+ * @param field_offset the offset (in bits), starting from the field value pointer
  *
  * @return 1 if the MSB of the target field matches the MSB of the field value
  *         0 if the MSB of the target field doesn't match the MSB of the field value
  *
  */
 uint8_t mo_MSB(struct schc_field *target_field, unsigned char *field_value,
-		__attribute__((unused)) uint16_t field_offset) {
-	if(compare_bits(target_field->target_value, field_value, target_field->MO_param_length)) {
+		uint16_t field_offset) {
+	if(compare_bit_sequence(target_field->target_value, 0, field_value, field_offset,
+			target_field->MO_param_length)) {
 		return 1; // left x bits match the target value
 	}
 
@@ -728,14 +2672,16 @@ uint8_t mo_MSB(struct schc_field *target_field, unsigned char *field_value,
  *
  * @param target_field the field from the rule
  * @param field_value the value from the header to compare with the rule value
+ * @param field_offset the offset (in bits), starting from the field value pointer
  *
  * @return 1 if the the field value is equal to one of the values found in the mapping array
  *         0 if no matching value is found in the mapping array
  *
  */
 uint8_t mo_matchmap(struct schc_field *target_field, unsigned char *field_value,
-		__attribute__((unused)) uint16_t field_offset) {
+		uint16_t field_offset) {
 	uint8_t i;
+	uint8_t bit_pos = get_position_in_first_byte(target_field->field_length);
 
 	// reset the parser
 	jsmn_init(&json_parser);
@@ -746,13 +2692,24 @@ uint8_t mo_matchmap(struct schc_field *target_field, unsigned char *field_value,
 
 	// if result is 0,
 	if (result == 0) {
+#if SCHC_MATCHMAP_INDEX == 1
+		matchmap_table_t* table = matchmap_get(target_field);
+		if (table != NULL) {
+			matchmap_match_t* match = &matchmap_matches[table - matchmap_tables];
+			match->ptr = field_value;
+			match->offset = field_offset;
+			match->index = matchmap_find(table,
+					get_bits64(field_value, field_offset, target_field->field_length));
+			return (match->index >= 0);
+		}
+#endif
 		for (i = 0; i < target_field->MO_param_length; i++) {
 			uint8_t ptr = i;
 			if (! (target_field->field_length % 8) ) // only supports byte aligned matchmap
 				ptr = i * get_number_of_bytes_from_bits(target_field->field_length);
 
-			if (compare_bits_little_endian(field_value,
-					(uint8_t*) (target_field->target_value + ptr),
+			if (compare_bit_sequence(field_value, field_offset,
+					(uint8_t*) (target_field->target_value + ptr), bit_pos,
 					target_field->field_length)) {
 				return 1;
 			}
@@ -798,57 +2755,87 @@ uint8_t mo_matchmap(struct schc_field *target_field, unsigned char *field_value,
  *
  */
 uint8_t schc_compressor_init() {
+	bit_operations_init();
 	jsmn_init(&json_parser);
 	if(!rm_revise_rule_context()) {
 		return 0;
 	}
+#if SCHC_HEADER_CACHE == 1
+	schc_header_cache_flush();
+#endif
+#if SCHC_MATCHMAP_INDEX == 1
+	matchmap_init();
+#endif
+#if SCHC_COMPACT_RULES == 1
+	compact_init();
+#endif
+#if SCHC_GENERATED_RULES == 1 && !defined(SCHC_RULEGEN)
+	rulegen_init();
+#endif
+#if SCHC_RULE_TREE == 1
+	rule_tree_init();
+#endif
+#if USE_COAP == 1 && SCHC_COAP_OPTION_ORDER == 1
+	coap_option_order_init();
+#endif
 
 	return 1;
 }
 
+#if SCHC_HEADER_CACHE == 1
 /**
- * Compresses a CoAP/UDP/IP packet
+ * Empty the header cache of the calling thread
+ * has to be called by every thread when the rules of a device change
+ */
+void schc_header_cache_flush() {
+	memset(header_cache, 0, sizeof(header_cache));
+	memset(&header_cache_stats, 0, sizeof(header_cache_stats));
+	header_cache_clock = 0;
+}
+
+/**
+ * Get the counters of the header cache of the calling thread
+ *
+ * @param 	stats			set to the counters since the last flush
+ */
+void schc_header_cache_get_stats(schc_header_cache_stats_t* stats) {
+	*stats = header_cache_stats;
+}
+#endif
+
+/*
+ * Compresses the headers of a CoAP/UDP/IP packet for a device
+ * writes the rule id and the residue, or the uncompressed headers, to dst
+ * the headers have to be contiguous, the packet may be cut after
+ * IP6_HLEN + UDP_HLEN + MAX_COAP_MSG_SIZE + 1 bytes, which holds all the headers that can be compressed
  *
+ * @param 	device			the device to find a rule for
  * @param 	data 			pointer to the original packet
  * @param 	total_length 	the length of the packet
- * @param 	dst				pointer to the bit array object, where the compressed packet will
- * 							be stored. Can later be passed to fragmenter
- * @param 	device_id		the device id to find a rule for
+ * @param 	dst				the bit array to store the compressed headers in, dst->offset is set to the end of them
  * @param 	direction		the direction of the flow
- * 							UP: LPWAN to IPv6 or DOWN: IPv6 to LPWAN
+ * @param 	rule			set to the compression rule, NULL if the headers are sent uncompressed
+ * @param 	header_length	set to the number of bytes of data taken by the headers in dst
  *
- * @return 	schc_rule		the compression rule that was used to compress the packet
- *         	NULL			otherwise
+ * @return 	1				the headers are compressed
+ *         	0				the rule id could not be set
  */
-
-struct schc_compression_rule_t* schc_compress(uint8_t *data, uint16_t total_length,
-		schc_bitarray_t* dst, uint32_t device_id, direction dir) {
+static uint8_t compress_header(struct schc_device* device, uint8_t *data, uint16_t total_length,
+		schc_bitarray_t* dst, direction dir, struct schc_compression_rule_t** rule, uint16_t* header_length) {
 	struct schc_compression_rule_t* schc_rule;
 	uint16_t coap_length = 0;
 
-	struct schc_device *device = get_device_by_id(device_id);
-	if (device == NULL) {
-		DEBUG_PRINTF(
-				"schc_compress(): no device was found for this id=%02" PRIu32 "\n", device_id);
-		return 0;
-	}
-
-	memset(dst->ptr, 0, dst->len);
 	/* use bit array for comparison */
 	schc_bitarray_t src; src.ptr = data; src.offset = 0; src.len = total_length;
 	uint8_t icmp6_packet = 0; uint8_t use_udp = USE_UDP;
 
 	DEBUG_PRINTF("schc_compress(): \n");
 
-	/* look for a matching rule */
-	struct schc_layer_rule_t *ipv6_rule = NULL;
-	struct schc_layer_rule_t *udp_rule = NULL;
-	struct schc_layer_rule_t *coap_rule = NULL;
+	/* the state of each layer, as seen by the decompressor */
+	schc_layer_state_t state[3] = { LAYER_IGNORED, LAYER_IGNORED, LAYER_IGNORED };
+	schc_bitarray_t* layer_src[3] = { &src, &src, NULL };
 #if USE_IP6 == 1
-	ipv6_rule = schc_find_rule_from_header(&src, device, SCHC_IPV6, dir);
-	if(ipv6_rule != NULL) {
-		DEBUG_PRINTF("schc_compress(): IPv6 rule ptr=%p \n", (void*)ipv6_rule);
-	}
+	state[SCHC_IPV6] = LAYER_PRESENT;
 	if(data[6] == 0x3A) { // icmpv6 packet
 		icmp6_packet = 1;
 		use_udp      = 0;
@@ -858,51 +2845,81 @@ struct schc_compression_rule_t* schc_compress(uint8_t *data, uint16_t total_leng
 	}
 #endif
 #if USE_UDP == 1
-		if(use_udp) {
-			udp_rule = schc_find_rule_from_header(&src, device, SCHC_UDP, dir);
-			if(udp_rule != NULL) {
-				DEBUG_PRINTF("schc_compress(): UDP rule ptr=%p \n", (void*)udp_rule);
-			}
-		}
+	if(use_udp) {
+		state[SCHC_UDP] = LAYER_PRESENT;
+	}
+#if USE_IP6 == 1
+	else if(data[6] == 0x11) { // too short to hold the udp header
+		state[SCHC_UDP] = LAYER_ABSENT;
+	}
+#endif
 #endif
 #if USE_COAP == 1
 		schc_bitarray_t coap_src = { .ptr = 0 };
 		uint8_t* coap_ptr = NULL;
-		if (!icmp6_packet &&
+		/* the bit array, matchable to the rule, is used until the end of the compression */
+		uint8_t coap_buffer[MAX_COAP_MSG_SIZE];
+		if (!icmp6_packet) {
+			state[SCHC_COAP] = LAYER_ABSENT;
+		}
+		if (!icmp6_packet && use_udp == USE_UDP &&
 			(total_length >= (IP6_HLEN * USE_IP6) + (UDP_HLEN * use_udp))) {
 			/* CoAP pdu for CoAP specific actions */
 			coap_ptr = (uint8_t*) (data + (IP6_HLEN * USE_IP6) + (UDP_HLEN * use_udp));
 			pcoap_pdu coap_msg = { coap_ptr, (total_length - (IP6_HLEN * USE_IP6) - (UDP_HLEN * use_udp)),
 					(total_length - (IP6_HLEN * USE_IP6) - (UDP_HLEN * use_udp)) };
 
-			/* check the buffer for determining the CoAP header length */
-			coap_length = pcoap_get_coap_offset(&coap_msg);
+			/* find the CoAP header length and the options in a single pass */
+			pcoap_option_index coap_index;
+			pcoap_error coap_err = pcoap_index_options(&coap_msg, &coap_index);
+			coap_length = coap_index.header_len;
 
 			/* generate a bit array, matchable to the rule */
-			uint8_t coap_buffer[MAX_COAP_MSG_SIZE] = { 0 };
 			coap_src.ptr = coap_buffer; coap_src.offset = 0;
-			if (generate_coap_header_fields(&coap_msg, &coap_src) > 0) {
+			if (coap_err == CE_NONE && generate_coap_header_fields(&coap_msg, &coap_index, &coap_src) > 0) {
 				coap_src.len = coap_length;
-				coap_rule = schc_find_rule_from_header(&coap_src, device, SCHC_COAP, dir);
-				if(coap_rule != NULL) {
-					DEBUG_PRINTF("schc_compress(): CoAP rule ptr=%p \n", (void*)coap_rule);
-				}
-				/* reset the bit arrays offset and start compressing */
-				coap_src.offset = 0;
+				state[SCHC_COAP] = LAYER_PRESENT;
+				layer_src[SCHC_COAP] = &coap_src;
 			}
 			else {
 				coap_ptr = NULL;
 				coap_src.ptr = NULL;
+				coap_length = 0;
 			}
 		}
 #endif
-	/* reset the offset and start compressing */
-	src.offset = 0;
+#if USE_UDP == 1
+	/* the UDP header follows the IPv6 header */
+	schc_bitarray_t udp_src = src;
+	udp_src.offset = BYTES_TO_BITS(IP6_HLEN * USE_IP6);
+	layer_src[SCHC_UDP] = &udp_src;
+#endif
 
-	schc_rule = get_schc_rule_by_layer_ids(ipv6_rule, udp_rule, coap_rule, device);
+	/* look for the matching rule sending the least bits */
+#if SCHC_HEADER_CACHE == 1
+	header_cache_key_t cache_key = { device, dir, { state[SCHC_IPV6], state[SCHC_UDP], state[SCHC_COAP] },
+			(total_length < HEADER_CACHE_RAW_BYTES) ? total_length : HEADER_CACHE_RAW_BYTES,
+			coap_length, data, NULL };
+#if USE_COAP == 1
+	cache_key.coap = coap_src.ptr;
+#endif
+	header_cache_entry_t* cache_entry = header_cache_lookup(&cache_key);
+	if (cache_entry != NULL) {
+		schc_rule = cache_entry->rule;
+	} else {
+		schc_rule = schc_find_compression_rule(device, layer_src, state, dir);
+		cache_entry = header_cache_insert(&cache_key, schc_rule);
+	}
+#else
+	schc_rule = schc_find_compression_rule(device, layer_src, state, dir);
+#endif
+	if (schc_rule != NULL) {
+		DEBUG_PRINTF("schc_compress(): rule %02" PRIu32 " ptr=%p \n", schc_rule->rule_id, (void*)schc_rule);
+	}
+	uint16_t length = (IP6_HLEN * USE_IP6) + (UDP_HLEN * use_udp) + coap_length;
 
 	if (set_rule_id(schc_rule, device, dst->ptr) != 1) {
-		return NULL;
+		return 0;
 	}
 
 	if(schc_rule == NULL) {
@@ -931,60 +2948,264 @@ struct schc_compression_rule_t* schc_compress(uint8_t *data, uint16_t total_leng
 		}
 	}
 	else { /* a rule was found - compress */
-		dst->offset = device->profile->RULE_ID_SIZE;
-#if USE_IP6 == 1
-		compress(dst, &src, (const struct schc_layer_rule_t*) ipv6_rule, dir);
-#endif
-		if(!icmp6_packet) {
-#if USE_UDP == 1
-			if (use_udp) {
-				compress(dst, &src, (const struct schc_layer_rule_t*) udp_rule, dir);
+		schc_bitwriter_t residue;
+		schc_bitwriter_init(&residue, dst->ptr, device->profile->RULE_ID_SIZE);
+		/* the headers of the layers without a rule are sent as payload */
+		length = 0;
+		schc_layer_t layer;
+		for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+			struct schc_layer_rule_t* layer_rule = get_layer_rule(schc_rule, layer);
+			if (state[layer] != LAYER_PRESENT || layer_rule == NULL) {
+				continue;
+			}
+			layer_src[layer]->offset = (layer == SCHC_COAP) ? 0 : BYTES_TO_BITS(length);
+			schc_match_record_t* record = match_record_get(layer, layer_rule);
+#if SCHC_HEADER_CACHE == 1
+			if (cache_entry != NULL) {
+				record = cache_entry->has_record[layer] ? &cache_entry->records[layer] : NULL;
 			}
 #endif
-#if USE_COAP == 1
-			if (coap_src.ptr) {
-				compress(dst, &coap_src, (const struct schc_layer_rule_t*) coap_rule, dir);
+			if (record != NULL) {
+				compress_record(&residue, layer_src[layer], record);
+			} else {
+				compress(&residue, layer_src[layer], (const struct schc_layer_rule_t*) layer_rule, dir);
 			}
+			length += (layer == SCHC_IPV6) ? IP6_HLEN : (layer == SCHC_UDP) ? UDP_HLEN : coap_length;
+		}
+		dst->offset = schc_bitwriter_flush(&residue);
+	}
+
+	*rule = schc_rule;
+	*header_length = length;
+
+	return 1;
+}
+
+/*
+ * Set the lengths and padding of a compressed packet
+ *
+ * @param 	device			the device the packet was compressed for
+ * @param 	schc_rule		the compression rule, NULL if the packet was sent uncompressed
+ * @param 	dst				the compressed packet, dst->offset at the end of the residue
+ * @param 	payload_len		the number of payload bytes after the residue
+ * @param 	payload_in_dst	1 if the payload was copied into dst, 0 if it is sent from the original segments
+ */
+static void compress_set_length(struct schc_device* device, const struct schc_compression_rule_t* schc_rule,
+		schc_bitarray_t* dst, uint16_t payload_len, uint8_t payload_in_dst) {
+    uint16_t new_pkt_length = (BITS_TO_BYTES(dst->offset) + (payload_in_dst ? payload_len : 0));
+    /* set the padding of the compressed packet */
+    dst->padding = padded(dst);
+
+    /* set the total packet length (w/o padding) */
+    dst->bit_len = BYTES_TO_BITS(payload_len) + dst->offset;
+    uint16_t total_packet_len_bits = dst->bit_len + dst->padding;
+
+	DEBUG_PRINTF("\n");
+	DEBUG_PRINTF(
+			"schc_compress(): %d compressed header bits + %d payload bits + %d padding bits = %d bits (%dB)\n",
+			(int) dst->offset, BYTES_TO_BITS(payload_len), dst->padding, total_packet_len_bits, BITS_TO_BYTES(total_packet_len_bits));
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
+	DEBUG_PRINTF("+---------------------------------+\n");
+	DEBUG_PRINTF("|          SCHC Packet            |\n");
+	DEBUG_PRINTF("+---------------------------------+\n");
+
+	int i;
+	for(i = 0; i <  new_pkt_length; i++) {
+		DEBUG_PRINTF("%02X ", dst->ptr[i]);
+		if(!((i + 1) % 12)) {
+			DEBUG_PRINTF("\n");
+		}
+	}
+
+	DEBUG_PRINTF("\n");
 #endif
+	if (schc_rule != NULL) {
+		SCHC_TRACE_INFO(SCHC_EV_COMPRESS, schc_rule->rule_id, dst->bit_len);
+	} else {
+		SCHC_TRACE_INFO(SCHC_EV_COMPRESS_UNCOMPRESSED, device->profile->UNCOMPRESSED_RULE_ID, dst->bit_len);
+	}
+	/* set the compressed packet length */
+	dst->len = new_pkt_length;
+}
+
+/**
+ * Compresses a CoAP/UDP/IP packet for a device
+ *
+ * @param 	device			the device to find a rule for
+ * @param 	data 			pointer to the original packet
+ * @param 	total_length 	the length of the packet
+ * @param 	dst				pointer to the bit array object, where the compressed packet will
+ * 							be stored
+ * @param 	direction		the direction of the flow
+ * @param 	rule			set to the compression rule, NULL if the packet is sent uncompressed
+ *
+ * @return 	1				the packet is stored in dst
+ *         	0				the rule id could not be set
+ */
+static uint8_t compress_packet(struct schc_device* device, uint8_t *data, uint16_t total_length,
+		schc_bitarray_t* dst, direction dir, struct schc_compression_rule_t** rule) {
+	struct schc_compression_rule_t* schc_rule;
+	uint16_t header_length;
+
+	/* clear the bytes the compressed packet can take, it never exceeds the rule id and the original packet */
+	uint32_t clear_length = (uint32_t) total_length + RULE_SIZE_BYTES + 1;
+	memset(dst->ptr, 0, (clear_length < dst->len) ? clear_length : dst->len);
+
+	*rule = NULL;
+	if (!compress_header(device, data, total_length, dst, dir, &schc_rule, &header_length)) {
+		return 0;
+	}
+
+	/* copy the payload */
+	uint16_t payload_len = (total_length - header_length);
+	const uint8_t *payload_ptr = (data + header_length);
+
+	copy_bits(dst->ptr, dst->offset, payload_ptr, 0, BYTES_TO_BITS(payload_len));
+	compress_set_length(device, schc_rule, dst, payload_len, 1);
+	*rule = schc_rule;
+
+	return 1;
+}
+
+/**
+ * Compresses a CoAP/UDP/IP packet
+ *
+ * @param 	data 			pointer to the original packet
+ * @param 	total_length 	the length of the packet
+ * @param 	dst				pointer to the bit array object, where the compressed packet will
+ * 							be stored. Can later be passed to fragmenter
+ * @param 	device_id		the device id to find a rule for
+ * @param 	direction		the direction of the flow
+ * 							UP: LPWAN to IPv6 or DOWN: IPv6 to LPWAN
+ *
+ * @return 	schc_rule		the compression rule that was used to compress the packet
+ *         	NULL			otherwise
+ */
+struct schc_compression_rule_t* schc_compress(uint8_t *data, uint16_t total_length,
+		schc_bitarray_t* dst, uint64_t device_id, direction dir) {
+	struct schc_device *device = get_device_by_id(device_id);
+	if (device == NULL) {
+		DEBUG_PRINTF(
+				"schc_compress(): no device was found for this id=%02" PRIu64 "\n", device_id);
+		return 0;
+	}
+
+	struct schc_compression_rule_t* schc_rule;
+	compress_packet(device, data, total_length, dst, dir, &schc_rule);
+
+	/* and return the schc rule */
+	return schc_rule;
+}
+
+/* the start of a packet that holds all the headers that can be compressed, see compress_header() */
+#define COMPRESS_IOV_HEADER_BYTES	((IP6_HLEN * USE_IP6) + (UDP_HLEN * USE_UDP) + (MAX_COAP_MSG_SIZE * USE_COAP) + 1)
+
+/**
+ * Compresses a CoAP/UDP/IP packet, stored in segments
+ * the headers may span several segments, they are gathered before matching when they do not fit the first one
+ * if the residue ends on a byte boundary, the payload is not copied:
+ * the compressed frame is the residue in dst, followed by the payload segments in frame
+ * otherwise the payload is shifted into dst, after the residue, with one copy per segment
+ *
+ * @param 	iov 			the segments of the packet
+ * @param 	iov_count 		the number of segments
+ * @param 	dst				pointer to the bit array object, where the rule id and the residue will be stored,
+ * 							followed by the payload if it was shifted
+ * @param 	frame			set to the payload segments following dst and the length of the frame
+ * @param 	device_id		the device id to find a rule for
+ * @param 	direction		the direction of the flow
+ * 							UP: LPWAN to IPv6 or DOWN: IPv6 to LPWAN
+ *
+ * @return 	schc_rule		the compression rule that was used to compress the packet
+ *         	NULL			otherwise
+ */
+struct schc_compression_rule_t* schc_compress_iov(const schc_iovec_t* iov, uint8_t iov_count,
+		schc_bitarray_t* dst, schc_frame_t* frame, uint64_t device_id, direction dir) {
+	struct schc_compression_rule_t* schc_rule;
+	uint8_t header_buf[COMPRESS_IOV_HEADER_BYTES];
+	uint32_t total_length = 0;
+	uint16_t header_length;
+	uint8_t i;
+
+	frame->payload_count = 0;
+	frame->len = 0;
+
+	struct schc_device *device = get_device_by_id(device_id);
+	if (device == NULL) {
+		DEBUG_PRINTF(
+				"schc_compress_iov(): no device was found for this id=%02" PRIu64 "\n", device_id);
+		return NULL;
+	}
+	for (i = 0; i < iov_count; i++) {
+		total_length += iov[i].len;
+	}
+	if (iov_count == 0 || total_length > UINT16_MAX) {
+		return NULL;
+	}
+
+	/* the headers are matched on a contiguous start of the packet */
+	uint16_t view_length = (total_length < COMPRESS_IOV_HEADER_BYTES) ? total_length : COMPRESS_IOV_HEADER_BYTES;
+	uint8_t* view = iov[0].ptr;
+	if (iov[0].len < view_length) {
+		uint16_t gathered = 0;
+		for (i = 0; i < iov_count && gathered < view_length; i++) {
+			uint16_t len = ((view_length - gathered) < iov[i].len) ? (view_length - gathered) : iov[i].len;
+			memcpy(header_buf + gathered, iov[i].ptr, len);
+			gathered += len;
 		}
+		view = header_buf;
 	}
 
-	/* copy the payload */
-	uint16_t payload_len = (total_length - (IP6_HLEN * USE_IP6)
-			- (UDP_HLEN * use_udp) - coap_length);
-	const uint8_t *payload_ptr = (data + (IP6_HLEN * USE_IP6)
-			+ (UDP_HLEN * use_udp) + coap_length);
+	/* clear the bytes the compressed headers can take */
+	uint32_t clear_length = (uint32_t) view_length + RULE_SIZE_BYTES + 1;
+	memset(dst->ptr, 0, (clear_length < dst->len) ? clear_length : dst->len);
 
-	copy_bits(dst->ptr, dst->offset, payload_ptr, 0, BYTES_TO_BITS(payload_len));
-    uint16_t new_pkt_length = (BITS_TO_BYTES(dst->offset) + payload_len);
-    /* set the padding of the compressed packet */
-    dst->padding = padded(dst);
+	if (!compress_header(device, view, view_length, dst, dir, &schc_rule, &header_length)) {
+		return NULL;
+	}
+	uint16_t payload_len = (uint16_t) (total_length - header_length);
+
+	/* find the segment and the offset the payload starts at */
+	uint8_t first = 0;
+	uint16_t skip = header_length;
+	while (first < iov_count && skip >= iov[first].len) {
+		skip -= iov[first].len;
+		first++;
+	}
 
-    /* set the total packet length (w/o padding) */
-    dst->bit_len = BYTES_TO_BITS(payload_len) + dst->offset;
-    uint16_t total_packet_len_bits = dst->bit_len + dst->padding;
+	if (!(dst->offset % 8) && (iov_count - first) <= SCHC_IOV_MAX) {
+		/* the payload follows the residue as is */
+		for (i = first; i < iov_count; i++) {
+			uint16_t offset = (i == first) ? skip : 0;
+			if (iov[i].len > offset) {
+				frame->payload[frame->payload_count++] = (schc_iovec_t) { .ptr = iov[i].ptr + offset,
+						.len = (uint16_t) (iov[i].len - offset) };
+			}
+		}
+		compress_set_length(device, schc_rule, dst, payload_len, 0);
+		frame->len = dst->len + payload_len;
 
-	DEBUG_PRINTF("\n");
-	DEBUG_PRINTF(
-			"schc_compress(): %d compressed header bits + %d payload bits + %d padding bits = %d bits (%dB)\n",
-			(int) dst->offset, BYTES_TO_BITS(payload_len), dst->padding, total_packet_len_bits, BITS_TO_BYTES(total_packet_len_bits));
-	DEBUG_PRINTF("+---------------------------------+\n");
-	DEBUG_PRINTF("|          SCHC Packet            |\n");
-	DEBUG_PRINTF("+---------------------------------+\n");
+		return schc_rule;
+	}
 
-	int i;
-	for(i = 0; i <  new_pkt_length; i++) {
-		DEBUG_PRINTF("%02X ", dst->ptr[i]);
-		if(!((i + 1) % 12)) {
-			DEBUG_PRINTF("\n");
+	/* shift the payload behind the residue, the rest of the packet is cleared first */
+	uint32_t end = (uint32_t) total_length + RULE_SIZE_BYTES + 1;
+	end = (end < dst->len) ? end : dst->len;
+	if (end > clear_length) {
+		memset(dst->ptr + clear_length, 0, end - clear_length);
+	}
+	uint32_t copy_offset = dst->offset;
+	for (i = first; i < iov_count; i++) {
+		uint16_t offset = (i == first) ? skip : 0;
+		uint16_t len = (uint16_t) (iov[i].len - offset);
+		if (iov[i].len > offset) {
+			copy_bits(dst->ptr, copy_offset, iov[i].ptr + offset, 0, BYTES_TO_BITS(len));
+			copy_offset += BYTES_TO_BITS(len);
 		}
 	}
+	compress_set_length(device, schc_rule, dst, payload_len, 1);
+	frame->len = dst->len;
 
-	DEBUG_PRINTF("\n");
-	/* set the compressed packet length */
-	dst->len = new_pkt_length;
-
-	/* and return the schc rule */
 	return schc_rule;
 }
 
@@ -992,24 +3213,25 @@ struct schc_compression_rule_t* schc_compress(uint8_t *data, uint16_t total_leng
  * Set the packet length for the UDP and IP headers
  *
  * @param data 			pointer to the data packet
+ * @param header_len 	the number of bytes in data, the fields beyond are not set
  * @param data_len 		the length of the total packet
  *
  * @return 0
  *
  */
-static uint16_t compute_length(unsigned char *data, uint16_t data_len) {
+static uint16_t compute_length(unsigned char *data, uint16_t header_len, uint16_t data_len) {
 	// if the length fields are set to 0
 	// the length must be calculated
 	uint8_t* packet_ptr = (uint8_t*) data;
 #if USE_IP6 == 1
-	if(packet_ptr[4] == 0 && packet_ptr[5] == 0) {
+	if(header_len >= 6 && packet_ptr[4] == 0 && packet_ptr[5] == 0) {
 		// ip length
 		packet_ptr[4] = (((data_len - IP6_HLEN) & 0xFF00) >> 8);
 		packet_ptr[5] = ((data_len - IP6_HLEN) & 0xFF);
 	}
 #endif
 #if USE_UDP == 1
-	if(packet_ptr[44] == 0 && packet_ptr[45] == 0) {
+	if(header_len >= 46 && packet_ptr[44] == 0 && packet_ptr[45] == 0) {
 		// udp length
 		packet_ptr[44] = (((data_len - IP6_HLEN) & 0xFF00) >> 8);
 		packet_ptr[45] = ((data_len - IP6_HLEN) & 0xFF);
@@ -1019,100 +3241,222 @@ static uint16_t compute_length(unsigned char *data, uint16_t data_len) {
 	return 0;
 }
 
+/*
+ * Fold a 64-bit accumulator of 16-bit words into a 16-bit ones' complement sum
+ */
+static uint16_t chksum_fold(uint64_t acc) {
+	while (acc >> 16) {
+		acc = (acc & 0xFFFF) + (acc >> 16);
+	}
+
+	return (uint16_t) acc;
+}
+
+/*
+ * Read a big endian 32-bit word
+ */
+static uint32_t chksum_load32(const uint8_t *p) {
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+/*
+ * Add the 16-bit words of data to a ones' complement sum
+ * the words are summed as 32-bit words in a 64-bit accumulator and the carries are folded once
+ * an odd last byte is padded with zero
+ *
+ * @param sum 			the sum so far, in host byte order
+ * @param data 			the bytes to add
+ * @param len 			the number of bytes
+ *
+ * @return sum 			the new sum, in host byte order
+ */
 static uint16_t chksum(uint16_t sum, const uint8_t *data, uint16_t len) {
-	uint16_t t;
-	const uint8_t *dataptr;
-	const uint8_t *last_byte;
+	uint64_t acc0 = sum, acc1 = 0;
+
+	while (len >= 8) {
+		acc0 += chksum_load32(data);
+		acc1 += chksum_load32(data + 4);
+		data += 8;
+		len -= 8;
+	}
+	if (len >= 4) {
+		acc0 += chksum_load32(data);
+		data += 4;
+		len -= 4;
+	}
+	if (len >= 2) {
+		acc1 += ((uint16_t) data[0] << 8) | data[1];
+		data += 2;
+		len -= 2;
+	}
+	if (len) {
+		acc1 += ((uint16_t) data[0] << 8);
+	}
 
-	dataptr = data;
-	last_byte = data + len - 1;
+	return chksum_fold(acc0 + acc1);
+}
 
-	while (dataptr < last_byte) { /* At least two more bytes */
-		t = (dataptr[0] << 8) + dataptr[1];
-		sum += t;
-		if (sum < t) {
-			sum++; /* carry */
-		}
-		dataptr += 2;
+/*
+ * Copy bytes and add their 16-bit words to a ones' complement sum, in a single pass
+ *
+ * @param dst 			the bytes to copy to
+ * @param src 			the bytes to copy and add
+ * @param len 			the number of bytes
+ *
+ * @return sum 			the ones' complement sum of the bytes, in host byte order
+ */
+static uint16_t copy_chksum(uint8_t *dst, const uint8_t *src, uint16_t len) {
+	uint64_t acc0 = 0, acc1 = 0;
+
+	while (len >= 8) {
+		uint32_t w0 = chksum_load32(src);
+		uint32_t w1 = chksum_load32(src + 4);
+		memcpy(dst, src, 8);
+		acc0 += w0;
+		acc1 += w1;
+		src += 8; dst += 8;
+		len -= 8;
 	}
+	memcpy(dst, src, len);
 
-	if (dataptr == last_byte) {
-		t = (dataptr[0] << 8) + 0;
-		sum += t;
-		if (sum < t) {
-			sum++; // carry
-		}
+	return chksum_fold(acc0 + acc1 + chksum(0, src, len));
+}
+
+/*
+ * Add a partial ones' complement sum, of bytes following the bytes summed so far
+ *
+ * @param sum 			the sum so far
+ * @param part 			the sum of the following bytes
+ * @param odd 			1 if the bytes summed so far have an odd length
+ *
+ * @return sum 			the sum of both
+ */
+static uint16_t chksum_add(uint16_t sum, uint16_t part, uint8_t odd) {
+	if (odd) { // the part starts at an odd byte, the sum of swapped bytes is swapped
+		part = (uint16_t) ((part << 8) | (part >> 8));
 	}
 
-	// return sum in host byte order
-	return sum;
+	return chksum_fold((uint64_t) sum + part);
+}
+
+/*
+ * Check whether the UDP checksum of a decompressed packet has to be calculated
+ *
+ * @param header 			pointer to the IPv6 and UDP header
+ * @param header_length 	the number of bytes in header
+ *
+ * @return 1 				the checksum field is set to 0 and has to be calculated
+ */
+static uint8_t checksum_pending(const uint8_t *header, uint16_t header_length) {
+#if USE_UDP == 1
+	// protocol 17 for UDP
+	return (header_length >= (IP6_HLEN + UDP_HLEN) && header[6] == 0x11 && header[46] == 0 && header[47] == 0);
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Set the UDP checksum from the sum of the reconstructed upper layer bytes and the sum of the payload
+ *
+ * @param header 			pointer to the IPv6 and UDP header, followed by the upper layer bytes that were
+ * 							reconstructed
+ * @param header_part 		the number of upper layer bytes in header
+ * @param payload_sum 		the ones' complement sum of the remaining upper layer bytes
+ *
+ * @return checksum the computed checksum
+ */
+static uint16_t checksum_set(unsigned char *header, uint16_t header_part, uint16_t payload_sum) {
+	uint16_t upper_layer_len = (((uint16_t)(header[44]) << 8) + header[45]);
+
+	// protocol (17 for UDP) and length fields. This addition cannot carry.
+	uint16_t sum = upper_layer_len + header[6];
+
+	// sum IP source and destination
+	sum = chksum(sum, (uint8_t *)&header[8], 2 * sizeof(schc_ipaddr_t));
+
+	// sum upper layer headers and data
+	sum = chksum(sum, &header[IP6_HLEN], header_part);
+	sum = chksum_add(sum, payload_sum, header_part % 2);
+
+	uint16_t result = (~sum);
+
+	header[46] = (uint8_t) ((result & 0xFF00) >> 8);
+	header[47] = (uint8_t) (result & 0xFF);
+
+	return result;
 }
 
 /**
- * Calculates the UDP checksum and sets the appropriate header fields
+ * Calculates the UDP checksum of a packet, stored as a header and a payload segment,
+ * and sets the appropriate header fields
  *
- * @param data pointer to the data packet
+ * @param header 			pointer to the IPv6 and UDP header, followed by the upper layer bytes that were
+ * 							reconstructed
+ * @param header_length 	the number of bytes in header
+ * @param payload 			pointer to the remaining upper layer bytes
+ * @param payload_length 	the number of bytes in payload
  *
  * @return checksum the computed checksum
  *
  */
-uint16_t compute_checksum(unsigned char *data) {
+static uint16_t compute_checksum_iov(unsigned char *header, uint16_t header_length,
+		const uint8_t *payload, uint16_t payload_length) {
 	// if the checksum fields are set to 0
 	// the checksum must be calculated
-#if USE_UDP == 1
-	if(data[46] == 0 && data[47] == 0) {
-		uint16_t upper_layer_len; uint16_t sum; uint16_t result;
+	if(checksum_pending(header, header_length)) {
+		uint16_t upper_layer_len = (((uint16_t)(header[44]) << 8) + header[45]);
 
-		uint8_t proto = data[6];
-		if(proto == 0x11) { // protocol (17 for UDP) and length fields. This addition cannot carry.
-			upper_layer_len = (((uint16_t)(data[44]) << 8) + data[45]);
+		uint16_t header_part = header_length - IP6_HLEN;
+		header_part = (upper_layer_len < header_part) ? upper_layer_len : header_part;
 
-			sum = upper_layer_len + proto;
+		uint16_t payload_part = upper_layer_len - header_part;
+		payload_part = (payload_length < payload_part) ? payload_length : payload_part;
 
-			// sum IP source and destination
-			sum = chksum(sum, (uint8_t *)&data[8], 2 * sizeof(schc_ipaddr_t));
+		checksum_set(header, header_part, payload_part ? chksum(0, payload, payload_part) : 0);
 
-			// sum upper layer headers and data
-			sum = chksum(sum, &data[IP6_HLEN], upper_layer_len);
-
-			result = (~sum);
-
-			data[46] = (uint8_t) ((result & 0xFF00) >> 8);
-			data[47] = (uint8_t) (result & 0xFF);
-
-			return 1;
-		}
+		return 1;
 	}
-#endif
 
 	return 0;
 }
 
 /**
- * Construct the header from the layered set of rules
+ * Calculates the UDP checksum and sets the appropriate header fields
+ *
+ * @param data pointer to the data packet
+ *
+ * @return checksum the computed checksum
+ *
+ */
+uint16_t compute_checksum(unsigned char *data) {
+	return compute_checksum_iov(data, UINT16_MAX, NULL, 0);
+}
+
+/**
+ * Construct the header of a packet for a device from the layered set of rules
+ * the payload is not copied, bit_arr->offset is set to the start of the payload
+ * the header of an uncompressed packet is part of the payload
  *
+ * @param 	device				the device
+ * @param 	rule				the rule of the rule id of the packet, as found by get_compression_rule_by_rule_id()
  * @param 	bit_arr				pointer to the received data
- * @param 	buf	 				pointer where to save the decompressed packet
- * @param 	device_id 			the device its id
+ * @param 	buf	 				pointer where to save the decompressed header
  * @param 	total_length 		the total length of the received data
- * @param 	direction			the direction of the flow (UP: LPWAN to IPv6, DOWN: IPv6 to LPWAN)
+ * @param 	direction			the direction of the flow
+ * @param 	rule_out			set to the rule of the packet, NULL if the packet was sent uncompressed
+ * @param 	header_length		set to the length of the decompressed header
  *
- * @return 	length 				length of the newly constructed packet
- * 			0 					the rule or device was not found
+ * @return 	1 					the header was constructed
+ * 			0 					the rule was not found
  */
-uint16_t schc_decompress(schc_bitarray_t* bit_arr, uint8_t *buf,
-		uint32_t device_id, uint16_t total_length, direction dir) {
-	struct schc_device *device = get_device_by_id(device_id);
-	if(device == NULL) {
-		DEBUG_PRINTF("schc_decompress(): No device found with id=%d\n", device_id);
-		return 0;
-	}
+static uint8_t decompress_header(struct schc_device* device, struct schc_compression_rule_t *rule,
+		schc_bitarray_t* bit_arr, uint8_t *buf, uint16_t total_length, direction dir,
+		struct schc_compression_rule_t** rule_out, uint16_t* header_length) {
 
 	DEBUG_PRINTF("\n");
 	DEBUG_PRINTF("schc_decompress(): \n");
 
-	struct schc_compression_rule_t *rule = get_compression_rule_by_rule_id(bit_arr->ptr, device);
-
 	if(rule != NULL) {
 #if USE_COAP == 1
 		if(rule->coap_rule != NULL) {
@@ -1151,26 +3495,29 @@ uint16_t schc_decompress(schc_bitarray_t* bit_arr, uint8_t *buf,
 	uint8_t compressed_id[4] = { 0 };
 	little_end_uint8_from_uint32(compressed_id, device->profile->RULE_ID_SIZE); /* copy the uint32_t to a uint8_t array */
 
-	uint8_t new_header_length = 0;
+	uint16_t new_header_length = 0;
 
 	/* todo
 	 * we have no way of knowing which layers were selected at the compression side
 	 * e.g. using ICMPv6 packets and CoAP packets
 	 */
-	if (compare_bits(bit_arr->ptr, compressed_id, device->profile->RULE_ID_SIZE)) { /* uncompressed packet, copy uncompressed headers */
-		copy_bits(buf, 0, bit_arr->ptr, device->profile->RULE_ID_SIZE,
-				  bit_arr->bit_len - device->profile->RULE_ID_SIZE);
+	if (compare_bits(bit_arr->ptr, compressed_id, device->profile->RULE_ID_SIZE)) { /* uncompressed packet, the headers are copied with the payload */
+		rule = NULL;
 	} else if (rule == NULL) {
 		// did not find any matching rule but uncompressed rule does not fit either.
+		SCHC_TRACE_ERROR(SCHC_EV_DECOMPRESS_NO_RULE, bit_arr->ptr[0], total_length);
 		return 0;
 	} else { // compressed packet, decompress with residue and rule
 		schc_bitarray_t dst_arr;
 		dst_arr.ptr = buf;
 		dst_arr.offset = 0; /* there is no offset (yet) in the destination array */
 
+		schc_bitreader_t residue;
+		schc_bitreader_init(&residue, bit_arr->ptr, bit_arr->offset, total_length);
+
 #if USE_IP6 == 1
 		if (rule->ipv6_rule != NULL) {
-			ret = decompress((struct schc_layer_rule_t *) rule->ipv6_rule, bit_arr, &dst_arr, dir);
+			ret = decompress((struct schc_layer_rule_t *) rule->ipv6_rule, &residue, &dst_arr, dir, iid_get(device));
 			if (ret == 0) {
 				return 0; // no rule was found
 			}
@@ -1186,7 +3533,7 @@ uint16_t schc_decompress(schc_bitarray_t* bit_arr, uint8_t *buf,
 #endif
 #if USE_UDP == 1
 		if (use_udp && (rule->udp_rule != NULL)) {
-			ret = decompress((struct schc_layer_rule_t *) (rule->udp_rule), bit_arr, &dst_arr, dir);
+			ret = decompress((struct schc_layer_rule_t *) (rule->udp_rule), &residue, &dst_arr, dir, NULL);
 			if (ret == 0) {
 				return 0; // no rule was found
 			}
@@ -1195,46 +3542,346 @@ uint16_t schc_decompress(schc_bitarray_t* bit_arr, uint8_t *buf,
 #endif
 #if USE_COAP == 1
 		if (!icmp6_packet && (rule->coap_rule != NULL)) {
-			coap_offset = decompress_coap_rule((struct schc_coap_rule_t *) rule->coap_rule, bit_arr, &pcoap_msg, dir);
+			coap_offset = decompress_coap_rule((struct schc_coap_rule_t *) rule->coap_rule, &residue, &pcoap_msg, dir);
 			if (coap_offset == 0) {
 				return 0; // no rule was found
 			}
 			new_header_length += coap_offset;
 		}
 #endif
+		bit_arr->offset = schc_bitreader_offset(&residue);
 	}
 
 	/* calculate padding */
 	bit_arr->padding = padded(bit_arr);
-	uint16_t payload_bit_length = BYTES_TO_BITS(total_length) - bit_arr->offset - bit_arr->padding; // the schc header minus the total length is the payload length
 
-	copy_bits(buf, BYTES_TO_BITS(new_header_length), bit_arr->ptr, bit_arr->offset, payload_bit_length);
-	uint16_t payload_length = get_number_of_bytes_from_bits(payload_bit_length);
+	*rule_out = rule;
+	*header_length = new_header_length;
 
-	/* set UDP and IPv6 length and checksum if the field is set to 0 */
-	compute_length(buf, (payload_length + new_header_length));
-	compute_checksum(buf);
+	return 1;
+}
 
-	DEBUG_PRINTF("schc_decompress(): header length: %d, payload length %d \n", new_header_length, payload_length);
+/**
+ * Print the decompressed packet and trace the decompression
+ *
+ * @param 	device				the device
+ * @param 	rule				the rule of the packet, NULL if the packet was sent uncompressed
+ * @param 	header	 			the decompressed header
+ * @param 	header_length		the number of bytes in header
+ * @param 	payload	 			the payload, following the header
+ * @param 	payload_length		the number of bytes in payload
+ */
+static void decompress_done(struct schc_device* device, const struct schc_compression_rule_t* rule,
+		const uint8_t* header, uint16_t header_length, const uint8_t* payload, uint16_t payload_length) {
+	DEBUG_PRINTF("schc_decompress(): header length: %d, payload length %d \n", header_length, payload_length);
 
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
 	DEBUG_PRINTF("\n");
 	DEBUG_PRINTF("+---------------------------------+\n");
 	DEBUG_PRINTF("|        Original Packet          |\n");
 	DEBUG_PRINTF("+---------------------------------+\n");
 
 	int i;
-	for (i = 0; i < new_header_length + payload_length; i++) {
-		DEBUG_PRINTF("%02X ", buf[i]);
+	for (i = 0; i < header_length + payload_length; i++) {
+		DEBUG_PRINTF("%02X ", (i < header_length) ? header[i] : payload[i - header_length]);
 		if (!((i + 1) % 12)) {
 			DEBUG_PRINTF("\n");
 		}
 	}
 
 	DEBUG_PRINTF("\n\n");
+#endif
+	SCHC_TRACE_INFO(SCHC_EV_DECOMPRESS, (rule != NULL) ? rule->rule_id : device->profile->UNCOMPRESSED_RULE_ID,
+			header_length + payload_length);
+}
+
+/**
+ * Construct a packet for a device from the layered set of rules
+ *
+ * @param 	device				the device
+ * @param 	rule				the rule of the rule id of the packet, as found by get_compression_rule_by_rule_id()
+ * @param 	bit_arr				pointer to the received data
+ * @param 	buf	 				pointer where to save the decompressed packet
+ * @param 	total_length 		the total length of the received data
+ * @param 	direction			the direction of the flow
+ *
+ * @return 	length 				length of the newly constructed packet
+ * 			0 					the rule was not found
+ */
+static uint16_t decompress_packet(struct schc_device* device, struct schc_compression_rule_t *rule,
+		schc_bitarray_t* bit_arr, uint8_t *buf, uint16_t total_length, direction dir) {
+	uint16_t new_header_length;
+
+	if (!decompress_header(device, rule, bit_arr, buf, total_length, dir, &rule, &new_header_length)) {
+		return 0;
+	}
+
+	uint16_t payload_bit_length = BYTES_TO_BITS(total_length) - bit_arr->offset - bit_arr->padding; // the schc header minus the total length is the payload length
+	uint16_t payload_length = get_number_of_bytes_from_bits(payload_bit_length);
+
+	/* set UDP and IPv6 length and checksum if the field is set to 0 */
+	compute_length(buf, new_header_length, (payload_length + new_header_length));
+
+	if (checksum_pending(buf, new_header_length) && !(bit_arr->offset % 8)
+			&& (((uint16_t) (buf[44]) << 8) + buf[45]) == (new_header_length - IP6_HLEN + payload_length)) {
+		/* the checksum of the payload is calculated while it is copied and the header is added */
+		uint16_t payload_sum = copy_chksum(buf + new_header_length, bit_arr->ptr + (bit_arr->offset / 8), payload_length);
+		checksum_set(buf, new_header_length - IP6_HLEN, payload_sum);
+	} else {
+		copy_bits(buf, BYTES_TO_BITS(new_header_length), bit_arr->ptr, bit_arr->offset, payload_bit_length);
+		compute_length(buf, (payload_length + new_header_length), (payload_length + new_header_length));
+		compute_checksum(buf);
+	}
+
+	decompress_done(device, rule, buf, new_header_length, buf + new_header_length, payload_length);
 
 	return new_header_length + payload_length;
 }
 
+/**
+ * Construct the header from the layered set of rules
+ *
+ * @param 	bit_arr				pointer to the received data
+ * @param 	buf	 				pointer where to save the decompressed packet
+ * @param 	device_id 			the device its id
+ * @param 	total_length 		the total length of the received data
+ * @param 	direction			the direction of the flow (UP: LPWAN to IPv6, DOWN: IPv6 to LPWAN)
+ *
+ * @return 	length 				length of the newly constructed packet
+ * 			0 					the rule or device was not found
+ */
+uint16_t schc_decompress(schc_bitarray_t* bit_arr, uint8_t *buf,
+		uint64_t device_id, uint16_t total_length, direction dir) {
+	struct schc_device *device = get_device_by_id(device_id);
+	if(device == NULL) {
+		DEBUG_PRINTF("schc_decompress(): No device found with id=%" PRIu64 "\n", device_id);
+		return 0;
+	}
+
+	return decompress_packet(device, get_compression_rule_by_rule_id(bit_arr->ptr, device),
+			bit_arr, buf, total_length, dir);
+}
+
+/**
+ * Construct the header from the layered set of rules, without copying the payload
+ * if the payload starts on a byte boundary, only the header is written to buf
+ * and the payload is referred to in place, in the received data:
+ * the packet is the header in iov[0], followed by the payload in iov[1]
+ * otherwise the payload is shifted into buf, behind the header, and iov[1] is empty
+ * the IPv6 and UDP header of an uncompressed packet are copied to buf, to set the length and checksum
+ *
+ * @param 	bit_arr				pointer to the received data
+ * @param 	buf	 				pointer where to save the decompressed header,
+ * 								SCHC_DECOMPRESS_HEADROOM bytes at least
+ * @param 	buf_len 			the size of buf, a shifted payload has to fit buf as well
+ * @param 	iov	 				set to the header and the payload of the decompressed packet
+ * @param 	device_id 			the device its id
+ * @param 	total_length 		the total length of the received data
+ * @param 	direction			the direction of the flow (UP: LPWAN to IPv6, DOWN: IPv6 to LPWAN)
+ *
+ * @return 	length 				length of the newly constructed packet
+ * 			0 					the rule or device was not found or the shifted payload does not fit buf
+ */
+uint16_t schc_decompress_iov(schc_bitarray_t* bit_arr, uint8_t *buf, uint16_t buf_len, schc_iovec_t iov[2],
+		uint64_t device_id, uint16_t total_length, direction dir) {
+	struct schc_compression_rule_t *rule;
+	uint16_t header_length;
+
+	iov[0] = (schc_iovec_t) { .ptr = buf, .len = 0 };
+	iov[1] = (schc_iovec_t) { .ptr = NULL, .len = 0 };
+
+	struct schc_device *device = get_device_by_id(device_id);
+	if(device == NULL) {
+		DEBUG_PRINTF("schc_decompress_iov(): No device found with id=%" PRIu64 "\n", device_id);
+		return 0;
+	}
+	if (buf_len < SCHC_DECOMPRESS_HEADROOM) {
+		return 0;
+	}
+
+	rule = get_compression_rule_by_rule_id(bit_arr->ptr, device);
+	if (!decompress_header(device, rule, bit_arr, buf, total_length, dir, &rule, &header_length)) {
+		return 0;
+	}
+
+	uint16_t payload_bit_length = BYTES_TO_BITS(total_length) - bit_arr->offset - bit_arr->padding;
+	uint16_t payload_length = get_number_of_bytes_from_bits(payload_bit_length);
+	uint16_t payload_offset = 0;
+
+	if (!(bit_arr->offset % 8)) {
+		/* the payload is used in place, the headers of an uncompressed packet are copied to set their fields */
+		if (rule == NULL) {
+			payload_offset = (IP6_HLEN * USE_IP6) + (UDP_HLEN * USE_UDP);
+			payload_offset = (payload_length < payload_offset) ? payload_length : payload_offset;
+			memcpy(buf, bit_arr->ptr + (bit_arr->offset / 8), payload_offset);
+			header_length = payload_offset;
+		}
+		iov[1] = (schc_iovec_t) { .ptr = bit_arr->ptr + (bit_arr->offset / 8) + payload_offset,
+				.len = (uint16_t) (payload_length - payload_offset) };
+	} else {
+		if ((uint32_t) header_length + payload_length > buf_len) {
+			DEBUG_PRINTF("schc_decompress_iov(): the payload does not fit the buffer\n");
+			return 0;
+		}
+		copy_bits(buf, BYTES_TO_BITS(header_length), bit_arr->ptr, bit_arr->offset, payload_bit_length);
+		header_length += payload_length;
+	}
+	iov[0].len = header_length;
+
+	/* set UDP and IPv6 length and checksum if the field is set to 0 */
+	uint16_t packet_length = iov[0].len + iov[1].len;
+	compute_length(buf, iov[0].len, packet_length);
+	compute_checksum_iov(buf, iov[0].len, iov[1].ptr, iov[1].len);
+
+	decompress_done(device, rule, iov[0].ptr, iov[0].len, iov[1].ptr, iov[1].len);
+
+	return packet_length;
+}
+
+#if defined(__GNUC__)
+#define BATCH_PREFETCH(_ptr)		__builtin_prefetch((_ptr), 0, 3)
+#else
+#define BATCH_PREFETCH(_ptr)
+#endif
+
+/*
+ * Sort the packets of a batch on a key, packets with the same key keep their order
+ *
+ * @param order			the indices of the packets, sorted in place
+ * @param keys			the key of each packet, indexed like @p order
+ * @param count			the number of packets
+ */
+static void batch_sort(uint16_t* order, uint64_t* keys, uint16_t count) {
+	uint16_t i, j;
+
+	for (i = 1; i < count; i++) {
+		uint16_t index = order[i];
+		uint64_t key = keys[i];
+		for (j = i; j > 0 && keys[j - 1] > key; j--) {
+			order[j] = order[j - 1];
+			keys[j] = keys[j - 1];
+		}
+		order[j] = index;
+		keys[j] = key;
+	}
+}
+
+/**
+ * Compresses a batch of CoAP/UDP/IP packets, for the same or different devices
+ * the packets are compressed per device, so the device is looked up once for each device
+ * and its rules are used for all its packets in a row
+ *
+ * @param 	batch 			the packets, the dst and rule of each packet are set as by schc_compress()
+ * @param 	count		 	the number of packets
+ *
+ * @return 	compressed		the number of packets that were compressed (with a rule or uncompressed)
+ */
+uint16_t schc_compress_batch(schc_compress_desc_t* batch, uint16_t count) {
+	uint16_t order[SCHC_BATCH_GROUP];
+	uint64_t keys[SCHC_BATCH_GROUP];
+	uint16_t compressed = 0;
+	uint16_t start, i;
+
+	for (start = 0; start < count; start += SCHC_BATCH_GROUP) {
+		uint16_t group = ((count - start) < SCHC_BATCH_GROUP) ? (count - start) : SCHC_BATCH_GROUP;
+		for (i = 0; i < group; i++) {
+			order[i] = start + i;
+			keys[i] = batch[start + i].device_id;
+		}
+		batch_sort(order, keys, group);
+
+		struct schc_device* device = NULL;
+		for (i = 0; i < group; i++) {
+			schc_compress_desc_t* desc = &batch[order[i]];
+			if (i + 1 < group) { /* the headers of the next packet */
+				BATCH_PREFETCH(batch[order[i + 1]].data);
+				BATCH_PREFETCH(batch[order[i + 1]].data + 64);
+			}
+			if (i == 0 || keys[i] != keys[i - 1]) {
+				device = get_device_by_id(desc->device_id);
+			}
+
+			desc->compressed = 0;
+			desc->rule = NULL;
+			if (device == NULL) {
+				DEBUG_PRINTF("schc_compress_batch(): no device was found for this id=%02" PRIu64 "\n",
+						desc->device_id);
+				continue;
+			}
+			desc->compressed = compress_packet(device, desc->data, desc->length, desc->dst, desc->dir,
+					&desc->rule);
+			compressed += desc->compressed;
+		}
+	}
+
+	return compressed;
+}
+
+/**
+ * Decompresses a batch of SCHC packets, for the same or different devices
+ * the packets are decompressed per device and rule, so the device is looked up once
+ * for each device and the rule once for each run of packets with the same rule id
+ *
+ * @param 	batch 			the packets, the length of each decompressed packet is set
+ * 							as returned by schc_decompress()
+ * @param 	count		 	the number of packets
+ *
+ * @return 	decompressed	the number of packets that were decompressed
+ */
+uint16_t schc_decompress_batch(schc_decompress_desc_t* batch, uint16_t count) {
+	uint16_t order[SCHC_BATCH_GROUP];
+	uint64_t keys[SCHC_BATCH_GROUP];
+	uint16_t decompressed = 0;
+	uint16_t start, i, j, k;
+
+	for (start = 0; start < count; start += SCHC_BATCH_GROUP) {
+		uint16_t group = ((count - start) < SCHC_BATCH_GROUP) ? (count - start) : SCHC_BATCH_GROUP;
+		for (i = 0; i < group; i++) {
+			order[i] = start + i;
+			keys[i] = batch[start + i].device_id;
+		}
+		batch_sort(order, keys, group);
+
+		for (i = 0; i < group; i = j) {
+			struct schc_device* device = get_device_by_id(keys[i]);
+
+			/* the packets of the device, before their keys are replaced */
+			j = i + 1;
+			while (j < group && keys[j] == keys[i]) {
+				j++;
+			}
+			if (device != NULL) { /* sort on the rule id */
+				for (k = i; k < j; k++) {
+					keys[k] = get_bits(batch[order[k]].src->ptr, 0, device->profile->RULE_ID_SIZE);
+				}
+				batch_sort(order + i, keys + i, j - i);
+			}
+
+			struct schc_compression_rule_t* rule = NULL;
+			for (k = i; k < j; k++) {
+				schc_decompress_desc_t* desc = &batch[order[k]];
+				if (k + 1 < group) { /* the residue of the next packet */
+					BATCH_PREFETCH(batch[order[k + 1]].src->ptr);
+				}
+
+				desc->length = 0;
+				if (device == NULL) {
+					DEBUG_PRINTF("schc_decompress_batch(): No device found with id=%" PRIu64 "\n",
+							desc->device_id);
+					continue;
+				}
+				if (k == i || keys[k] != keys[k - 1]) { /* the first packet of a rule id */
+					rule = get_compression_rule_by_rule_id(desc->src->ptr, device);
+				}
+				desc->length = decompress_packet(device, rule, desc->src, desc->buf, desc->total_length, desc->dir);
+				decompressed += (desc->length > 0);
+			}
+		}
+	}
+
+	return decompressed;
+}
+
 #if CLICK
 ELEMENT_PROVIDES(schcCOMPRESSOR)
 ELEMENT_REQUIRES(schcJSON schcCOAP schcBIT)
@@ -11,16 +11,150 @@
 
 #include "schc.h"
 
+#ifndef SCHC_RULE_TREE
+#define SCHC_RULE_TREE					1
+#endif
+#ifndef SCHC_RULE_TREE_DEVICES
+#define SCHC_RULE_TREE_DEVICES			4
+#endif
+#ifndef SCHC_RULE_TREE_NODES
+#define SCHC_RULE_TREE_NODES			128
+#endif
+#ifndef SCHC_RULE_TREE_BRANCHES
+#define SCHC_RULE_TREE_BRANCHES			256
+#endif
+#ifndef SCHC_RULE_TREE_LEAF_ENTRIES
+#define SCHC_RULE_TREE_LEAF_ENTRIES		256
+#endif
+#ifndef SCHC_RULE_TREE_RULES
+#define SCHC_RULE_TREE_RULES			64
+#endif
+#ifndef SCHC_MATCHMAP_INDEX
+#define SCHC_MATCHMAP_INDEX				1
+#endif
+#ifndef SCHC_MATCHMAP_TABLES
+#define SCHC_MATCHMAP_TABLES			32
+#endif
+#ifndef SCHC_COMPACT_RULES
+#define SCHC_COMPACT_RULES				1
+#endif
+#ifndef SCHC_COMPACT_RULE_COUNT
+#define SCHC_COMPACT_RULE_COUNT			64
+#endif
+#ifndef SCHC_COMPACT_FIELDS
+#define SCHC_COMPACT_FIELDS				512
+#endif
+#ifndef SCHC_COMPACT_POOL_BYTES
+#define SCHC_COMPACT_POOL_BYTES			1024
+#endif
+#ifndef SCHC_GENERATED_RULES
+#define SCHC_GENERATED_RULES			0
+#endif
+#ifndef SCHC_GENERATED_RULE_COUNT
+#define SCHC_GENERATED_RULE_COUNT		64
+#endif
+#ifndef SCHC_MATCH_RECORDS
+#define SCHC_MATCH_RECORDS				4
+#endif
+#ifndef SCHC_HEADER_CACHE
+#define SCHC_HEADER_CACHE				0
+#endif
+#ifndef SCHC_HEADER_CACHE_ENTRIES
+#define SCHC_HEADER_CACHE_ENTRIES		8
+#endif
+#ifndef SCHC_HEADER_CACHE_COAP_BYTES
+#define SCHC_HEADER_CACHE_COAP_BYTES	32
+#endif
+#ifndef SCHC_COAP_OPTION_ORDER
+#define SCHC_COAP_OPTION_ORDER		1
+#endif
+#ifndef SCHC_COAP_OPTION_ORDERS
+#define SCHC_COAP_OPTION_ORDERS		16
+#endif
+#ifndef SCHC_BATCH_GROUP
+#define SCHC_BATCH_GROUP				32
+#endif
+#ifndef SCHC_IOV_MAX
+#define SCHC_IOV_MAX					8
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 uint8_t schc_compressor_init();
 struct schc_compression_rule_t* schc_compress(uint8_t *data, uint16_t total_length,
-		schc_bitarray_t* buf, uint32_t device_id, direction dir);
+		schc_bitarray_t* buf, uint64_t device_id, direction dir);
 
 uint16_t schc_decompress(schc_bitarray_t* bit_arr, uint8_t *buf,
-		uint32_t device_id, uint16_t total_length, direction dir);
+		uint64_t device_id, uint16_t total_length, direction dir);
+
+/* a segment of a packet */
+typedef struct schc_iovec_t {
+	uint8_t* ptr;
+	uint16_t len;
+} schc_iovec_t;
+
+/* a compressed frame: the rule id and residue in the bit array, followed by the payload segments */
+typedef struct schc_frame_t {
+	/* the payload segments, as is, 0 if the payload was copied into the bit array */
+	schc_iovec_t payload[SCHC_IOV_MAX];
+	uint8_t payload_count;
+	/* the length of the frame in bytes */
+	uint16_t len;
+} schc_frame_t;
+
+struct schc_compression_rule_t* schc_compress_iov(const schc_iovec_t* iov, uint8_t iov_count,
+		schc_bitarray_t* dst, schc_frame_t* frame, uint64_t device_id, direction dir);
+
+/* the size of the buffer schc_decompress_iov() needs for the largest header */
+#define SCHC_DECOMPRESS_HEADROOM		((IP6_HLEN * USE_IP6) + (UDP_HLEN * USE_UDP) + (MAX_COAP_HEADER_LENGTH * USE_COAP))
+
+uint16_t schc_decompress_iov(schc_bitarray_t* bit_arr, uint8_t *buf, uint16_t buf_len, schc_iovec_t iov[2],
+		uint64_t device_id, uint16_t total_length, direction dir);
+
+/* a packet of a compression batch */
+typedef struct schc_compress_desc_t {
+	/* the packet to compress */
+	uint8_t* data;
+	uint16_t length;
+	uint64_t device_id;
+	direction dir;
+	/* the bit array to store the compressed packet in */
+	schc_bitarray_t* dst;
+	/* set to the rule that was used, NULL if the packet was sent uncompressed */
+	struct schc_compression_rule_t* rule;
+	/* set to 1 if the compressed packet was stored in dst,
+	 * 0 if the device was not found or the packet could not be compressed */
+	uint8_t compressed;
+} schc_compress_desc_t;
+
+/* a packet of a decompression batch */
+typedef struct schc_decompress_desc_t {
+	/* the compressed packet */
+	schc_bitarray_t* src;
+	uint16_t total_length;
+	uint64_t device_id;
+	direction dir;
+	/* the buffer to store the decompressed packet in */
+	uint8_t* buf;
+	/* set to the length of the decompressed packet, 0 if it was not decompressed */
+	uint16_t length;
+} schc_decompress_desc_t;
+
+uint16_t schc_compress_batch(schc_compress_desc_t* batch, uint16_t count);
+uint16_t schc_decompress_batch(schc_decompress_desc_t* batch, uint16_t count);
+
+#if SCHC_HEADER_CACHE == 1
+typedef struct schc_header_cache_stats_t {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t insertions;
+} schc_header_cache_stats_t;
+
+void schc_header_cache_flush();
+void schc_header_cache_get_stats(schc_header_cache_stats_t* stats);
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,272 @@
+/*
+ * (c) 2018 - 2022  idlab - UGent - imec
+ *
+ * Bart Moons
+ *
+ * This file is part of the SCHC stack implementation
+ *
+ * This is a benchmark for the batch compression API
+ * It compresses and decompresses the same packets, for two devices in both directions,
+ * once per packet and with schc_compress_batch() and schc_decompress_batch(),
+ * for a sweep of batch sizes and reports the ns per packet
+ *
+ * usage: ./bench_batch [-q]
+ * 	-q	quick run, less iterations
+ *
+ * the output of the library is discarded, set SCHC_TRACE_LEVEL below 3
+ * to leave the packet dumps out of the measurement
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../compressor.h"
+
+#define MAX_PACKET_LENGTH		128
+#define MAX_BATCH				128
+#define TARGET_PACKETS			(1 << 17) /* amount of packets per measurement */
+
+static const uint32_t batch_sizes[] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+
+/* IPv6/UDP/CoAP packets from the device (CCCC::2) to the network gateway (AAAA::1) and back */
+static const uint8_t msg_up[] = {
+		0x60, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x11, 0x40, 0xCC, 0xCC, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xAA, 0xAA, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+		0x33, 0x16, 0x33, 0x16, 0x00, 0x1E, 0x05, 0x2C,
+		0x54, 0x03, 0x23, 0xBB, 0x21, 0xFA, 0x01, 0xFB, 0xB5, 0x75, 0x73, 0x61, 0x67, 0x65,
+		0xD1, 0xEA, 0x1A, 0xFF,
+		0x01, 0x02, 0x03, 0x04 };
+static const uint8_t msg_down[] = {
+		0x60, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x11, 0x40, 0xAA, 0xAA, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xCC, 0xCC, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+		0x33, 0x16, 0x33, 0x16, 0x00, 0x1E, 0x05, 0x2C,
+		0x54, 0x03, 0x23, 0xBB, 0x21, 0xFA, 0x01, 0xFB, 0xB5, 0x75, 0x73, 0x61, 0x67, 0x65,
+		0xD1, 0xEA, 0x1A, 0xFF,
+		0x01, 0x02, 0x03, 0x04 };
+
+static const uint64_t device_ids[] = { 0x06, 0x01 };
+
+static uint8_t packets[MAX_BATCH][MAX_PACKET_LENGTH];
+static uint8_t compressed[MAX_BATCH][MAX_PACKET_LENGTH];
+static uint8_t decompressed[MAX_BATCH][MAX_PACKET_LENGTH];
+static schc_bitarray_t bit_arrays[MAX_BATCH];
+static schc_compress_desc_t compress_batch[MAX_BATCH];
+static schc_decompress_desc_t decompress_batch[MAX_BATCH];
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * fill the batch with packets for alternating devices and directions
+ */
+static void init_batch(void) {
+	uint32_t i;
+	for (i = 0; i < MAX_BATCH; i++) {
+		direction dir = (i / 2) % 2 ? DOWN : UP;
+		memcpy(packets[i], dir == UP ? msg_up : msg_down, sizeof(msg_up));
+		packets[i][sizeof(msg_up) - 1] = (uint8_t) i; /* payload */
+
+		bit_arrays[i] = (schc_bitarray_t) SCHC_DEFAULT_BIT_ARRAY(MAX_PACKET_LENGTH, compressed[i]);
+		compress_batch[i] = (schc_compress_desc_t) { .data = packets[i], .length = sizeof(msg_up),
+				.device_id = device_ids[i % 2], .dir = dir, .dst = &bit_arrays[i] };
+		decompress_batch[i] = (schc_decompress_desc_t) { .src = &bit_arrays[i],
+				.device_id = device_ids[i % 2], .dir = dir, .buf = decompressed[i] };
+	}
+}
+
+static void compress_single(uint32_t n) {
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		bit_arrays[i].len = MAX_PACKET_LENGTH;
+		compress_batch[i].rule = schc_compress(compress_batch[i].data, compress_batch[i].length,
+				&bit_arrays[i], compress_batch[i].device_id, compress_batch[i].dir);
+	}
+}
+
+static void compress_batched(uint32_t n) {
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		bit_arrays[i].len = MAX_PACKET_LENGTH;
+	}
+	schc_compress_batch(compress_batch, n);
+}
+
+static void decompress_single(uint32_t n) {
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		bit_arrays[i].offset = 0;
+		decompress_batch[i].length = schc_decompress(&bit_arrays[i], decompressed[i],
+				decompress_batch[i].device_id, bit_arrays[i].len, decompress_batch[i].dir);
+	}
+}
+
+static void decompress_batched(uint32_t n) {
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		bit_arrays[i].offset = 0;
+		decompress_batch[i].total_length = bit_arrays[i].len;
+	}
+	schc_decompress_batch(decompress_batch, n);
+}
+
+static double measure(void (*fn)(uint32_t), uint32_t batch_size, uint32_t scale) {
+	uint32_t rounds = TARGET_PACKETS / scale / batch_size + 1;
+	uint32_t i;
+
+	fn(batch_size); /* warm up */
+	uint64_t start = now_ns();
+	for (i = 0; i < rounds; i++) {
+		fn(batch_size);
+	}
+	uint64_t ns = now_ns() - start;
+
+	return (double) ns / ((double) rounds * batch_size);
+}
+
+/*
+ * check the batch calls store the same packets as the calls per packet
+ * the decompressor fills in the UDP checksum, so the packets are not compared to the original
+ */
+static int verify(void) {
+	static uint8_t single[MAX_BATCH][MAX_PACKET_LENGTH];
+	static uint16_t single_len[MAX_BATCH];
+	uint32_t i;
+
+	compress_single(MAX_BATCH);
+	for (i = 0; i < MAX_BATCH; i++) {
+		memcpy(single[i], compressed[i], MAX_PACKET_LENGTH);
+		single_len[i] = bit_arrays[i].len;
+	}
+	compress_batched(MAX_BATCH);
+	for (i = 0; i < MAX_BATCH; i++) {
+		if (single_len[i] != bit_arrays[i].len || memcmp(single[i], compressed[i], single_len[i])) {
+			return 0;
+		}
+	}
+
+	decompress_single(MAX_BATCH);
+	for (i = 0; i < MAX_BATCH; i++) {
+		if (decompress_batch[i].length != sizeof(msg_up)) {
+			return 0;
+		}
+		memcpy(single[i], decompressed[i], MAX_PACKET_LENGTH);
+		memset(decompressed[i], 0, MAX_PACKET_LENGTH);
+	}
+	decompress_batched(MAX_BATCH);
+	for (i = 0; i < MAX_BATCH; i++) {
+		if (decompress_batch[i].length != sizeof(msg_up)
+				|| memcmp(decompressed[i], single[i], sizeof(msg_up))) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * check a batch mixing devices, of which one is not provisioned
+ * the packets are grouped per device in the order 0x01, 0x01, 0x06, UNKNOWN_DEVICE_ID,
+ * the packet of device 0x06 carries the id of the device that is not provisioned as its rule id,
+ * so the id of that device and the rule id of the packet before it are the same
+ */
+#define UNKNOWN_DEVICE_ID		0x63
+
+static int verify_devices(void) {
+	static const uint64_t ids[] = { 0x06, 0x01, UNKNOWN_DEVICE_ID, 0x01 };
+	static uint8_t single[4][MAX_PACKET_LENGTH];
+	static uint16_t single_len[4];
+	schc_compress_desc_t c_batch[4];
+	schc_decompress_desc_t d_batch[4];
+	uint32_t i;
+
+	for (i = 0; i < 4; i++) {
+		bit_arrays[i] = (schc_bitarray_t) SCHC_DEFAULT_BIT_ARRAY(MAX_PACKET_LENGTH, compressed[i]);
+		c_batch[i] = (schc_compress_desc_t) { .data = packets[i], .length = sizeof(msg_up),
+				.device_id = ids[i], .dir = UP, .dst = &bit_arrays[i] };
+		d_batch[i] = (schc_decompress_desc_t) { .src = &bit_arrays[i], .device_id = ids[i],
+				.dir = UP, .buf = decompressed[i] };
+		memcpy(packets[i], msg_up, sizeof(msg_up));
+	}
+	if (schc_compress_batch(c_batch, 4) != 3 || c_batch[2].compressed) {
+		return 0;
+	}
+
+	/* the packet of the device that is not provisioned holds a packet compressed for device 0x06 */
+	memcpy(compressed[2], compressed[0], MAX_PACKET_LENGTH);
+	bit_arrays[2].len = bit_arrays[0].len;
+	compressed[0][0] = UNKNOWN_DEVICE_ID;
+
+	for (i = 0; i < 4; i++) {
+		bit_arrays[i].offset = 0;
+		single_len[i] = schc_decompress(&bit_arrays[i], single[i], ids[i], bit_arrays[i].len, UP);
+		bit_arrays[i].offset = 0;
+		d_batch[i].total_length = bit_arrays[i].len;
+	}
+	schc_decompress_batch(d_batch, 4);
+	for (i = 0; i < 4; i++) {
+		if (d_batch[i].length != single_len[i] || memcmp(decompressed[i], single[i], single_len[i])) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	uint32_t scale = 1;
+	uint32_t i;
+
+	if (argc > 1 && !strcmp(argv[1], "-q")) {
+		scale = 16;
+	} else if (argc > 1) {
+		printf("usage: %s [-q]\n", argv[0]);
+		return 1;
+	}
+
+	/* print the results on the original stdout, discard the output of the library */
+	FILE* out = fdopen(dup(fileno(stdout)), "w");
+	if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+		return 1;
+	}
+
+	if (!schc_compressor_init()) {
+		fprintf(out, "bench_batch(): could not initialize the compressor\n");
+		return 1;
+	}
+	if (!verify_devices()) {
+		fprintf(out, "bench_batch(): the batch of mixed devices and the single packet results differ\n");
+		return 1;
+	}
+	init_batch();
+
+	if (!verify()) {
+		fprintf(out, "bench_batch(): the batch and single packet results differ\n");
+		return 1;
+	}
+
+	fprintf(out, "%8s %14s %14s %8s %14s %14s %8s\n", "batch", "compress", "batch", "speedup",
+			"decompress", "batch", "speedup");
+	for (i = 0; i < sizeof(batch_sizes) / sizeof(batch_sizes[0]); i++) {
+		uint32_t n = batch_sizes[i];
+		double c_single = measure(compress_single, n, scale);
+		double c_batch = measure(compress_batched, n, scale);
+		double d_single = measure(decompress_single, n, scale);
+		double d_batch = measure(decompress_batched, n, scale);
+		fprintf(out, "%8u %11.1f ns %11.1f ns %7.2fx %11.1f ns %11.1f ns %7.2fx\n", n, c_single, c_batch,
+				c_single / c_batch, d_single, d_batch, d_single / d_batch);
+	}
+	fprintf(out, "ns per packet\n");
+	fclose(out);
+
+	return 0;
+}
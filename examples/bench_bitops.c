@@ -0,0 +1,344 @@
+/*
+ * (c) 2018 - 2022  idlab - UGent - imec
+ *
+ * Bart Moons
+ *
+ * This file is part of the SCHC stack implementation
+ *
+ * This is a micro-benchmark for the bit operations
+ * It sweeps the source and destination bit offsets (0 - 7)
+ * and the length (1 bit - 4 KiB) and reports ns/op and cycles/byte
+ *
+ * usage: ./bench_bitops [-q] [-o baseline.csv] [-c previous.csv]
+ * 	-q	quick run, less iterations
+ * 	-o	write the results to a csv file (default bench_bitops.csv)
+ * 	-c	compare with the results of a previous run
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "../bit_operations.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_CYCLE_COUNTER		1
+#else
+#define HAS_CYCLE_COUNTER		0
+#endif
+
+#define MAX_BYTES				(4096 + 16)
+#define TARGET_BITS_PER_RUN		(1 << 24) /* amount of bits moved per measurement */
+#define MAX_RESULTS				8192
+
+typedef enum {
+	BENCH_COPY_BITS = 0,
+	BENCH_GET_BITS,
+	BENCH_COMPARE_BIT_SEQUENCE,
+	BENCH_COMPARE_BITS_ALIGNED,
+	BENCH_SHIFT_BITS_LEFT,
+	BENCH_SHIFT_BITS_RIGHT,
+	BENCH_XOR_BITS,
+	BENCH_FUNCTIONS
+} bench_function_t;
+
+static const char* bench_names[BENCH_FUNCTIONS] = {
+	"copy_bits", "get_bits", "compare_bit_sequence", "compare_bits_aligned",
+	"shift_bits_left", "shift_bits_right", "xor_bits"
+};
+
+/* the lengths in bits, from 1 bit to 4 KiB */
+static const uint32_t bench_lengths[] = {
+	1, 3, 8, 13, 32, 64, 100, 256, 1000, 2048, 8192, 16384, 32768
+};
+
+typedef struct bench_result_t {
+	char name[32];
+	uint8_t src_offset;
+	uint8_t dst_offset;
+	uint32_t bits;
+	double ns_per_op;
+	double cycles_per_byte;
+} bench_result_t;
+
+static uint8_t src_buf[MAX_BYTES];
+static uint8_t cmp_buf[MAX_BYTES];
+static uint8_t dst_buf[MAX_BYTES];
+static volatile uint32_t sink;
+
+static bench_result_t results[MAX_RESULTS];
+static uint32_t result_count;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void) {
+#if HAS_CYCLE_COUNTER
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/*
+ * the maximum length a function accepts, in bits
+ */
+static uint32_t max_length(bench_function_t fn) {
+	switch (fn) {
+	case BENCH_GET_BITS:
+		return 32;
+	case BENCH_COMPARE_BITS_ALIGNED:
+		return BYTES_TO_BITS(MAX_FIELD_LENGTH) - 8;
+	case BENCH_COMPARE_BIT_SEQUENCE:
+		return 0xFFFF - 8; /* positions are 16 bit */
+	default:
+		return BYTES_TO_BITS(4096);
+	}
+}
+
+/*
+ * the functions working on a single array only sweep the source offset
+ */
+static uint8_t uses_dst_offset(bench_function_t fn) {
+	return (fn == BENCH_COPY_BITS || fn == BENCH_COMPARE_BIT_SEQUENCE
+			|| fn == BENCH_COMPARE_BITS_ALIGNED);
+}
+
+static void run_once(bench_function_t fn, uint8_t src_offset, uint8_t dst_offset,
+		uint32_t bits) {
+	switch (fn) {
+	case BENCH_COPY_BITS:
+		copy_bits(dst_buf, dst_offset, src_buf, src_offset, bits);
+		break;
+	case BENCH_GET_BITS:
+		sink += get_bits(src_buf, src_offset, bits);
+		break;
+	case BENCH_COMPARE_BIT_SEQUENCE:
+		sink += compare_bit_sequence(src_buf, src_offset, cmp_buf, dst_offset, bits);
+		break;
+	case BENCH_COMPARE_BITS_ALIGNED:
+		sink += compare_bits_aligned(src_buf, src_offset, cmp_buf, dst_offset, bits);
+		break;
+	case BENCH_SHIFT_BITS_LEFT:
+		shift_bits_left(dst_buf, BITS_TO_BYTES(bits), src_offset);
+		break;
+	case BENCH_SHIFT_BITS_RIGHT:
+		shift_bits_right(dst_buf, BITS_TO_BYTES(bits), src_offset);
+		break;
+	case BENCH_XOR_BITS:
+		xor_bits(dst_buf, src_buf, cmp_buf, bits);
+		break;
+	default:
+		break;
+	}
+}
+
+static void measure(bench_function_t fn, uint8_t src_offset, uint8_t dst_offset,
+		uint32_t bits, uint32_t scale) {
+	uint32_t iterations = TARGET_BITS_PER_RUN / scale / (bits + 64) + 16;
+	uint32_t i;
+
+	/* the compared arrays hold the same bit sequence, so the comparison runs to the end */
+	memset(cmp_buf, 0, sizeof(cmp_buf));
+	copy_bits(cmp_buf, dst_offset, src_buf, src_offset, bits);
+
+	for (i = 0; i < 16; i++) { /* warm up */
+		run_once(fn, src_offset, dst_offset, bits);
+	}
+
+	uint64_t start_ns = now_ns();
+	uint64_t start_cycles = now_cycles();
+	for (i = 0; i < iterations; i++) {
+		run_once(fn, src_offset, dst_offset, bits);
+	}
+	uint64_t cycles = now_cycles() - start_cycles;
+	uint64_t ns = now_ns() - start_ns;
+
+	if (result_count >= MAX_RESULTS) {
+		return;
+	}
+
+	bench_result_t* res = &results[result_count++];
+	snprintf(res->name, sizeof(res->name), "%s", bench_names[fn]);
+	res->src_offset = src_offset;
+	res->dst_offset = dst_offset;
+	res->bits = bits;
+	res->ns_per_op = (double) ns / iterations;
+	res->cycles_per_byte = HAS_CYCLE_COUNTER ?
+			((double) cycles / iterations) / ((bits + 7) / 8) : 0;
+}
+
+static const bench_result_t* find_result(const bench_result_t* list, uint32_t count,
+		const bench_result_t* res) {
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		if (!strcmp(list[i].name, res->name) && list[i].src_offset == res->src_offset
+				&& list[i].dst_offset == res->dst_offset && list[i].bits == res->bits) {
+			return &list[i];
+		}
+	}
+	return NULL;
+}
+
+static uint32_t read_baseline(const char* path, bench_result_t* list) {
+	char line[256];
+	uint32_t count = 0;
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		printf("bench_bitops(): could not open %s \n", path);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), f) && count < MAX_RESULTS) {
+		bench_result_t* res = &list[count];
+		unsigned src_offset, dst_offset;
+		if (sscanf(line, "%31[^,],%u,%u,%u,%lf,%lf", res->name, &src_offset, &dst_offset,
+				&res->bits, &res->ns_per_op, &res->cycles_per_byte) == 6) {
+			res->src_offset = src_offset;
+			res->dst_offset = dst_offset;
+			count++;
+		}
+	}
+	fclose(f);
+
+	return count;
+}
+
+static int write_baseline(const char* path) {
+	uint32_t i;
+	FILE* f = fopen(path, "w");
+	if (f == NULL) {
+		printf("bench_bitops(): could not write %s \n", path);
+		return 0;
+	}
+
+	fprintf(f, "# function,src_offset,dst_offset,bits,ns_per_op,cycles_per_byte\n");
+	for (i = 0; i < result_count; i++) {
+		fprintf(f, "%s,%u,%u,%u,%.3f,%.4f\n", results[i].name, results[i].src_offset,
+				results[i].dst_offset, results[i].bits, results[i].ns_per_op,
+				results[i].cycles_per_byte);
+	}
+	fclose(f);
+
+	return 1;
+}
+
+/*
+ * print the mean over the offsets for every function and length
+ */
+static void print_summary(const bench_result_t* previous, uint32_t previous_count) {
+	uint32_t i, j;
+
+	printf("%-22s %8s %12s %12s", "function", "bits", "ns/op", "cycles/B");
+	if (previous_count) {
+		printf(" %12s %8s", "prev ns/op", "speedup");
+	}
+	printf("\n");
+
+	for (i = 0; i < result_count; i++) {
+		/* only print the first entry of every function and length */
+		uint8_t printed = 0;
+		for (j = 0; j < i; j++) {
+			if (!strcmp(results[j].name, results[i].name) && results[j].bits == results[i].bits) {
+				printed = 1;
+				break;
+			}
+		}
+		if (printed) {
+			continue;
+		}
+
+		double ns = 0, cycles = 0, prev_ns = 0;
+		uint32_t n = 0, prev_n = 0;
+		for (j = i; j < result_count; j++) {
+			if (!strcmp(results[j].name, results[i].name) && results[j].bits == results[i].bits) {
+				ns += results[j].ns_per_op;
+				cycles += results[j].cycles_per_byte;
+				n++;
+				const bench_result_t* prev = find_result(previous, previous_count, &results[j]);
+				if (prev) {
+					prev_ns += prev->ns_per_op;
+					prev_n++;
+				}
+			}
+		}
+
+		printf("%-22s %8u %12.2f %12.3f", results[i].name, results[i].bits, ns / n, cycles / n);
+		if (prev_n) {
+			printf(" %12.2f %7.2fx", prev_ns / prev_n, (prev_ns / prev_n) / (ns / n));
+		}
+		printf("\n");
+	}
+#if !HAS_CYCLE_COUNTER
+	printf("no cycle counter available on this target, cycles/B is not measured\n");
+#endif
+}
+
+int main(int argc, char** argv) {
+	const char* output = "bench_bitops.csv";
+	const char* compare = NULL;
+	uint32_t scale = 1;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-q")) {
+			scale = 16;
+		} else if (!strcmp(argv[i], "-o") && (i + 1) < argc) {
+			output = argv[++i];
+		} else if (!strcmp(argv[i], "-c") && (i + 1) < argc) {
+			compare = argv[++i];
+		} else {
+			printf("usage: %s [-q] [-o baseline.csv] [-c previous.csv]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	bit_operations_init();
+
+	srand(1);
+	for (i = 0; i < MAX_BYTES; i++) {
+		src_buf[i] = (uint8_t) rand();
+	}
+
+	bench_function_t fn;
+	for (fn = 0; fn < BENCH_FUNCTIONS; fn++) {
+		uint32_t l;
+		for (l = 0; l < sizeof(bench_lengths) / sizeof(bench_lengths[0]); l++) {
+			uint32_t bits = bench_lengths[l];
+			if (bits > max_length(fn)) {
+				continue;
+			}
+			uint8_t src_offset, dst_offset;
+			for (src_offset = 0; src_offset < 8; src_offset++) {
+				for (dst_offset = 0; dst_offset < 8; dst_offset++) {
+					measure(fn, src_offset, dst_offset, bits, scale);
+					if (!uses_dst_offset(fn)) {
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	static bench_result_t previous[MAX_RESULTS];
+	uint32_t previous_count = 0;
+	if (compare) {
+		previous_count = read_baseline(compare, previous);
+	}
+
+	print_summary(previous, previous_count);
+
+	if (!write_baseline(output)) {
+		return 1;
+	}
+	printf("\nresults written to %s \n", output);
+
+	return 0;
+}
@@ -271,7 +271,7 @@ void remove_timer_entry(schc_fragmentation_t *conn) {
 	stop_timer(timer_id);
 	
 	if(conn->device) {
-		DEBUG_PRINTF("remove_timer_entry(): remove timer entry for device with id %d \n", conn->device->device_id);
+		DEBUG_PRINTF("remove_timer_entry(): remove timer entry for device with id %" PRIu64 " \n", conn->device->device_id);
 	}
 }
 
@@ -282,7 +282,7 @@ void remove_timer_entry(schc_fragmentation_t *conn) {
  * whether the network driver is busy or not
  *
  */
-uint8_t tx_send_callback(uint8_t* data, uint16_t length, uint32_t device_id) {
+uint8_t tx_send_callback(uint8_t* data, uint16_t length, uint64_t device_id) {
 	/* test cases for client */
 #if TEST_RECEIVER_ABORT
 	if(tx_conn->frag_cnt > 1) { 
@@ -303,20 +303,20 @@ uint8_t tx_send_callback(uint8_t* data, uint16_t length, uint32_t device_id) {
 #endif
 	}
 
-	DEBUG_PRINTF("tx_send_callback(): transmitting packet with length %d for device %d \n", length, device_id);
+	DEBUG_PRINTF("tx_send_callback(): transmitting packet with length %d for device %" PRIu64 " \n", length, device_id);
 
     int rc = socket_client_send(udp, data, length); /* send to udp server */
     return 1;
 }
 
-uint8_t rx_send_callback(uint8_t* data, uint16_t length, uint32_t device_id) {
-	DEBUG_PRINTF("rx_send_callback(): transmitting packet with length %d for device %d \n", length, device_id);
+uint8_t rx_send_callback(uint8_t* data, uint16_t length, uint64_t device_id) {
+	DEBUG_PRINTF("rx_send_callback(): transmitting packet with length %d for device %" PRIu64 " \n", length, device_id);
 	// received_packet(data, length, device_id);
 	return 1;
 }
 
 void free_callback(schc_fragmentation_t *conn) {
-	DEBUG_PRINTF("free_callback(): freeing connections for device %d\n", conn->device->device_id);
+	DEBUG_PRINTF("free_callback(): freeing connections for device %" PRIu64 "\n", conn->device->device_id);
 }
  
 static void socket_receive_callback(char* data, int len) {   
@@ -324,7 +324,7 @@ static void socket_receive_callback(char* data, int len) {
 	schc_fragmentation_t *conn = schc_input((uint8_t*) data, len, device);
 }
 
-static void set_connection_info(schc_fragmentation_t* conn, schc_bitarray_t* bit_arr, uint32_t device_id) {
+static void set_connection_info(schc_fragmentation_t* conn, schc_bitarray_t* bit_arr, uint64_t device_id) {
 	/* L2 connection information */
 	conn->tile_size					= 12; /* tile size for No-Ack and Ack-Always; for Ack-On-Error defined by the rule */
 	conn->dc 						= 1000; /* duty cycle in ms */
@@ -8,10 +8,14 @@
  * This is a basic example on how to compress 
  * and decompress a packet
  *
+ * usage: ./compress [trace.bin]
+ * 	the trace records of the run are written to trace.bin, print them with ./trace_decode
+ *
  */
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "../compressor.h"
 
@@ -53,7 +57,45 @@ uint8_t msg[] = {
 				/* Data */
 				0x01, 0x02, 0x03, 0x04 };
 
-int main() {
+#if USE_IP6_UDP == 1 && USE_COAP == 1
+/* a packet to the device port 0x3318, rule 4 sends the least bits for it
+ * the UDP rules compared with the equal or match-mapping operator branch on the ports,
+ * the most significant bits rule of rule 4 has to be found in these branches as well
+ */
+uint8_t msg_port[] = {
+				/* direction DOWN: from network gateway (AAAA::3) to device (AAAA::1) */
+				/* IPv6 header */
+				0x60, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x11, 0x40, 0xAA, 0xAA,
+				0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+				0x00, 0x00, 0x00, 0x03, 0xAA, 0xAA, 0x00, 0x00, 0x00, 0x00,
+				0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+				/* UDP header */
+				0x33, 0x18, 0x33, 0x16, 0x00, 0x1E, 0x27, 0x4B,
+				/* CoAP header */
+				0x54, 0x03, 0x23, 0xBB, 0x21, 0xFA, 0x01, 0xFB, 0xB5, 0x75,
+				0x73, 0x61, 0x67, 0x65, 0xD1, 0xEA, 0x1A, 0xFF,
+				/* Data */
+				0x01, 0x02, 0x03, 0x04 };
+
+/* a packet from the device (BBBB::200:0:0:6) to the application (AAAA::200:0:0:1),
+ * rule 7 derives both interface identifiers from the L2 identifiers of the device
+ */
+uint8_t msg_iid[] = {
+				/* IPv6 header */
+				0x60, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x11, 0x40, 0xBB, 0xBB,
+				0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+				0x00, 0x00, 0x00, 0x06, 0xAA, 0xAA, 0x00, 0x00, 0x00, 0x00,
+				0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+				/* UDP header */
+				0x33, 0x16, 0x33, 0x16, 0x00, 0x1E, 0x12, 0x39,
+				/* CoAP header */
+				0x54, 0x03, 0x23, 0xBB, 0x21, 0xFA, 0x01, 0xFB, 0xB5, 0x75,
+				0x73, 0x61, 0x67, 0x65, 0xD1, 0xEA, 0x1A, 0xFF,
+				/* Data */
+				0x01, 0x02, 0x03, 0x04 };
+#endif
+
+int main(int argc, char** argv) {
 	/* COMPRESSION */
 	/* initialize the client compressor */
 	if(!schc_compressor_init()) {
@@ -121,6 +163,32 @@ int main() {
 		printf("main(): compression succeeded\n");
 	}
 
+	/* compress the packet from segments, the frame should hold the same bytes */
+	uint8_t iov_buf[MAX_PACKET_LENGTH] = { 0 };
+	uint8_t frame_buf[MAX_PACKET_LENGTH] = { 0 };
+	schc_bitarray_t iov_bit_arr = SCHC_DEFAULT_BIT_ARRAY(MAX_PACKET_LENGTH, iov_buf);
+	schc_iovec_t iov[3] = {
+			{ msg, 30 },
+			{ msg + 30, sizeof(msg) - 34 },
+			{ msg + sizeof(msg) - 4, 4 } };
+	schc_frame_t frame;
+	if (schc_compress_iov(iov, 3, &iov_bit_arr, &frame, device_id, DIRECTION) != schc_rule) {
+		err = 1;
+	} else {
+		uint16_t frame_len = iov_bit_arr.len;
+		memcpy(frame_buf, iov_buf, iov_bit_arr.len);
+		for (int i = 0; i < frame.payload_count; i++) {
+			memcpy(frame_buf + frame_len, frame.payload[i].ptr, frame.payload[i].len);
+			frame_len += frame.payload[i].len;
+		}
+		if (frame_len != frame.len || frame_len != c_bit_arr.len || memcmp(frame_buf, c_bit_arr.ptr, frame_len)) {
+			printf("main(): an error occured while compressing the segments\n");
+			err = 1;
+		} else {
+			printf("main(): scatter-gather compression succeeded\n");
+		}
+	}
+
 	/* DECOMPRESSION */
 	uint8_t new_packet_len = 0;
 
@@ -155,5 +223,97 @@ int main() {
 		printf("main(): decompression succeeded\n");
 	}
 
+	/* decompress the header only, the packet is the header followed by the payload in place */
+	uint8_t headroom[SCHC_DECOMPRESS_HEADROOM + MAX_PACKET_LENGTH] = { 0 };
+	schc_iovec_t packet_iov[2];
+	uint16_t iov_packet_len = schc_decompress_iov(&c_bit_arr, headroom, sizeof(headroom), packet_iov, device_id,
+			c_bit_arr.len, DIRECTION);
+	if (iov_packet_len != new_packet_len || packet_iov[0].len + packet_iov[1].len != new_packet_len
+			|| memcmp(packet_iov[0].ptr, decomp_buf, packet_iov[0].len)
+			|| memcmp(packet_iov[1].ptr, decomp_buf + packet_iov[0].len, packet_iov[1].len)) {
+		printf("main(): an error occured while decompressing to segments\n");
+		err = 1;
+	} else {
+		printf("main(): zero-copy decompression succeeded, %d header bytes, %d payload bytes in place\n",
+				packet_iov[0].len, packet_iov[1].len);
+	}
+
+#if USE_IP6_UDP == 1
+	/* compress the packet, a packet of another flow from the same buffer and the packet again,
+	 * the packet should be compressed the same both times */
+	uint8_t flow_packet[sizeof(msg)];
+	uint8_t flow_buf[3][MAX_PACKET_LENGTH] = { { 0 } };
+	schc_bitarray_t flow_bit_arr[3];
+	memcpy(flow_packet, msg, sizeof(msg));
+	for (int i = 0; i < 3; i++) {
+		flow_packet[IP6_HLEN + 3] = (i == 1) ? 0x17 : 0x16; /* the second port, 0x3316 or 0x3317 */
+		flow_bit_arr[i] = (schc_bitarray_t) SCHC_DEFAULT_BIT_ARRAY(MAX_PACKET_LENGTH, flow_buf[i]);
+		schc_compress(flow_packet, sizeof(flow_packet), &flow_bit_arr[i], device_id, DIRECTION);
+	}
+	if (flow_bit_arr[2].len != c_bit_arr.len || memcmp(flow_buf[2], c_bit_arr.ptr, c_bit_arr.len)) {
+		printf("main(): an error occured while compressing the packet after a packet of another flow\n");
+		err = 1;
+	} else {
+		printf("main(): compression after a packet of another flow succeeded\n");
+	}
+#endif
+
+#if USE_IP6_UDP == 1 && USE_COAP == 1
+	/* compress and decompress the packet rule 4 sends the least bits for */
+	uint8_t port_buf[MAX_PACKET_LENGTH] = { 0 };
+	uint8_t port_packet[MAX_PACKET_LENGTH] = { 0 };
+	schc_bitarray_t port_bit_arr = SCHC_DEFAULT_BIT_ARRAY(MAX_PACKET_LENGTH, port_buf);
+	schc_rule = schc_compress(msg_port, sizeof(msg_port), &port_bit_arr, device_id, DOWN);
+	if (schc_rule == NULL || schc_rule->rule_id != 0x04) {
+		printf("main(): an error occured while compressing, the packet should be compressed with rule 4\n");
+		err = 1;
+	} else if (schc_decompress(&port_bit_arr, port_packet, device_id, port_bit_arr.len, DOWN) != sizeof(msg_port)
+			|| memcmp(port_packet, msg_port, sizeof(msg_port))) {
+		printf("main(): an error occured while decompressing the packet compressed with rule 4\n");
+		err = 1;
+	} else {
+		printf("main(): compression with rule 4 succeeded, %d bytes\n", port_bit_arr.len);
+	}
+#endif
+
+#if USE_IP6_UDP == 1 && USE_COAP == 1
+	/* compress and decompress the packet carrying the interface identifiers of the device with rule 7,
+	 * and the packet from BBBB::2 to AAAA::1, which rule 7 doesn't match and rule 1 does */
+	for (int i = 0; i < 2; i++) {
+		uint8_t iid_buf[MAX_PACKET_LENGTH] = { 0 };
+		uint8_t iid_packet[MAX_PACKET_LENGTH] = { 0 };
+		schc_bitarray_t iid_bit_arr = SCHC_DEFAULT_BIT_ARRAY(MAX_PACKET_LENGTH, iid_buf);
+		if (i) {
+			msg_iid[16] = 0x00; msg_iid[23] = 0x02; /* the device IID */
+			msg_iid[32] = 0x00; /* the application IID */
+			msg_iid[IP6_HLEN + 6] = 0x16; msg_iid[IP6_HLEN + 7] = 0x3D; /* the UDP checksum */
+		}
+		schc_rule = schc_compress(msg_iid, sizeof(msg_iid), &iid_bit_arr, device_id, UP);
+		if (schc_rule == NULL || schc_rule->rule_id != (i ? 0x01 : 0x07)) {
+			printf("main(): an error occured while compressing, the packet should be compressed with rule %d\n",
+					i ? 1 : 7);
+			err = 1;
+		} else if (schc_decompress(&iid_bit_arr, iid_packet, device_id, iid_bit_arr.len, UP) != sizeof(msg_iid)
+				|| memcmp(iid_packet, msg_iid, sizeof(msg_iid))) {
+			printf("main(): an error occured while decompressing the packet compressed with rule %d\n", i ? 1 : 7);
+			err = 1;
+		} else {
+			printf("main(): compression with rule %d succeeded, %d bytes\n", i ? 1 : 7, iid_bit_arr.len);
+		}
+	}
+#endif
+
+	/* write the binary trace records */
+	if (argc > 1) {
+		FILE* f = fopen(argv[1], "wb");
+		if (f == NULL) {
+			return 1;
+		}
+		schc_trace_record_t records[SCHC_TRACE_RECORDS];
+		uint32_t count = schc_trace_read(records, SCHC_TRACE_RECORDS);
+		fwrite(records, sizeof(records[0]), count, f);
+		fclose(f);
+	}
+
 	return err;
 }
@@ -250,7 +250,7 @@ void remove_timer_entry_callback(schc_fragmentation_t *conn) {
 	struct timer_node * timer_id = (struct timer_node *) conn->timer_ctx;
 	stop_timer(timer_id);
 	if(conn->device) {
-		DEBUG_PRINTF("remove_timer_entry_callback(): remove timer entry for device with id %d \n", conn->device->device_id);
+		DEBUG_PRINTF("remove_timer_entry_callback(): remove timer entry for device with id %" PRIu64 " \n", conn->device->device_id);
 	}
 }
 
@@ -261,22 +261,22 @@ void remove_timer_entry_callback(schc_fragmentation_t *conn) {
  * whether the network driver is busy or not
  *
  */
-uint8_t tx_send_callback(uint8_t* data, uint16_t length, uint32_t device_id) {
-	DEBUG_PRINTF("tx_send_callback(): transmitting packet with length %d to device %d \n", length, device_id);
+uint8_t tx_send_callback(uint8_t* data, uint16_t length, uint64_t device_id) {
+	DEBUG_PRINTF("tx_send_callback(): transmitting packet with length %d to device %" PRIu64 " \n", length, device_id);
 #if !TEST_LOST_ACK
 	socket_server_send(serv, data, length);
 #endif
 	return 1;
 }
 
-uint8_t rx_send_callback(uint8_t* data, uint16_t length, uint32_t device_id) {
-	DEBUG_PRINTF("rx_send_callback(): transmitting packet with length %d to device %d \n", length, device_id);
+uint8_t rx_send_callback(uint8_t* data, uint16_t length, uint64_t device_id) {
+	DEBUG_PRINTF("rx_send_callback(): transmitting packet with length %d to device %" PRIu64 " \n", length, device_id);
 	// received_packet(data, length, device_id, &tx_conn); // send packet to constrained device
 	return 1;
 }
 
 void free_connection_callback(schc_fragmentation_t *conn) {
-	DEBUG_PRINTF("free_connection_callback(): freeing connections for device %d\n", conn->device->device_id);
+	DEBUG_PRINTF("free_connection_callback(): freeing connections for device %" PRIu64 "\n", conn->device->device_id);
 }
 
 void socket_receive_callback(char * data, int len) {
@@ -0,0 +1,485 @@
+/*
+ * (c) 2018 - 2022  idlab - UGent - imec
+ *
+ * Bart Moons
+ *
+ * This file is part of the SCHC stack implementation
+ *
+ * This is a code generator for the compression rules
+ * It writes a match, compress and decompress function for every layer rule of the devices
+ * in rules/rule_config.h and direction, with the positions, lengths and target values
+ * of the fields as constants. Adjacent fields compared with the equal or MSB operator
+ * are compared at once, adjacent residues are copied at once.
+ * Set SCHC_GENERATED_RULES to 1 to use the generated code.
+ *
+ * usage: ./rulegen ../rules/rules_generated.h
+ * 	or make rules_generated
+ *
+ * the generator is built on the compressor, so the rules are walked with the same helpers
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define SCHC_RULEGEN			1
+#include "../compressor.c"
+
+#define RULEGEN_MAX_RULES		256
+#define RULEGEN_RUN_BYTES		64 /* the maximum number of bytes compared or copied at once */
+
+typedef enum {
+	RUN_NONE = 0,
+	RUN_EQUAL = 1,		/* header bits compared to constant bits */
+	RUN_SPAN = 2,		/* header bits recorded as residue */
+	RUN_HEADER = 3,		/* header bits written as residue */
+	RUN_CONST = 4,		/* constant bits written to the header */
+	RUN_RESIDUE = 5,	/* residue bits written to the header */
+	RUN_CLEAR = 6		/* header bits cleared, to be computed */
+} run_kind_t;
+
+/* adjacent fields handled at once */
+typedef struct rulegen_run_t {
+	run_kind_t kind;
+	int32_t pos;
+	uint32_t len;
+	/* the first field of the run, for the debug output */
+	uint16_t field;
+	uint8_t bits[RULEGEN_RUN_BYTES];
+} rulegen_run_t;
+
+/* a field of a layer rule in a direction */
+typedef struct rulegen_field_t {
+	const struct schc_field* field;
+	uint8_t index;
+	int32_t pos;
+} rulegen_field_t;
+
+static FILE* out;
+static uint16_t value_count;
+
+/*
+ * Get the fields of a layer rule in a direction
+ * the fields are walked as in match_layer_rule() when matching, as in compress() and decompress() otherwise
+ *
+ * @return the number of fields
+ *         -1 if the code can not be generated
+ */
+static int16_t rulegen_walk(const struct schc_layer_rule_t* rule, uint8_t max_layer_fields, direction DI,
+		uint8_t matching, rulegen_field_t fields[], uint32_t* length) {
+	uint8_t dir_length = (DI == UP) ? rule->up : rule->down;
+	int32_t pos = 0;
+	uint8_t j = 0, k = 0;
+
+	while (matching ? (j < dir_length) : (k < rule->length)) {
+		if (k >= rule->length) {
+			return -1;
+		}
+		const struct schc_field* field = &rule->content[k];
+		if ((field->dir == BI) || (field->dir == DI)) {
+			fields[j] = (rulegen_field_t) { .field = field, .index = k, .pos = pos + _addr_offset(field, DI) };
+			if (fields[j].pos < 0) {
+				return -1;
+			}
+			pos += field->field_length;
+			j++;
+		}
+		k++;
+		if (matching && k > max_layer_fields) {
+			return -1;
+		}
+	}
+	*length = pos;
+
+	return j;
+}
+
+/*
+ * Write the mismatch of a field
+ */
+static void rulegen_mismatch_of(uint16_t field, const char* indent) {
+	const char* name = (field < sizeof(schc_header_field_names) / sizeof(schc_header_field_names[0]))
+			? schc_header_field_names[field] : NULL;
+
+	fprintf(out, "%s\treturn rulegen_mismatch(%d); /* %s */\n%s}\n", indent, field,
+			(name != NULL) ? name : "CoAP option", indent);
+}
+
+static void rulegen_value(const rulegen_run_t* run) {
+	uint32_t i;
+
+	fprintf(out, "\tstatic const uint8_t value_%d[] = {", value_count);
+	for (i = 0; i < BITS_TO_BYTES(run->len); i++) {
+		fprintf(out, "%s0x%02X", (i % 12) ? ", " : (i ? ",\n\t\t\t" : " "), run->bits[i]);
+	}
+	fprintf(out, " };\n");
+}
+
+/*
+ * Write the code of a run
+ */
+static void rulegen_flush(rulegen_run_t* run) {
+	switch (run->kind) {
+	case RUN_EQUAL: {
+		if (run->len <= 64) {
+			fprintf(out, "\tif (get_bits64(src->ptr, start + %d, %d) != 0x%016" PRIX64 "ULL) {\n",
+					run->pos, run->len, get_bits64(run->bits, 0, run->len));
+		} else {
+			rulegen_value(run);
+			fprintf(out, "\tif (!compare_bit_sequence(value_%d, 0, src->ptr, start + %d, %d)) {\n",
+					value_count++, run->pos, run->len);
+		}
+		rulegen_mismatch_of(run->field, "\t");
+	} break;
+	case RUN_SPAN: {
+		fprintf(out, "\t\tmatch_record_span(record, (schc_residue_span_t) { start + %d, %d, 1 });\n",
+				run->pos, run->len);
+	} break;
+	case RUN_HEADER: {
+		fprintf(out, "\tschc_bitwriter_put_array(dst, src->ptr, start + %d, %d);\n", run->pos, run->len);
+	} break;
+	case RUN_CONST: {
+		rulegen_value(run);
+		fprintf(out, "\tcopy_bits(dst->ptr, start + %d, value_%d, 0, %d);\n", run->pos, value_count++, run->len);
+	} break;
+	case RUN_RESIDUE: {
+		fprintf(out, "\tschc_bitreader_get_array(src, dst->ptr, start + %d, %d);\n", run->pos, run->len);
+	} break;
+	case RUN_CLEAR: {
+		fprintf(out, "\tclear_bits(dst->ptr, start + %d, %d);\n", run->pos, run->len);
+	} break;
+	default:
+		break;
+	}
+	run->kind = RUN_NONE;
+}
+
+/*
+ * Add the bits of a field to a run, the run is written first if the field is not adjacent
+ *
+ * @param run			the run
+ * @param kind			the kind of run the field is part of
+ * @param pos			the position of the field in the header
+ * @param len			the number of bits
+ * @param field			the field id
+ * @param value			the constant bits, NULL if the run has no constant bits
+ * @param value_pos		the position of the constant bits in the value
+ */
+static void rulegen_add(rulegen_run_t* run, run_kind_t kind, int32_t pos, uint32_t len, uint16_t field,
+		const uint8_t* value, uint8_t value_pos) {
+	if (len == 0) {
+		return;
+	}
+	if (run->kind != kind || (run->pos + (int32_t) run->len) != pos
+			|| (run->len + len) > BYTES_TO_BITS(RULEGEN_RUN_BYTES)) {
+		rulegen_flush(run);
+		run->kind = kind;
+		run->pos = pos;
+		run->len = 0;
+		run->field = field;
+		memset(run->bits, 0, sizeof(run->bits));
+	}
+	if (value != NULL) {
+		copy_bits(run->bits, run->len, value, value_pos, len);
+	}
+	run->len += len;
+}
+
+/*
+ * Write the match function of a layer rule
+ *
+ * @return 1 if the function was written
+ *         0 if the rule is matched field by field
+ */
+static uint8_t rulegen_match(const struct schc_layer_rule_t* rule, uint8_t max_layer_fields, direction DI,
+		const char* name) {
+	rulegen_field_t fields[UINT8_MAX];
+	rulegen_run_t run = { .kind = RUN_NONE };
+	uint32_t length;
+	int32_t end = 0;
+	int16_t count = rulegen_walk(rule, max_layer_fields, DI, 1, fields, &length);
+	int16_t i;
+
+	if (count < 0) {
+		return 0;
+	}
+	for (i = 0; i < count; i++) {
+		if (fields[i].pos + fields[i].field->field_length > end) {
+			end = fields[i].pos + fields[i].field->field_length;
+		}
+	}
+
+	fprintf(out, "static int8_t %s(const struct schc_layer_rule_t* rule, schc_bitarray_t* src,\n"
+			"\t\tschc_match_record_t* record, const schc_iid_t* iid) {\n"
+			"\tuint32_t start = src->offset;\n\n", name);
+	/* the fields must be present in the header */
+	fprintf(out, "\tif ((start + %d) > BYTES_TO_BITS(src->len)) {\n\t\treturn 0;\n\t}\n", end);
+
+	value_count = 0;
+	for (i = 0; i < count; i++) {
+		const struct schc_field* field = fields[i].field;
+		int32_t pos = fields[i].pos;
+		if (field->MO == &mo_equal) {
+			rulegen_add(&run, RUN_EQUAL, pos, field->field_length, field->field, field->target_value,
+					get_position_in_first_byte(field->field_length));
+		} else if (field->MO == &mo_MSB) {
+			rulegen_add(&run, RUN_EQUAL, pos, field->MO_param_length, field->field, field->target_value, 0);
+		} else if (field->MO != &mo_ignore) {
+			/* other matching operators are called through the rule */
+			char mo[32] = "mo_matchmap";
+			if (field->MO != &mo_matchmap) {
+				snprintf(mo, sizeof(mo), "rule->content[%d].MO", fields[i].index);
+			}
+			rulegen_flush(&run);
+			fprintf(out, "\tif (!%s((struct schc_field*) &rule->content[%d],\n"
+					"\t\t\tsrc->ptr + ((start + %d) / 8), (start + %d) %% 8)) {\n", mo, fields[i].index, pos, pos);
+			rulegen_mismatch_of(field->field, "\t");
+		}
+		if (field->action == DEVIID || field->action == APPIID) {
+			/* the field is elided, so it must equal the value derived from the L2 identifier */
+			rulegen_flush(&run);
+			fprintf(out, "\t{\n\t\tuint8_t value_pos;\n"
+					"\t\tconst uint8_t* value = iid_field(&rule->content[%d], iid, &value_pos);\n"
+					"\t\tif (value == NULL || get_bits64(src->ptr, start + %d, %d) != get_bits64(value, value_pos, %d)) {\n",
+					fields[i].index, pos, field->field_length, field->field_length);
+			rulegen_mismatch_of(field->field, "\t\t");
+			fprintf(out, "\t}\n");
+		}
+	}
+	rulegen_flush(&run);
+
+	/* the residue of the rule, for compress_record() */
+	fprintf(out, "\tif (record != NULL) {\n");
+	for (i = 0; i < count; i++) {
+		const struct schc_field* field = fields[i].field;
+		int32_t pos = fields[i].pos;
+		switch (field->action) {
+		case VALUESENT:
+			rulegen_add(&run, RUN_SPAN, pos, field->field_length, field->field, NULL, 0);
+			break;
+		case LSB:
+			rulegen_add(&run, RUN_SPAN, pos + field->MO_param_length,
+					field->field_length - field->MO_param_length, field->field, NULL, 0);
+			break;
+		case MAPPINGSENT:
+			rulegen_flush(&run);
+			fprintf(out, "\t\tmatch_record_add(record, src, &rule->content[%d], start + %d);\n", fields[i].index, pos);
+			break;
+		default:
+			break;
+		}
+	}
+	rulegen_flush(&run);
+	fprintf(out, "\t}\n\tsrc->offset = start + %d;\n\n\treturn 1;\n}\n\n", length);
+
+	return 1;
+}
+
+/*
+ * Write the compress function of a layer rule
+ */
+static uint8_t rulegen_compress(const struct schc_layer_rule_t* rule, uint8_t max_layer_fields, direction DI,
+		const char* name) {
+	rulegen_field_t fields[UINT8_MAX];
+	rulegen_run_t run = { .kind = RUN_NONE };
+	uint32_t length;
+	int16_t count = rulegen_walk(rule, max_layer_fields, DI, 0, fields, &length);
+	int16_t i;
+
+	if (count < 0) {
+		return 0;
+	}
+
+	fprintf(out, "static void %s(const struct schc_layer_rule_t* rule, schc_bitwriter_t* dst,\n"
+			"\t\tschc_bitarray_t* src) {\n"
+			"\tuint32_t start = src->offset;\n\n", name);
+	for (i = 0; i < count; i++) {
+		const struct schc_field* field = fields[i].field;
+		int32_t pos = fields[i].pos;
+		switch (field->action) {
+		case VALUESENT:
+			rulegen_add(&run, RUN_HEADER, pos, field->field_length, field->field, NULL, 0);
+			break;
+		case LSB:
+			rulegen_add(&run, RUN_HEADER, pos + field->MO_param_length,
+					field->field_length - field->MO_param_length, field->field, NULL, 0);
+			break;
+		case MAPPINGSENT:
+			rulegen_flush(&run);
+			fprintf(out, "\t{\n\t\tint16_t index = get_mapping_index(&rule->content[%d], src->ptr + ((start + %d) / 8), (start + %d) %% 8);\n"
+					"\t\tif (index >= 0) {\n\t\t\tschc_bitwriter_put(dst, index, %d);\n\t\t}\n\t}\n",
+					fields[i].index, pos, pos, get_required_number_of_bits((field->MO_param_length - 1)));
+			break;
+		default:
+			break;
+		}
+	}
+	rulegen_flush(&run);
+	fprintf(out, "\tsrc->offset = start + %d;\n}\n\n", length);
+
+	return 1;
+}
+
+/*
+ * Write the decompress function of a layer rule
+ */
+static uint8_t rulegen_decompress(const struct schc_layer_rule_t* rule, uint8_t max_layer_fields, direction DI,
+		const char* name) {
+	rulegen_field_t fields[UINT8_MAX];
+	rulegen_run_t run = { .kind = RUN_NONE };
+	uint32_t length;
+	int16_t count = rulegen_walk(rule, max_layer_fields, DI, 0, fields, &length);
+	int16_t i;
+
+	if (count < 0) {
+		return 0;
+	}
+
+	fprintf(out, "static void %s(const struct schc_layer_rule_t* rule, schc_bitreader_t* src,\n"
+			"\t\tschc_bitarray_t* dst, const schc_iid_t* iid) {\n"
+			"\tuint32_t start = dst->offset;\n\n", name);
+	value_count = 0;
+	for (i = 0; i < count; i++) {
+		const struct schc_field* field = fields[i].field;
+		int32_t pos = fields[i].pos;
+		switch (field->action) {
+		case NOTSENT:
+			rulegen_add(&run, RUN_CONST, pos, field->field_length, field->field, field->target_value,
+					get_position_in_first_byte(field->field_length));
+			break;
+		case VALUESENT:
+			rulegen_add(&run, RUN_RESIDUE, pos, field->field_length, field->field, NULL, 0);
+			break;
+		case MAPPINGSENT: {
+			/* byte aligned entries are indexed per entry, other entries per byte */
+			uint8_t stride = (field->field_length % 8) ? 1 : get_number_of_bytes_from_bits(field->field_length);
+			char index[32] = "index";
+			if (stride != 1) {
+				snprintf(index, sizeof(index), "(uint8_t) (index * %d)", stride);
+			}
+			rulegen_flush(&run);
+			fprintf(out, "\t{\n\t\tuint8_t index = (uint8_t) schc_bitreader_get(src, %d);\n"
+					"\t\tcopy_bits(dst->ptr, start + %d, rule->content[%d].target_value + %s, %d, %d);\n\t}\n",
+					get_required_number_of_bits((field->MO_param_length - 1)), pos, fields[i].index,
+					index, (8 - (field->field_length % 8)) % 8, field->field_length);
+		} break;
+		case LSB:
+			rulegen_add(&run, RUN_CONST, pos, field->MO_param_length, field->field, field->target_value, 0);
+			rulegen_add(&run, RUN_RESIDUE, pos + field->MO_param_length,
+					field->field_length - field->MO_param_length, field->field, NULL, 0);
+			break;
+		case COMPLENGTH:
+		case COMPCHK:
+			rulegen_add(&run, RUN_CLEAR, pos, field->field_length, field->field, NULL, 0);
+			break;
+		case DEVIID:
+		case APPIID:
+			rulegen_flush(&run);
+			fprintf(out, "\t{\n\t\tuint8_t value_pos;\n"
+					"\t\tconst uint8_t* value = iid_field(&rule->content[%d], iid, &value_pos);\n"
+					"\t\tif (value != NULL) {\n\t\t\tcopy_bits(dst->ptr, start + %d, value, value_pos, %d);\n"
+					"\t\t} else {\n\t\t\tclear_bits(dst->ptr, start + %d, %d);\n\t\t}\n\t}\n",
+					fields[i].index, pos, field->field_length, pos, field->field_length);
+			break;
+		}
+	}
+	rulegen_flush(&run);
+	fprintf(out, "\tdst->offset = start + %d;\n}\n\n", length);
+
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	uint64_t digests[RULEGEN_MAX_RULES];
+	uint8_t generated[RULEGEN_MAX_RULES][3][2]; /* match, compress, decompress per direction */
+	uint16_t count = 0;
+	struct schc_device* device;
+	uint32_t i = 0;
+	uint16_t j, k;
+
+	if (argc < 2) {
+		printf("usage: %s rules_generated.h\n", argv[0]);
+		return 1;
+	}
+	out = fopen(argv[1], "w");
+	if (out == NULL) {
+		printf("main(): could not open %s\n", argv[1]);
+		return 1;
+	}
+
+	fprintf(out, "/*\n * Generated by examples/rulegen.c from the rules in rules/rule_config.h, do not edit\n"
+			" * run make rules_generated in examples again when the rules change\n *\n */\n\n");
+
+	while ((device = get_device_by_index(i++)) != NULL) {
+		for (j = 0; j < device->compression_rule_count; j++) {
+			const struct schc_compression_rule_t* compression_rule = (*device->compression_context)[j];
+			schc_layer_t layer;
+			for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+				const struct schc_layer_rule_t* rule = get_layer_rule(compression_rule, layer);
+				if (rule == NULL) {
+					continue;
+				}
+				/* rules with the same digest share their code */
+				uint8_t max_layer_fields = get_layer_field_count(layer);
+				uint64_t digest = rulegen_digest(rule, max_layer_fields);
+				k = 0;
+				while (k < count && digests[k] != digest) {
+					k++;
+				}
+				if (k < count) {
+					continue;
+				}
+				if (count >= RULEGEN_MAX_RULES) {
+					printf("main(): more than %d layer rules, the remaining rules are walked field by field\n",
+							RULEGEN_MAX_RULES);
+					break;
+				}
+				digests[count] = digest;
+
+				fprintf(out, "/* device 0x%" PRIX64 ", rule %" PRIu32 ", %s layer */\n", (uint64_t) device->device_id,
+						compression_rule->rule_id, (layer == SCHC_IPV6) ? "IPv6" : (layer == SCHC_UDP) ? "UDP" : "CoAP");
+				direction DI;
+				for (DI = UP; DI <= DOWN; DI++) {
+					char name[64];
+					const char* dir_name = (DI == UP) ? "up" : "down";
+					snprintf(name, sizeof(name), "rulegen_%d_match_%s", count, dir_name);
+					generated[count][0][DI] = rulegen_match(rule, max_layer_fields, DI, name);
+					snprintf(name, sizeof(name), "rulegen_%d_compress_%s", count, dir_name);
+					generated[count][1][DI] = rulegen_compress(rule, max_layer_fields, DI, name);
+					snprintf(name, sizeof(name), "rulegen_%d_decompress_%s", count, dir_name);
+					generated[count][2][DI] = rulegen_decompress(rule, max_layer_fields, DI, name);
+				}
+				count++;
+			}
+		}
+	}
+
+	fprintf(out, "#define RULEGEN_ENTRY_COUNT\t\t%d\n\n", count);
+	fprintf(out, "static const rulegen_entry_t rulegen_entries[%d] = {\n", count ? count : 1);
+	for (k = 0; k < count; k++) {
+		const char* kinds[3] = { "match", "compress", "decompress" };
+		uint8_t kind;
+		fprintf(out, "\t{ 0x%016" PRIX64 "ULL", digests[k]);
+		for (kind = 0; kind < 3; kind++) {
+			fprintf(out, ",\n\t\t{ ");
+			direction DI;
+			for (DI = UP; DI <= DOWN; DI++) {
+				if (generated[k][kind][DI]) {
+					fprintf(out, "rulegen_%d_%s_%s", k, kinds[kind], (DI == UP) ? "up" : "down");
+				} else {
+					fprintf(out, "NULL");
+				}
+				fprintf(out, (DI == UP) ? ", " : " }");
+			}
+		}
+		fprintf(out, " },\n");
+	}
+	fprintf(out, "};\n");
+	fclose(out);
+
+	printf("main(): %d layer rules written to %s\n", count, argv[1]);
+
+	return 0;
+}
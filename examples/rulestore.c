@@ -0,0 +1,945 @@
+/*
+ * (c) 2018 - 2022  idlab - UGent - imec
+ *
+ * Bart Moons
+ *
+ * This file is part of the SCHC stack implementation
+ *
+ * This is a writer for the binary rule store
+ * It writes the devices in rules/rule_config.h, or the devices of a device list
+ * with the rules of YANG-JSON files (RFC 9363), to a store the library loads
+ * with schc_store_open() when SCHC_RULE_STORE is set to 1.
+ *
+ * usage: ./rulestore rules.bin
+ * 	writes the devices in rules/rule_config.h, devices with the same rules share a context
+ *        ./rulestore -j context0.json [-j context1.json ...] -d devices.txt rules.bin
+ * 	every JSON file holds the rules of a context, every line of the device list holds
+ * 	device_id context [dev_l2_id [app_l2_id]], e.g. 0x0000000000000006 0
+ *
+ * the JSON files hold an ietf-schc:schc object with a rule list, the compression entries
+ * are mapped on the fields of this library, the CoAP payload marker is fid-coap-payload-marker
+ * the rule without compression sets the uncompressed rule id of the context
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "../schc.h"
+#include "../jsmn.h"
+#include "../bit_operations.h"
+
+typedef struct store_field_t {
+	uint16_t field;
+	uint8_t mo_param;
+	uint8_t length;
+	uint8_t pos;
+	uint8_t dir;
+	uint8_t mo;
+	uint8_t action;
+	uint8_t value[MAX_FIELD_LENGTH];
+} store_field_t;
+
+typedef struct store_layer_rule_t {
+	uint8_t layer;
+	uint8_t up;
+	uint8_t down;
+	uint8_t length;
+	uint32_t first;
+	const void* src;
+} store_layer_rule_t;
+
+typedef struct store_compression_rule_t {
+	uint32_t rule_id;
+	uint32_t layer[3];
+	const void* src;
+} store_compression_rule_t;
+
+typedef struct store_fragmentation_rule_t {
+	struct schc_fragmentation_rule_t rule;
+	const void* src;
+} store_fragmentation_rule_t;
+
+typedef struct store_profile_t {
+	struct schc_profile_t profile;
+	const void* src;
+} store_profile_t;
+
+typedef struct store_context_t {
+	uint32_t uncomp_rule_id;
+	uint32_t first;
+	uint16_t profile;
+	uint8_t compression_count;
+	uint8_t fragmentation_count;
+	/* the device the context was built from */
+	const struct schc_device* src;
+} store_context_t;
+
+typedef struct store_device_t {
+	uint64_t device_id;
+	uint64_t dev_l2_id;
+	uint64_t app_l2_id;
+	uint32_t context;
+} store_device_t;
+
+/* a growing array */
+typedef struct store_list_t {
+	void* ptr;
+	uint32_t count;
+	uint32_t size;
+	uint32_t max;
+} store_list_t;
+
+#define LIST(_type)			{ NULL, 0, sizeof(_type), 0 }
+#define AT(_list, _type, _i)	(&((_type*) (_list).ptr)[_i])
+
+static store_list_t fields = LIST(store_field_t);
+static store_list_t layer_rules = LIST(store_layer_rule_t);
+static store_list_t compression_rules = LIST(store_compression_rule_t);
+static store_list_t fragmentation_rules = LIST(store_fragmentation_rule_t);
+static store_list_t profiles = LIST(store_profile_t);
+static store_list_t contexts = LIST(store_context_t);
+static store_list_t refs = LIST(uint32_t);
+static store_list_t store_devices = LIST(store_device_t);
+
+static uint32_t list_add(store_list_t* list) {
+	if (list->count == list->max) {
+		list->max = list->max ? 2 * list->max : 64;
+		list->ptr = realloc(list->ptr, (size_t) list->max * list->size);
+		if (list->ptr == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	memset((uint8_t*) list->ptr + (size_t) list->count * list->size, 0, list->size);
+
+	return list->count++;
+}
+
+/*
+ * Add a record, the records of the list can move
+ */
+static void* list_push(store_list_t* list) {
+	uint32_t index = list_add(list);
+
+	return (uint8_t*) list->ptr + (size_t) index * list->size;
+}
+
+static void add_ref(uint32_t index) {
+	*((uint32_t*) list_push(&refs)) = index;
+}
+
+static schc_layer_t field_layer(uint16_t field) {
+	if (field >= IP6_V && field <= IP6_APPIID) {
+		return SCHC_IPV6;
+	}
+	if (field >= UDP_DEV && field <= UDP_CHK) {
+		return SCHC_UDP;
+	}
+
+	return SCHC_COAP;
+}
+
+/*
+ * Add the layer rules of a compression rule, with up and down counted from the directions of the fields
+ */
+static uint32_t add_layer_rule(schc_layer_t layer, uint32_t first, uint8_t length, const void* src) {
+	uint32_t index = list_add(&layer_rules);
+	store_layer_rule_t* rule = AT(layer_rules, store_layer_rule_t, index);
+	uint8_t i;
+
+	rule->layer = layer;
+	rule->first = first;
+	rule->length = length;
+	rule->src = src;
+	for (i = 0; i < length; i++) {
+		uint8_t dir = AT(fields, store_field_t, first + i)->dir;
+		rule->up += (dir != DOWN);
+		rule->down += (dir != UP);
+	}
+
+	return index;
+}
+
+static void write_u16(uint8_t* ptr, uint16_t value) {
+	ptr[0] = (uint8_t) value;
+	ptr[1] = (uint8_t) (value >> 8);
+}
+
+static void write_u32(uint8_t* ptr, uint32_t value) {
+	write_u16(ptr, (uint16_t) value);
+	write_u16(ptr + 2, (uint16_t) (value >> 16));
+}
+
+static void write_u64(uint8_t* ptr, uint64_t value) {
+	write_u32(ptr, (uint32_t) value);
+	write_u32(ptr + 4, (uint32_t) (value >> 32));
+}
+
+/*
+ * The rules in rules/rule_config.h
+ */
+static uint32_t header_find(const store_list_t* list, size_t src_offset, const void* src) {
+	uint32_t i;
+
+	for (i = 0; i < list->count; i++) {
+		const uint8_t* record = (const uint8_t*) list->ptr + (size_t) i * list->size;
+		if (*(const void* const*) (record + src_offset) == src) {
+			return i;
+		}
+	}
+
+	return UINT32_MAX;
+}
+
+static uint32_t header_layer_rule(const struct schc_layer_rule_t* rule, schc_layer_t layer) {
+	uint8_t i;
+
+	if (rule == NULL) {
+		return SCHC_STORE_NO_RULE;
+	}
+	uint32_t index = header_find(&layer_rules, offsetof(store_layer_rule_t, src), rule);
+	if (index != UINT32_MAX) {
+		return index;
+	}
+
+	uint32_t first = fields.count;
+	for (i = 0; i < rule->length; i++) {
+		const struct schc_field* src = &rule->content[i];
+		store_field_t* field = list_push(&fields);
+		field->field = src->field;
+		field->mo_param = src->MO_param_length;
+		field->length = src->field_length;
+		field->pos = src->field_pos;
+		field->dir = src->dir;
+		field->action = src->action;
+		memcpy(field->value, src->target_value, MAX_FIELD_LENGTH);
+		if (src->MO == &mo_equal) {
+			field->mo = SCHC_STORE_MO_EQUAL;
+		} else if (src->MO == &mo_ignore) {
+			field->mo = SCHC_STORE_MO_IGNORE;
+		} else if (src->MO == &mo_MSB) {
+			field->mo = SCHC_STORE_MO_MSB;
+		} else if (src->MO == &mo_matchmap) {
+			field->mo = SCHC_STORE_MO_MATCHMAP;
+		} else {
+			fprintf(stderr, "field %d uses a matching operator the store does not hold\n", src->field);
+			exit(1);
+		}
+	}
+	index = add_layer_rule(layer, first, rule->length, rule);
+	/* keep the counts of the rule */
+	AT(layer_rules, store_layer_rule_t, index)->up = rule->up;
+	AT(layer_rules, store_layer_rule_t, index)->down = rule->down;
+
+	return index;
+}
+
+static uint32_t header_compression_rule(const struct schc_compression_rule_t* rule) {
+	uint32_t index = header_find(&compression_rules, offsetof(store_compression_rule_t, src), rule);
+	if (index != UINT32_MAX) {
+		return index;
+	}
+
+	uint32_t layer[3] = { SCHC_STORE_NO_RULE, SCHC_STORE_NO_RULE, SCHC_STORE_NO_RULE };
+#if USE_IP6 == 1
+	layer[SCHC_IPV6] = header_layer_rule((const struct schc_layer_rule_t*) rule->ipv6_rule, SCHC_IPV6);
+#endif
+#if USE_UDP == 1
+	layer[SCHC_UDP] = header_layer_rule((const struct schc_layer_rule_t*) rule->udp_rule, SCHC_UDP);
+#endif
+#if USE_COAP == 1
+	layer[SCHC_COAP] = header_layer_rule((const struct schc_layer_rule_t*) rule->coap_rule, SCHC_COAP);
+#endif
+	index = list_add(&compression_rules);
+	store_compression_rule_t* dst = AT(compression_rules, store_compression_rule_t, index);
+	dst->rule_id = rule->rule_id;
+	memcpy(dst->layer, layer, sizeof(layer));
+	dst->src = rule;
+
+	return index;
+}
+
+static uint32_t header_fragmentation_rule(const struct schc_fragmentation_rule_t* rule) {
+	uint32_t index = header_find(&fragmentation_rules, offsetof(store_fragmentation_rule_t, src), rule);
+	if (index == UINT32_MAX) {
+		index = list_add(&fragmentation_rules);
+		AT(fragmentation_rules, store_fragmentation_rule_t, index)->rule = *rule;
+		AT(fragmentation_rules, store_fragmentation_rule_t, index)->src = rule;
+	}
+
+	return index;
+}
+
+static uint32_t header_profile(const struct schc_profile_t* profile) {
+	uint32_t index = header_find(&profiles, offsetof(store_profile_t, src), profile);
+	if (index == UINT32_MAX) {
+		index = list_add(&profiles);
+		AT(profiles, store_profile_t, index)->profile = *profile;
+		AT(profiles, store_profile_t, index)->src = profile;
+	}
+
+	return index;
+}
+
+/*
+ * Add the devices of the device list, a context is added for every distinct set of rules
+ */
+static void header_read(void) {
+	struct schc_device* device;
+	uint32_t i = 0, j;
+	uint8_t k;
+
+	while ((device = get_device_by_index(i++)) != NULL) {
+		for (j = 0; j < contexts.count; j++) {
+			const struct schc_device* src = AT(contexts, store_context_t, j)->src;
+			if (src->compression_context == device->compression_context
+					&& src->compression_rule_count == device->compression_rule_count
+					&& src->fragmentation_context == device->fragmentation_context
+					&& src->fragmentation_rule_count == device->fragmentation_rule_count
+					&& src->profile == device->profile && src->uncomp_rule_id == device->uncomp_rule_id) {
+				break;
+			}
+		}
+		if (j == contexts.count) {
+			uint16_t profile = header_profile(device->profile);
+			uint32_t first = refs.count;
+			for (k = 0; k < device->compression_rule_count; k++) {
+				add_ref(header_compression_rule((*device->compression_context)[k]));
+			}
+			for (k = 0; k < device->fragmentation_rule_count; k++) {
+				add_ref(header_fragmentation_rule((*device->fragmentation_context)[k]));
+			}
+			store_context_t* context = list_push(&contexts);
+			context->uncomp_rule_id = device->uncomp_rule_id;
+			context->first = first;
+			context->profile = profile;
+			context->compression_count = device->compression_rule_count;
+			context->fragmentation_count = device->fragmentation_rule_count;
+			context->src = device;
+		}
+		store_device_t* dst = list_push(&store_devices);
+		dst->device_id = device->device_id;
+		dst->dev_l2_id = device->dev_l2_id;
+		dst->app_l2_id = device->app_l2_id;
+		dst->context = j;
+	}
+}
+
+/*
+ * The rules in YANG-JSON
+ */
+typedef struct json_t {
+	const char* js;
+	jsmntok_t* tokens;
+	int count;
+	const char* path;
+} json_t;
+
+static const struct {
+	const char* name;
+	uint16_t field;
+} json_fields[] = {
+		{ "fid-ipv6-version", IP6_V }, { "fid-ipv6-trafficclass", IP6_TC }, { "fid-ipv6-flowlabel", IP6_FL },
+		{ "fid-ipv6-payload-length", IP6_LEN }, { "fid-ipv6-nextheader", IP6_NH }, { "fid-ipv6-hoplimit", IP6_HL },
+		{ "fid-ipv6-devprefix", IP6_DEVPRE }, { "fid-ipv6-deviid", IP6_DEVIID },
+		{ "fid-ipv6-appprefix", IP6_APPPRE }, { "fid-ipv6-appiid", IP6_APPIID },
+		{ "fid-udp-dev-port", UDP_DEV }, { "fid-udp-app-port", UDP_APP },
+		{ "fid-udp-length", UDP_LEN }, { "fid-udp-checksum", UDP_CHK },
+		{ "fid-coap-version", COAP_V }, { "fid-coap-type", COAP_T }, { "fid-coap-tkl", COAP_TKL },
+		{ "fid-coap-code", COAP_C }, { "fid-coap-mid", COAP_MID }, { "fid-coap-token", COAP_TKN },
+		{ "fid-coap-option-if-match", COAP_IFMATCH }, { "fid-coap-option-uri-host", COAP_URIHOST },
+		{ "fid-coap-option-etag", COAP_ETAG }, { "fid-coap-option-if-none-match", COAP_IFNOMATCH },
+		{ "fid-coap-option-uri-port", COAP_URIPORT }, { "fid-coap-option-location-path", COAP_LOCPATH },
+		{ "fid-coap-option-uri-path", COAP_URIPATH }, { "fid-coap-option-content-format", COAP_CONTENTF },
+		{ "fid-coap-option-max-age", COAP_MAXAGE }, { "fid-coap-option-uri-query", COAP_URIQUERY },
+		{ "fid-coap-option-accept", COAP_ACCEPT }, { "fid-coap-option-location-query", COAP_LOCQUERY },
+		{ "fid-coap-option-proxy-uri", COAP_PROXYURI }, { "fid-coap-option-proxy-scheme", COAP_PROXYSCH },
+		{ "fid-coap-option-size1", COAP_SIZE1 }, { "fid-coap-option-no-response", COAP_NORESP },
+		{ "fid-coap-payload-marker", COAP_PAYLOAD } };
+
+static void json_error(const json_t* json, int token, const char* msg) {
+	fprintf(stderr, "%s: %s at offset %d\n", json->path, msg, json->tokens[token].start);
+	exit(1);
+}
+
+/*
+ * Get the index of the token after a token and its children
+ */
+static int json_skip(const json_t* json, int token) {
+	int children = json->tokens[token].size;
+
+	token++;
+	while (children-- > 0) {
+		token = json_skip(json, token);
+	}
+
+	return token;
+}
+
+/*
+ * Compare a string token, identities are compared without their module prefix
+ */
+static int json_is(const json_t* json, int token, const char* str) {
+	const char* start = json->js + json->tokens[token].start;
+	int len = json->tokens[token].end - json->tokens[token].start;
+	const char* colon = memchr(start, ':', len);
+
+	if (colon != NULL) {
+		len -= (int) (colon + 1 - start);
+		start = colon + 1;
+	}
+
+	return (len == (int) strlen(str) && !strncmp(start, str, len));
+}
+
+/*
+ * Get the value of a member of an object
+ *
+ * @return the token of the value, -1 if the object has no such member
+ */
+static int json_member(const json_t* json, int object, const char* key) {
+	int i, token = object + 1;
+
+	if (json->tokens[object].type != JSMN_OBJECT) {
+		return -1;
+	}
+	for (i = 0; i < json->tokens[object].size; i++) {
+		if (json_is(json, token, key)) {
+			return token + 1;
+		}
+		token = json_skip(json, token + 1);
+	}
+
+	return -1;
+}
+
+static uint64_t json_number(const json_t* json, int token) {
+	char buf[32] = { 0 };
+	int len = json->tokens[token].end - json->tokens[token].start;
+	char* end;
+
+	if (len <= 0 || len >= (int) sizeof(buf)) {
+		json_error(json, token, "number expected");
+	}
+	/* YANG encodes 64-bit numbers as strings */
+	memcpy(buf, json->js + json->tokens[token].start, len);
+	uint64_t value = strtoull(buf, &end, 0);
+	if (*end != '\0') {
+		json_error(json, token, "number expected");
+	}
+
+	return value;
+}
+
+static uint64_t json_member_number(const json_t* json, int object, const char* key, uint64_t value) {
+	int token = json_member(json, object, key);
+
+	return (token < 0) ? value : json_number(json, token);
+}
+
+/*
+ * Decode a base64 binary value
+ *
+ * @return the number of bytes
+ */
+static uint32_t json_binary(const json_t* json, int token, uint8_t* out, uint32_t max) {
+	uint32_t bits = 0, len = 0;
+	int i;
+	uint32_t acc = 0;
+
+	for (i = json->tokens[token].start; i < json->tokens[token].end; i++) {
+		char c = json->js[i];
+		int v;
+		if (c >= 'A' && c <= 'Z') {
+			v = c - 'A';
+		} else if (c >= 'a' && c <= 'z') {
+			v = c - 'a' + 26;
+		} else if (c >= '0' && c <= '9') {
+			v = c - '0' + 52;
+		} else if (c == '+') {
+			v = 62;
+		} else if (c == '/') {
+			v = 63;
+		} else if (c == '=') {
+			break;
+		} else {
+			json_error(json, token, "base64 value expected");
+		}
+		acc = (acc << 6) | (uint32_t) v;
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			if (len == max) {
+				json_error(json, token, "value exceeds MAX_FIELD_LENGTH");
+			}
+			out[len++] = (uint8_t) (acc >> bits);
+		}
+	}
+
+	return len;
+}
+
+/*
+ * Copy the values of an index/value list, each right aligned in bytes bytes at index * bytes
+ *
+ * @return the number of values
+ */
+static uint8_t json_values(const json_t* json, int list, uint8_t* out, uint8_t bytes) {
+	uint8_t value[MAX_FIELD_LENGTH];
+	int i, item = list + 1;
+
+	for (i = 0; i < json->tokens[list].size; i++, item = json_skip(json, item)) {
+		int token = json_member(json, item, "value");
+		uint64_t index = json_member_number(json, item, "index", i);
+		if (token < 0) {
+			json_error(json, item, "value expected");
+		}
+		uint32_t len = json_binary(json, token, value, sizeof(value));
+		if (len > bytes || (index + 1) * bytes > MAX_FIELD_LENGTH) {
+			json_error(json, token, "value exceeds the field or MAX_FIELD_LENGTH");
+		}
+		memcpy(out + index * bytes + (bytes - len), value, len);
+	}
+
+	return (uint8_t) json->tokens[list].size;
+}
+
+static uint8_t json_identity(const json_t* json, int object, const char* key, const char* const names[],
+		uint8_t count) {
+	int token = json_member(json, object, key);
+	uint8_t i;
+
+	if (token < 0) {
+		json_error(json, object, key);
+	}
+	for (i = 0; i < count; i++) {
+		if (names[i] != NULL && json_is(json, token, names[i])) {
+			return i;
+		}
+	}
+	json_error(json, token, "identity not supported");
+
+	return 0;
+}
+
+static const char* const json_directions[] = {
+		[UP] = "di-up", [DOWN] = "di-down", [BI] = "di-bidirectional" };
+static const char* const json_mos[] = {
+		[SCHC_STORE_MO_EQUAL] = "mo-equal", [SCHC_STORE_MO_IGNORE] = "mo-ignore",
+		[SCHC_STORE_MO_MSB] = "mo-msb", [SCHC_STORE_MO_MATCHMAP] = "mo-match-mapping" };
+static const char* const json_cdas[] = {
+		[NOTSENT] = "cda-not-sent", [VALUESENT] = "cda-value-sent", [MAPPINGSENT] = "cda-mapping-sent",
+		[LSB] = "cda-lsb", [COMPLENGTH] = "cda-compute-length", [COMPCHK] = "cda-compute-checksum",
+		[DEVIID] = "cda-deviid", [APPIID] = "cda-appiid" };
+static const char* const json_modes[] = {
+		[ACK_ALWAYS] = "fragmentation-mode-ack-always", [ACK_ON_ERROR] = "fragmentation-mode-ack-on-error",
+		[NO_ACK] = "fragmentation-mode-no-ack" };
+
+static void json_field(const json_t* json, int entry, store_field_t* field) {
+	int token = json_member(json, entry, "field-id");
+	uint8_t i;
+
+	if (token < 0) {
+		json_error(json, entry, "field-id expected");
+	}
+	for (i = 0; i < sizeof(json_fields) / sizeof(json_fields[0]); i++) {
+		if (json_is(json, token, json_fields[i].name)) {
+			break;
+		}
+	}
+	if (i == sizeof(json_fields) / sizeof(json_fields[0])) {
+		json_error(json, token, "field not supported");
+	}
+	field->field = json_fields[i].field;
+
+	token = json_member(json, entry, "field-length");
+	if (token < 0 || json->tokens[token].type != JSMN_PRIMITIVE) {
+		json_error(json, entry, "a field length in bits expected, variable lengths are not supported");
+	}
+	field->length = (uint8_t) json_number(json, token);
+	field->pos = (uint8_t) json_member_number(json, entry, "field-position", 1);
+	field->dir = json_identity(json, entry, "direction-indicator", json_directions, BI + 1);
+	field->mo = json_identity(json, entry, "matching-operator", json_mos, SCHC_STORE_MO_MATCHMAP + 1);
+
+	token = json_member(json, entry, "comp-decomp-action");
+	if (token >= 0 && json_is(json, token, "cda-compute")) {
+		/* the length and checksum are computed as the field requires */
+		field->action = (field->field == UDP_CHK) ? COMPCHK : COMPLENGTH;
+	} else {
+		field->action = json_identity(json, entry, "comp-decomp-action", json_cdas, APPIID + 1);
+	}
+
+	token = json_member(json, entry, "target-value");
+	if (field->mo == SCHC_STORE_MO_MATCHMAP) {
+		/* the list entries take a byte each, or the bytes of the field if it is byte aligned */
+		uint8_t bytes = (field->length % 8) ? 1 : (field->length / 8);
+		if (token < 0 || bytes == 0) {
+			json_error(json, entry, "a target value list of a fixed length field expected");
+		}
+		field->mo_param = json_values(json, token, field->value, bytes);
+	} else if (token >= 0) {
+		json_values(json, token, field->value, BITS_TO_BYTES(field->length));
+	}
+
+	token = json_member(json, entry, "matching-operator-value");
+	if (field->mo == SCHC_STORE_MO_MSB) {
+		uint8_t value[MAX_FIELD_LENGTH] = { 0 };
+		if (token < 0 || json->tokens[token].size != 1) {
+			json_error(json, entry, "the number of MSB bits expected");
+		}
+		json_values(json, token, value, 1);
+		field->mo_param = value[0];
+	}
+}
+
+static uint32_t json_timer(const json_t* json, int rule, const char* key) {
+	int token = json_member(json, rule, key);
+
+	if (token < 0) {
+		return 0;
+	}
+	/* ticks of 2^ticks-duration microseconds */
+	uint64_t duration = json_member_number(json, token, "ticks-duration", 20);
+	uint64_t ticks = json_member_number(json, token, "ticks-numbers", 0);
+
+	return (uint32_t) (((ticks << duration) + 999) / 1000);
+}
+
+/*
+ * Add a context with the rules of a YANG-JSON file
+ */
+static void json_read(const char* path) {
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		exit(1);
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char* js = malloc(size + 1);
+	if (js == NULL || fread(js, 1, size, f) != (size_t) size) {
+		fprintf(stderr, "%s: could not be read\n", path);
+		exit(1);
+	}
+	fclose(f);
+
+	jsmn_parser parser;
+	json_t json = { js, NULL, 0, path };
+	jsmn_init(&parser);
+	json.count = jsmn_parse(&parser, js, size, NULL, 0);
+	if (json.count <= 0) {
+		fprintf(stderr, "%s: not valid JSON\n", path);
+		exit(1);
+	}
+	json.tokens = malloc(json.count * sizeof(jsmntok_t));
+	jsmn_init(&parser);
+	jsmn_parse(&parser, js, size, json.tokens, json.count);
+
+	int schc = json_member(&json, 0, "schc");
+	int list = (schc < 0) ? -1 : json_member(&json, schc, "rule");
+	if (list < 0 || json.tokens[list].type != JSMN_ARRAY) {
+		fprintf(stderr, "%s: an ietf-schc:schc rule list expected\n", path);
+		exit(1);
+	}
+
+	store_profile_t profile = { { 0, 0, 0 }, NULL };
+	store_context_t context = { 0, refs.count, 0, 0, 0, NULL };
+	uint32_t fragmentation[256];
+	int i, rule = list + 1;
+
+	for (i = 0; i < json.tokens[list].size; i++, rule = json_skip(&json, rule)) {
+		uint32_t rule_id = (uint32_t) json_member_number(&json, rule, "rule-id-value", 0);
+		uint8_t rule_id_size = (uint8_t) json_member_number(&json, rule, "rule-id-length", 0);
+		int nature = json_member(&json, rule, "rule-nature");
+		if (profile.profile.RULE_ID_SIZE && rule_id_size != profile.profile.RULE_ID_SIZE) {
+			json_error(&json, rule, "all rules of a context have the same rule id length");
+		}
+		profile.profile.RULE_ID_SIZE = rule_id_size;
+
+		if (nature >= 0 && json_is(&json, nature, "nature-no-compression")) {
+			context.uncomp_rule_id = rule_id;
+			profile.profile.UNCOMPRESSED_RULE_ID = (uint8_t) rule_id;
+		} else if (nature >= 0 && json_is(&json, nature, "nature-fragmentation")) {
+			store_fragmentation_rule_t* dst;
+			if (context.fragmentation_count == 255) {
+				json_error(&json, rule, "too many fragmentation rules");
+			}
+			fragmentation[context.fragmentation_count++] = list_add(&fragmentation_rules);
+			dst = AT(fragmentation_rules, store_fragmentation_rule_t, fragmentation_rules.count - 1);
+			dst->rule.rule_id = rule_id;
+			dst->rule.mode = json_identity(&json, rule, "fragmentation-mode", json_modes, NO_ACK + 1);
+			dst->rule.dir = json_identity(&json, rule, "direction", json_directions, BI + 1);
+			dst->rule.FCN_SIZE = (uint8_t) json_member_number(&json, rule, "fcn-size", 0);
+			dst->rule.WINDOW_SIZE = (uint8_t) json_member_number(&json, rule, "w-size", 0);
+			/* the window size holds the number of tiles, the last one has fcn 0 */
+			uint64_t tiles = json_member_number(&json, rule, "window-size", 1);
+			dst->rule.MAX_WND_FCN = (uint8_t) (tiles ? tiles - 1 : 0);
+			dst->rule.tile_size = (uint16_t) (json_member_number(&json, rule, "tile-size", 0) / 8);
+			dst->rule.inactivity_timer_ms = json_timer(&json, rule, "inactivity-timer");
+			dst->rule.retransmission_timer_ms = json_timer(&json, rule, "retransmission-timer");
+			dst->rule.RCS_SIZE_BYTES = 4; /* rcs-crc32 */
+			if (context.fragmentation_count == 1) {
+				profile.profile.DTAG_SIZE = (uint8_t) json_member_number(&json, rule, "dtag-size", 0);
+			}
+		} else {
+			int entries = json_member(&json, rule, "entry");
+			uint32_t first[3] = { 0 };
+			uint8_t length[3] = { 0 };
+			int j, entry;
+			if (entries < 0 || json.tokens[entries].type != JSMN_ARRAY) {
+				json_error(&json, rule, "an entry list expected");
+			}
+			/* the entries are kept in header order, the layers follow each other */
+			for (j = 0, entry = entries + 1; j < json.tokens[entries].size; j++, entry = json_skip(&json, entry)) {
+				store_field_t field;
+				memset(&field, 0, sizeof(field));
+				json_field(&json, entry, &field);
+				schc_layer_t layer = field_layer(field.field);
+				if (length[layer] == 0) {
+					first[layer] = fields.count;
+				} else if (first[layer] + length[layer] != fields.count) {
+					json_error(&json, entry, "the entries of a layer follow each other");
+				}
+				*((store_field_t*) list_push(&fields)) = field;
+				length[layer]++;
+			}
+
+			store_compression_rule_t* dst = list_push(&compression_rules);
+			dst->rule_id = rule_id;
+			schc_layer_t layer;
+			for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+				dst = AT(compression_rules, store_compression_rule_t, compression_rules.count - 1);
+				dst->layer[layer] = length[layer] ? add_layer_rule(layer, first[layer], length[layer], NULL)
+						: SCHC_STORE_NO_RULE;
+			}
+			add_ref(compression_rules.count - 1);
+			context.compression_count++;
+		}
+	}
+	for (i = 0; i < context.fragmentation_count; i++) {
+		add_ref(fragmentation[i]);
+	}
+
+	context.profile = (uint16_t) list_add(&profiles);
+	*AT(profiles, store_profile_t, context.profile) = profile;
+	*((store_context_t*) list_push(&contexts)) = context;
+
+	free(json.tokens);
+	free(js);
+}
+
+/*
+ * Add the devices of a device list: device_id context [dev_l2_id [app_l2_id]]
+ */
+static void devices_read(const char* path) {
+	char line[256];
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		char* ptr = line;
+		char* end;
+		uint64_t value[4] = { 0, 0, 0, 0 };
+		int n;
+		for (n = 0; n < 4; n++, ptr = end) {
+			value[n] = strtoull(ptr, &end, 0);
+			if (end == ptr) {
+				break;
+			}
+		}
+		if (line[0] == '#' || n < 2) {
+			continue;
+		}
+		if (value[1] >= contexts.count) {
+			fprintf(stderr, "%s: device %02" PRIx64 " refers to context %" PRIu64 " of %u\n", path, value[0], value[1],
+					contexts.count);
+			exit(1);
+		}
+		store_device_t* device = list_push(&store_devices);
+		device->device_id = value[0];
+		device->context = (uint32_t) value[1];
+		device->dev_l2_id = value[2];
+		device->app_l2_id = value[3];
+	}
+	fclose(f);
+}
+
+static int device_compare(const void* a, const void* b) {
+	uint64_t x = ((const store_device_t*) a)->device_id, y = ((const store_device_t*) b)->device_id;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Write the store, the sections follow the header in section order
+ */
+static int store_write(const char* path) {
+	const uint32_t field_size = SCHC_STORE_FIELD_SIZE(MAX_FIELD_LENGTH);
+	const uint32_t sizes[SCHC_STORE_SECTIONS] = { 4, field_size, 8, 16, 20, 12, 4, 32 };
+	const uint32_t counts[SCHC_STORE_SECTIONS] = { profiles.count, fields.count, layer_rules.count,
+			compression_rules.count, fragmentation_rules.count, contexts.count, refs.count, store_devices.count };
+	uint32_t offset[SCHC_STORE_SECTIONS];
+	uint64_t length = SCHC_STORE_HEADER_LENGTH;
+	uint32_t i;
+
+	for (i = 0; i < SCHC_STORE_SECTIONS; i++) {
+		offset[i] = (uint32_t) length;
+		length += (uint64_t) counts[i] * sizes[i];
+	}
+	if (length > UINT32_MAX) {
+		fprintf(stderr, "the store exceeds 4 GiB\n");
+		return 1;
+	}
+	uint8_t* store = calloc(1, length);
+	if (store == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	write_u32(store, SCHC_STORE_MAGIC);
+	write_u16(store + 4, SCHC_STORE_VERSION);
+	write_u16(store + 6, SCHC_STORE_HEADER_LENGTH);
+	write_u32(store + 8, (uint32_t) length);
+	store[16] = MAX_FIELD_LENGTH;
+	for (i = 0; i < SCHC_STORE_SECTIONS; i++) {
+		write_u32(store + 20 + 8 * i, offset[i]);
+		write_u32(store + 24 + 8 * i, counts[i]);
+	}
+
+	uint8_t* record = store + offset[SCHC_STORE_PROFILES];
+	for (i = 0; i < profiles.count; i++, record += 4) {
+		const struct schc_profile_t* profile = &AT(profiles, store_profile_t, i)->profile;
+		record[0] = profile->RULE_ID_SIZE;
+		record[1] = profile->UNCOMPRESSED_RULE_ID;
+		record[2] = profile->DTAG_SIZE;
+	}
+	record = store + offset[SCHC_STORE_FIELDS];
+	for (i = 0; i < fields.count; i++, record += field_size) {
+		const store_field_t* field = AT(fields, store_field_t, i);
+		write_u16(record, field->field);
+		record[2] = field->mo_param;
+		record[3] = field->length;
+		record[4] = field->pos;
+		record[5] = field->dir;
+		record[6] = field->mo;
+		record[7] = field->action;
+		memcpy(record + 8, field->value, MAX_FIELD_LENGTH);
+	}
+	record = store + offset[SCHC_STORE_LAYER_RULES];
+	for (i = 0; i < layer_rules.count; i++, record += 8) {
+		const store_layer_rule_t* rule = AT(layer_rules, store_layer_rule_t, i);
+		record[0] = rule->layer;
+		record[1] = rule->up;
+		record[2] = rule->down;
+		record[3] = rule->length;
+		write_u32(record + 4, rule->first);
+	}
+	record = store + offset[SCHC_STORE_COMPRESSION_RULES];
+	for (i = 0; i < compression_rules.count; i++, record += 16) {
+		const store_compression_rule_t* rule = AT(compression_rules, store_compression_rule_t, i);
+		write_u32(record, rule->rule_id);
+		write_u32(record + 4, rule->layer[SCHC_IPV6]);
+		write_u32(record + 8, rule->layer[SCHC_UDP]);
+		write_u32(record + 12, rule->layer[SCHC_COAP]);
+	}
+	record = store + offset[SCHC_STORE_FRAGMENTATION_RULES];
+	for (i = 0; i < fragmentation_rules.count; i++, record += 20) {
+		const struct schc_fragmentation_rule_t* rule = &AT(fragmentation_rules, store_fragmentation_rule_t, i)->rule;
+		write_u32(record, rule->rule_id);
+		write_u32(record + 4, rule->inactivity_timer_ms);
+		write_u32(record + 8, rule->retransmission_timer_ms);
+		write_u16(record + 12, rule->tile_size);
+		record[14] = rule->mode;
+		record[15] = rule->dir;
+		record[16] = rule->FCN_SIZE;
+		record[17] = rule->MAX_WND_FCN;
+		record[18] = rule->WINDOW_SIZE;
+		record[19] = rule->RCS_SIZE_BYTES;
+	}
+	record = store + offset[SCHC_STORE_CONTEXTS];
+	for (i = 0; i < contexts.count; i++, record += 12) {
+		const store_context_t* context = AT(contexts, store_context_t, i);
+		write_u32(record, context->uncomp_rule_id);
+		write_u32(record + 4, context->first);
+		write_u16(record + 8, context->profile);
+		record[10] = context->compression_count;
+		record[11] = context->fragmentation_count;
+	}
+	record = store + offset[SCHC_STORE_RULE_REFS];
+	for (i = 0; i < refs.count; i++, record += 4) {
+		write_u32(record, *AT(refs, uint32_t, i));
+	}
+	record = store + offset[SCHC_STORE_DEVICES];
+	for (i = 0; i < store_devices.count; i++, record += 32) {
+		const store_device_t* device = AT(store_devices, store_device_t, i);
+		write_u64(record, device->device_id);
+		write_u64(record + 8, device->dev_l2_id);
+		write_u64(record + 16, device->app_l2_id);
+		write_u32(record + 24, device->context);
+	}
+
+	uint32_t checksum = 0x811C9DC5;
+	for (i = SCHC_STORE_HEADER_LENGTH; i < length; i++) {
+		checksum = (checksum ^ store[i]) * 0x01000193;
+	}
+	write_u32(store + 12, checksum);
+
+	FILE* f = fopen(path, "wb");
+	if (f == NULL || fwrite(store, 1, length, f) != length) {
+		perror(path);
+		return 1;
+	}
+	fclose(f);
+	free(store);
+
+	printf("%s: %u contexts, %u compression rules, %u fragmentation rules, %u devices, %" PRIu64 " bytes\n", path,
+			contexts.count, compression_rules.count, fragmentation_rules.count, store_devices.count, length);
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	const char* device_list = NULL;
+	int i, json = 0;
+
+	for (i = 1; i < argc - 1; i++) {
+		if (!strcmp(argv[i], "-j") && i + 2 < argc) {
+			json_read(argv[++i]);
+			json++;
+		} else if (!strcmp(argv[i], "-d") && i + 2 < argc) {
+			device_list = argv[++i];
+		} else {
+			break;
+		}
+	}
+	if (i != argc - 1 || (json == 0) != (device_list == NULL)) {
+		fprintf(stderr, "usage: %s rules.bin\n"
+				"       %s -j context.json [-j context.json ...] -d devices.txt rules.bin\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	if (json) {
+		devices_read(device_list);
+	} else {
+		header_read();
+	}
+
+	qsort(store_devices.ptr, store_devices.count, sizeof(store_device_t), device_compare);
+	for (i = 1; i < (int) store_devices.count; i++) {
+		if (AT(store_devices, store_device_t, i)->device_id == AT(store_devices, store_device_t, i - 1)->device_id) {
+			fprintf(stderr, "device %02" PRIx64 " is listed twice\n", AT(store_devices, store_device_t, i)->device_id);
+			return 1;
+		}
+	}
+
+	return store_write(argv[argc - 1]);
+}
@@ -0,0 +1,81 @@
+/*
+ * (c) 2018 - 2022  idlab - UGent - imec
+ *
+ * Bart Moons
+ *
+ * This file is part of the SCHC stack implementation
+ *
+ * This is a decoder for the binary trace records of the library
+ * The application writes the records it reads with schc_trace_read() to a file,
+ * this tool prints them, one record per line
+ *
+ * usage: ./trace_decode trace.bin
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "../schc.h"
+
+static const char* level_names[] = {
+	[SCHC_TRACE_LEVEL_OFF] = "-",
+	[SCHC_TRACE_LEVEL_ERROR] = "ERROR",
+	[SCHC_TRACE_LEVEL_INFO] = "INFO",
+	[SCHC_TRACE_LEVEL_DEBUG] = "DEBUG"
+};
+
+static const char* event_names[SCHC_EV_MAX] = {
+	[SCHC_EV_COMPRESS] = "compress rule=%" PRIu32 " bits=%" PRIu32,
+	[SCHC_EV_COMPRESS_UNCOMPRESSED] = "compress uncompressed rule=%" PRIu32 " bits=%" PRIu32,
+	[SCHC_EV_DECOMPRESS] = "decompress rule=%" PRIu32 " length=%" PRIu32,
+	[SCHC_EV_DECOMPRESS_NO_RULE] = "decompress no rule first byte=0x%02" PRIX32 " length=%" PRIu32,
+	[SCHC_EV_FRAGMENT_TX] = "fragment tx window/fcn=0x%08" PRIX32 " length=%" PRIu32,
+	[SCHC_EV_FRAGMENT_RETX] = "fragment retx window/fcn=0x%08" PRIX32 " length=%" PRIu32,
+	[SCHC_EV_FRAGMENT_RX] = "fragment rx dtag=%" PRIu32 " length=%" PRIu32,
+	[SCHC_EV_ACK_TX] = "ack tx window=%" PRIu32 " bitmap=0x%08" PRIX32,
+	[SCHC_EV_ACK_RX] = "ack rx window=%" PRIu32 " bitmap=0x%08" PRIX32,
+	[SCHC_EV_ACK_REQ_TX] = "ack req tx window=%" PRIu32 " dtag=%" PRIu32,
+	[SCHC_EV_SENDER_ABORT] = "sender abort window=%" PRIu32 " dtag=%" PRIu32,
+	[SCHC_EV_RECEIVER_ABORT] = "receiver abort window=%" PRIu32 " dtag=%" PRIu32,
+	[SCHC_EV_RCS_ERROR] = "rcs error received=0x%08" PRIX32 " computed=0x%08" PRIX32,
+	[SCHC_EV_BITMAP] = "bitmap window=%" PRIu32 " bitmap=0x%08" PRIX32
+};
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		printf("usage: %s trace.bin\n", argv[0]);
+		return 1;
+	}
+
+	FILE* f = fopen(argv[1], "rb");
+	if (f == NULL) {
+		printf("trace_decode(): could not open %s \n", argv[1]);
+		return 1;
+	}
+
+	schc_trace_record_t record;
+	uint32_t expected_seq = 0, count = 0;
+	while (fread(&record, sizeof(record), 1, f) == 1) {
+		if (count && record.seq != expected_seq) {
+			printf("... %" PRIu32 " records lost\n", record.seq - expected_seq);
+		}
+		expected_seq = record.seq + 1;
+		count++;
+
+		const char* level = (record.level <= SCHC_TRACE_LEVEL_DEBUG) ? level_names[record.level] : "?";
+		printf("%10" PRIu32 " %10" PRIu32 " %-5s ", record.seq, record.time, level);
+		if (record.event < SCHC_EV_MAX && event_names[record.event] != NULL) {
+			printf(event_names[record.event], record.arg[0], record.arg[1]);
+		} else {
+			printf("event=%u 0x%08" PRIX32 " 0x%08" PRIX32, record.event, record.arg[0], record.arg[1]);
+		}
+		printf("\n");
+	}
+	fclose(f);
+
+	printf("%" PRIu32 " records\n", count);
+
+	return 0;
+}
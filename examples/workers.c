@@ -0,0 +1,183 @@
+/*
+ * (c) 2018 - 2022  idlab - UGent - imec
+ *
+ * Bart Moons
+ *
+ * This file is part of the SCHC stack implementation
+ *
+ * This is an example of the worker pool
+ * The packets of the devices are compressed and decompressed on a pool of threads,
+ * every packet is queued on the worker handling its device.
+ * The results are compared with a run on the main thread
+ * and the packets per second are printed for a growing number of workers.
+ *
+ * usage: ./workers [-q]
+ * 	-q	quick run, less packets
+ *
+ * build with -DSCHC_WORKERS=1 (make workers) or set SCHC_WORKERS to 1 in schc_config.h
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../compressor.h"
+#include "../workers.h"
+
+#if SCHC_WORKERS != 1
+#error "build with -DSCHC_WORKERS=1 or set SCHC_WORKERS to 1 in schc_config.h"
+#endif
+
+#define MAX_PACKET_LENGTH		128
+#define PACKETS					(1 << 12)
+
+/* IPv6/UDP/CoAP packets from the device (CCCC::2) to the network gateway (AAAA::1) and back */
+static const uint8_t msg_up[] = {
+		0x60, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x11, 0x40, 0xCC, 0xCC, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xAA, 0xAA, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+		0x33, 0x16, 0x33, 0x16, 0x00, 0x1E, 0x05, 0x2C,
+		0x54, 0x03, 0x23, 0xBB, 0x21, 0xFA, 0x01, 0xFB, 0xB5, 0x75, 0x73, 0x61, 0x67, 0x65,
+		0xD1, 0xEA, 0x1A, 0xFF,
+		0x01, 0x02, 0x03, 0x04 };
+static const uint8_t msg_down[] = {
+		0x60, 0x00, 0x00, 0x00, 0x00, 0x1E, 0x11, 0x40, 0xAA, 0xAA, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xCC, 0xCC, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+		0x33, 0x16, 0x33, 0x16, 0x00, 0x1E, 0x05, 0x2C,
+		0x54, 0x03, 0x23, 0xBB, 0x21, 0xFA, 0x01, 0xFB, 0xB5, 0x75, 0x73, 0x61, 0x67, 0x65,
+		0xD1, 0xEA, 0x1A, 0xFF,
+		0x01, 0x02, 0x03, 0x04 };
+
+static const uint64_t device_ids[] = { 0x06, 0x01 };
+
+typedef struct packet_t {
+	uint8_t data[MAX_PACKET_LENGTH];
+	uint64_t device_id;
+	direction dir;
+	/* the compressed and decompressed packet */
+	uint8_t compressed[MAX_PACKET_LENGTH];
+	uint16_t compressed_len;
+	uint8_t decompressed[MAX_PACKET_LENGTH];
+	uint16_t decompressed_len;
+} packet_t;
+
+static packet_t packets[PACKETS];
+static packet_t expected[PACKETS];
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * compress and decompress a packet, this runs on the worker of the device
+ */
+static void roundtrip(void* arg) {
+	packet_t* packet = (packet_t*) arg;
+
+	schc_bitarray_t bit_arr = SCHC_DEFAULT_BIT_ARRAY(MAX_PACKET_LENGTH, packet->compressed);
+	packet->compressed_len = 0;
+	packet->decompressed_len = 0;
+	if (schc_compress(packet->data, sizeof(msg_up), &bit_arr, packet->device_id, packet->dir) == NULL) {
+		return;
+	}
+	packet->compressed_len = bit_arr.len;
+
+	bit_arr.offset = 0;
+	packet->decompressed_len = schc_decompress(&bit_arr, packet->decompressed, packet->device_id,
+			bit_arr.len, packet->dir);
+}
+
+static void init_packets(void) {
+	uint32_t i;
+	for (i = 0; i < PACKETS; i++) {
+		packet_t* packet = &packets[i];
+		memset(packet, 0, sizeof(packet_t));
+		packet->dir = (i / 2) % 2 ? DOWN : UP;
+		packet->device_id = device_ids[i % 2];
+		memcpy(packet->data, packet->dir == UP ? msg_up : msg_down, sizeof(msg_up));
+		packet->data[sizeof(msg_up) - 1] = (uint8_t) i; /* payload */
+	}
+}
+
+static int check_packets(uint32_t count) {
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		if (packets[i].compressed_len != expected[i].compressed_len
+				|| packets[i].decompressed_len != expected[i].decompressed_len
+				|| memcmp(packets[i].compressed, expected[i].compressed, MAX_PACKET_LENGTH)
+				|| memcmp(packets[i].decompressed, expected[i].decompressed, MAX_PACKET_LENGTH)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	static schc_worker_pool_t pool;
+	uint32_t count = PACKETS;
+	uint32_t i;
+	uint8_t workers;
+
+	if (argc > 1 && !strcmp(argv[1], "-q")) {
+		count = PACKETS / 16;
+	} else if (argc > 1) {
+		printf("usage: %s [-q]\n", argv[0]);
+		return 1;
+	}
+
+	/* print the results on the original stdout, discard the output of the library */
+	FILE* out = fdopen(dup(fileno(stdout)), "w");
+	if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+		return 1;
+	}
+
+	/* the rules are set up before the workers start */
+	if (!schc_compressor_init()) {
+		fprintf(out, "workers(): could not initialize the compressor\n");
+		return 1;
+	}
+
+	/* the reference, on the main thread */
+	init_packets();
+	uint64_t start = now_ns();
+	for (i = 0; i < count; i++) {
+		roundtrip(&packets[i]);
+	}
+	double single = (double) count * 1e9 / (now_ns() - start);
+	memcpy(expected, packets, sizeof(packets));
+	fprintf(out, "%8s %14s %8s\n", "workers", "packets/s", "speedup");
+	fprintf(out, "%8s %14.0f %7.2fx\n", "main", single, 1.0);
+
+	/* the packets are sharded on the device, so there is a worker per device at most */
+	for (workers = 1; workers <= SCHC_WORKERS_MAX && workers <= sizeof(device_ids) / sizeof(device_ids[0]); workers++) {
+		if (schc_workers_start(&pool, workers, NULL) != SCHC_SUCCESS) {
+			fprintf(out, "workers(): could not start %d workers\n", workers);
+			return 1;
+		}
+
+		init_packets();
+		start = now_ns();
+		for (i = 0; i < count; i++) {
+			schc_workers_post(&pool, packets[i].device_id, roundtrip, &packets[i]);
+		}
+		schc_workers_wait(&pool);
+		double rate = (double) count * 1e9 / (now_ns() - start);
+		schc_workers_stop(&pool);
+
+		if (!check_packets(count)) {
+			fprintf(out, "workers(): the packets of %d workers differ from the main thread\n", workers);
+			return 1;
+		}
+		fprintf(out, "%8d %14.0f %7.2fx\n", workers, rate, rate / single);
+	}
+	fclose(out);
+
+	return 0;
+}
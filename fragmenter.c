@@ -22,21 +22,10 @@ uint8_t ATTEMPTS = 0; // for debugging
 #include <click/config.h>
 #endif
 
-// keep track of the active connections
-static uint8_t FRAGMENTATION_BUF[MAX_MTU_LENGTH] = { 0 };
-
-#if DYNAMIC_MEMORY
-struct schc_fragmentation_t *schc_rx_conns;
-struct schc_fragmentation_t *schc_tx_conns;
-#else
-struct schc_fragmentation_t schc_rx_conns[SCHC_CONF_RX_CONNS];
-struct schc_fragmentation_t schc_tx_conns[SCHC_CONF_TX_CONNS];
-static uint32_t buf_ptr = 0;
-uint8_t schc_buf[STATIC_MEMORY_BUFFER_LENGTH] = { 0 };
-static struct schc_mbuf_t MBUF_POOL[SCHC_CONF_MBUF_POOL_LEN];
-#endif
-
-static schc_fragmentation_t default_conn;
+/* the context of the threads which did not bind one */
+static schc_ctx_t default_ctx;
+/* the context of the calling thread */
+static SCHC_THREAD_LOCAL schc_ctx_t* schc_ctx = &default_ctx;
 
 /**
  * get the FCN value
@@ -123,6 +112,7 @@ static uint8_t get_fragmentation_header_length(schc_mbuf_t *mbuf, schc_fragmenta
 	return offset;
 }
 
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
 /**
  * print the complete mbuf chain
  *
@@ -142,6 +132,22 @@ static void mbuf_print(schc_mbuf_t *head) {
 		i++;
 	}
 }
+#endif
+
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_INFO
+/**
+ * get the first 32 bits of a bitmap for a trace record
+ *
+ * @param  bitmap		the bitmap
+ * @param  len			the length of the bitmap in bits
+ *
+ * @return bits			the bits, aligned to the least significant bit
+ *
+ */
+static uint32_t get_trace_bitmap(const uint8_t* bitmap, uint8_t len) {
+	return get_bits(bitmap, 0, (len > 32) ? 32 : len);
+}
+#endif
 
 static schc_mbuf_t *mbuf_alloc(void)
 {
@@ -149,9 +155,9 @@ static schc_mbuf_t *mbuf_alloc(void)
 	uint32_t i;
 
 	for(i = 0; i < SCHC_CONF_MBUF_POOL_LEN; i++) {
-		if(MBUF_POOL[i].len == 0 && MBUF_POOL[i].ptr == NULL) {
+		if(schc_ctx->mbuf_pool[i].len == 0 && schc_ctx->mbuf_pool[i].ptr == NULL) {
 			DEBUG_PRINTF("mbuf_alloc(): selected mbuf slot %d \n", (int) i);
-			return &MBUF_POOL[i];
+			return &schc_ctx->mbuf_pool[i];
 		}
 	}
 	return NULL;
@@ -264,7 +270,7 @@ static void mbuf_delete(schc_mbuf_t **head, schc_mbuf_t *mbuf) {
 	free(mbuf->ptr);
 	free(mbuf);
 #else
-	DEBUG_PRINTF("mbuf_delete(): clear slot %li in mbuf pool \n", mbuf - MBUF_POOL);
+	DEBUG_PRINTF("mbuf_delete(): clear slot %li in mbuf pool \n", mbuf - schc_ctx->mbuf_pool);
 	memset(mbuf->ptr, 0, mbuf->len);
 	mbuf->next = NULL;
 	mbuf->frag_cnt = 0;
@@ -634,7 +640,7 @@ static uint8_t get_frag_cnt(schc_fragmentation_t* conn, uint8_t fcn, uint8_t win
  *
  */
 struct schc_fragmentation_rule_t* get_fragmentation_rule_by_reliability_mode(reliability_mode mode,
-		uint32_t device_id) {
+		uint64_t device_id) {
 	struct schc_device *device = get_device_by_id(device_id);
 
 	if (device == NULL) {
@@ -656,8 +662,6 @@ struct schc_fragmentation_rule_t* get_fragmentation_rule_by_reliability_mode(rel
 	return NULL;
 }
 
-// todo move to schc.c generic function for both this method and get_compression_rule_by_rule_id
-
 /*
  * Find a SCHC rule entry for a device
  *
@@ -669,27 +673,21 @@ struct schc_fragmentation_rule_t* get_fragmentation_rule_by_reliability_mode(rel
  *
  */
 static struct schc_fragmentation_rule_t* get_fragmentation_rule_by_rule_id(uint8_t* rule_arr, struct schc_device *device) {
-	int i;
+	struct schc_fragmentation_rule_t* rule;
 
-	for (i = 0; i < device->fragmentation_rule_count; i++) {
-		struct schc_fragmentation_rule_t* curr_rule = (struct schc_fragmentation_rule_t*) (*device->fragmentation_context)[i];
-		uint8_t curr_rule_pos = get_position_in_first_byte(device->profile->RULE_ID_SIZE);
-		uint8_t rule_id[4] = { 0 };
-		little_end_uint8_from_uint32(rule_id, curr_rule->rule_id); /* copy the uint32_t to a uint8_t array */
-		if( compare_bits_aligned(rule_id, curr_rule_pos, rule_arr, 0, device->profile->RULE_ID_SIZE)) {
-			DEBUG_PRINTF("get_fragmentation_rule(): curr rule %p \n", (void*) curr_rule);
-			return curr_rule;
-		}
+	get_rules_by_rule_id(rule_arr, device, NULL, &rule);
+	if (rule != NULL) {
+		DEBUG_PRINTF("get_fragmentation_rule(): curr rule %p \n", (void*) rule);
 	}
 
-	return NULL;
+	return rule;
 }
 
 static int16_t get_next_available_dtag(schc_fragmentation_t* conn) {
 	int16_t count = 0;
 
 #if DYNAMIC_MEMORY
-	schc_fragmentation_t *ptr = schc_tx_conns;
+	schc_fragmentation_t *ptr = schc_ctx->tx_conns;
 	while(ptr) {
 		if(ptr != conn && ptr->fragmentation_rule) {
 			if ( (ptr->fragmentation_rule->rule_id == conn->fragmentation_rule->rule_id) && (ptr->TX_STATE != INIT_TX)) { 
@@ -702,8 +700,8 @@ static int16_t get_next_available_dtag(schc_fragmentation_t* conn) {
 #else
 	uint32_t i;
 	for(i = 0; i < SCHC_CONF_TX_CONNS; i++) {
-		if(&schc_tx_conns[i] != conn && schc_tx_conns[i].fragmentation_rule) { /* not all connections are initialized yet */
-			if( (schc_tx_conns[i].fragmentation_rule->rule_id == conn->fragmentation_rule->rule_id) && (schc_tx_conns[i].TX_STATE != INIT_TX)) { 
+		if(&schc_ctx->tx_conns[i] != conn && schc_ctx->tx_conns[i].fragmentation_rule) { /* not all connections are initialized yet */
+			if( (schc_ctx->tx_conns[i].fragmentation_rule->rule_id == conn->fragmentation_rule->rule_id) && (schc_ctx->tx_conns[i].TX_STATE != INIT_TX)) { 
 				/* rule in use by another active connection */
 				count++;
 			}
@@ -957,33 +955,20 @@ static uint32_t has_no_more_fragments(schc_fragmentation_t* conn) {
 }
 
 static uint8_t set_bare_fragmentation_header(schc_fragmentation_t* conn, uint8_t window, uint8_t* fragmentation_buffer) {
-	uint8_t bit_offset = conn->device->profile->RULE_ID_SIZE;
+	schc_bitwriter_t header;
+	schc_bitwriter_init(&header, fragmentation_buffer, 0);
 
 	 // set rule id
 	uint8_t src_pos = get_position_in_first_byte(conn->device->profile->RULE_ID_SIZE);
 	uint8_t fragmenter_id[4] = { 0 };
 	little_end_uint8_from_uint32(fragmenter_id, conn->fragmentation_rule->rule_id); /* copy the uint32_t to a uint8_t array */
-	copy_bits(fragmentation_buffer, 0, fragmenter_id, src_pos, bit_offset);
-
-	// set dtag field
-	uint8_t dtag[1] = { conn->dtag << (8 - conn->device->profile->DTAG_SIZE) };
-	copy_bits(fragmentation_buffer, bit_offset, dtag, 0, conn->device->profile->DTAG_SIZE); // right after rule id
-
-	bit_offset += conn->device->profile->DTAG_SIZE;
+	schc_bitwriter_put_array(&header, fragmenter_id, src_pos, conn->device->profile->RULE_ID_SIZE);
 
-	// set window bit
-	uint8_t w[1] = { window << (8 - conn->fragmentation_rule->WINDOW_SIZE) };
-	copy_bits(fragmentation_buffer, bit_offset, w, 0, conn->fragmentation_rule->WINDOW_SIZE); // right after dtag
+	schc_bitwriter_put(&header, conn->dtag, conn->device->profile->DTAG_SIZE); // right after rule id
+	schc_bitwriter_put(&header, window, conn->fragmentation_rule->WINDOW_SIZE); // right after dtag
+	schc_bitwriter_put(&header, conn->fcn, conn->fragmentation_rule->FCN_SIZE); // right after window bits
 
-	bit_offset += conn->fragmentation_rule->WINDOW_SIZE;
-
-	// set fcn value
-	uint8_t fcn[1] = { conn->fcn << (8 - conn->fragmentation_rule->FCN_SIZE) };
-	copy_bits(fragmentation_buffer, bit_offset, fcn, 0, conn->fragmentation_rule->FCN_SIZE); // right after window bits
-
-	bit_offset += conn->fragmentation_rule->FCN_SIZE;
-
-	return bit_offset;
+	return schc_bitwriter_flush(&header);
 }
 
 /**
@@ -1040,8 +1025,12 @@ static void set_local_bitmap(schc_fragmentation_t* conn, uint8_t window) {
 	}
 	set_bits(conn->bitmap[window], frag, 1);
 
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
 	DEBUG_PRINTF("set_local_bitmap(): fcn=%d, index=%d, w=%d: ", conn->fcn, frag, window);
 	print_bitmap(conn->bitmap[window], conn->fragmentation_rule->MAX_WND_FCN + 1);
+#endif
+	SCHC_TRACE_DEBUG(SCHC_EV_BITMAP, window,
+			get_trace_bitmap(conn->bitmap[window], conn->fragmentation_rule->MAX_WND_FCN + 1));
 }
 
 /**
@@ -1245,9 +1234,11 @@ static void set_inactivity_timer(schc_fragmentation_t* conn) {
  *
  */
 static uint8_t send_fragment(schc_fragmentation_t* conn, uint8_t window, bool retransmission) {
-	memset(FRAGMENTATION_BUF, 0, MAX_MTU_LENGTH); /* set and reset buffer */
+	uint8_t* frag_buf = schc_ctx->frag_buf;
+
+	memset(frag_buf, 0, MAX_MTU_LENGTH); /* set and reset buffer */
 
-	uint16_t header_bits = set_complete_fragmentation_header(conn, window, FRAGMENTATION_BUF); /* set fragmentation header */
+	uint16_t header_bits = set_complete_fragmentation_header(conn, window, frag_buf); /* set fragmentation header */
 	uint32_t packet_bits_tx = has_no_more_fragments(conn); /* the number of bits already transmitted */
 	uint16_t packet_len = 0; int32_t remaining_bits; uint32_t packet_bit_offset = 0;
 
@@ -1291,7 +1282,7 @@ static uint8_t send_fragment(schc_fragmentation_t* conn, uint8_t window, bool re
 			header_bits += (conn->fragmentation_rule->RCS_SIZE_BYTES * 8); // include RCS bytes
 		}
 
-		remaining_bits = calculate_byte_padding(header_bits + packet_bits_tx); // padding variable (padding is already set by memset(FRAGMENTATION_BUF))
+		remaining_bits = calculate_byte_padding(header_bits + packet_bits_tx); // padding variable (padding is already set by memset(frag_buf))
 
 		packet_len = BITS_TO_BYTES(header_bits + remaining_bits + packet_bits_tx); // last packet length
 
@@ -1301,17 +1292,21 @@ static uint8_t send_fragment(schc_fragmentation_t* conn, uint8_t window, bool re
 		}
 	}
 
-	copy_bits(FRAGMENTATION_BUF, header_bits, conn->bit_arr->ptr, packet_bit_offset, packet_bits_tx); // copy bits
+	copy_bits(frag_buf, header_bits, conn->bit_arr->ptr, packet_bit_offset, packet_bits_tx); // copy bits
 
 	DEBUG_PRINTF(
 			"send_fragment(): count=%d, fcn=%d, dtag=%d, window=%d, length=%d\n",
 			conn->frag_cnt, conn->fcn, conn->dtag, window, packet_len);
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
 	int j;
 
 	for (j = 0; j < packet_len; j++) {
-		DEBUG_PRINTF("0x%02X ", FRAGMENTATION_BUF[j]);
+		DEBUG_PRINTF("0x%02X ", frag_buf[j]);
 	}
 	DEBUG_PRINTF("\n");
+#endif
+	SCHC_TRACE_INFO(retransmission ? SCHC_EV_FRAGMENT_RETX : SCHC_EV_FRAGMENT_TX,
+			((uint32_t) window << 16) | conn->fcn, packet_len);
 	
 	if(!retransmission) {
 		/* store the tile sizes of the current window */
@@ -1319,28 +1314,27 @@ static uint8_t send_fragment(schc_fragmentation_t* conn, uint8_t window, bool re
 		conn->total_transmissions++;
 	}
 
-	return conn->send(FRAGMENTATION_BUF, packet_len, conn->device->device_id);
+	return conn->send(frag_buf, packet_len, conn->device->device_id);
 }
 
 static uint8_t fill_ack_buffer(schc_fragmentation_t* conn, uint8_t window, uint8_t* buffer, uint8_t* offset) {
+	schc_bitwriter_t ack;
+	schc_bitwriter_init(&ack, buffer, 0);
+
 	/* set rule id */
-	*offset = conn->device->profile->RULE_ID_SIZE;
-	copy_bits(buffer, 0, conn->ack.rule_id, 0, *offset);
+	schc_bitwriter_put_array(&ack, conn->ack.rule_id, 0, conn->device->profile->RULE_ID_SIZE);
 
 	/* set dtag */
-	uint8_t dtag[1] =  { conn->dtag << (8 - conn->device->profile->DTAG_SIZE) };
-	copy_bits(buffer, *offset, dtag, 0, conn->device->profile->DTAG_SIZE);
-	*offset += conn->device->profile->DTAG_SIZE;
+	schc_bitwriter_put(&ack, conn->dtag, conn->device->profile->DTAG_SIZE);
 
 	/* set window */
-	uint8_t w[1] = { window << (8 - conn->fragmentation_rule->WINDOW_SIZE) };
-	copy_bits(buffer, *offset, w, 0, conn->fragmentation_rule->WINDOW_SIZE);
-	*offset += conn->fragmentation_rule->WINDOW_SIZE;
+	schc_bitwriter_put(&ack, window, conn->fragmentation_rule->WINDOW_SIZE);
 
 	/* set mic bit if all-1 window RCS check succeeded, otherwise set to zero */
-	uint8_t c[1] = { conn->ack.mic << (8 - MIC_C_SIZE_BITS) };
-	copy_bits(buffer, *offset, c, 0, MIC_C_SIZE_BITS);
-	*offset += MIC_C_SIZE_BITS;
+	schc_bitwriter_put(&ack, conn->ack.mic, MIC_C_SIZE_BITS);
+
+	*offset = schc_bitwriter_flush(&ack);
+	return *offset;
 }
 
 /**
@@ -1363,18 +1357,24 @@ static uint8_t send_ack(schc_fragmentation_t* conn, uint8_t window) {
 	DEBUG_PRINTF("send_ack(): sending bitmap \n");
 	copy_bits(ack, offset, conn->bitmap[window], 0, conn->fragmentation_rule->MAX_WND_FCN + 1); // copy the bitmap
 	offset += conn->fragmentation_rule->MAX_WND_FCN + 1; // todo must be encoded
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
 	print_bitmap(conn->bitmap[window], conn->fragmentation_rule->MAX_WND_FCN + 1);
+#endif
 
 	uint8_t packet_len = ((offset - 1) / 8) + 1;
 	DEBUG_PRINTF("send_ack(): sending ack with length %d (%d b) - count=%d, dtag=%d, window=%d \n",
 			packet_len, offset, conn->frag_cnt, conn->dtag, window);
 
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
 	int i;
 	for(i = 0; i < packet_len; i++) {
 		DEBUG_PRINTF("%02X ", ack[i]);
 	}
 
 	DEBUG_PRINTF("\n");
+#endif
+	SCHC_TRACE_INFO(SCHC_EV_ACK_TX, window,
+			get_trace_bitmap(conn->bitmap[window], conn->fragmentation_rule->MAX_WND_FCN + 1));
 
 	return conn->send(ack, packet_len, conn->device->device_id);
 }
@@ -1392,19 +1392,20 @@ static uint8_t send_ack(schc_fragmentation_t* conn, uint8_t window) {
  */
 static uint8_t send_ack_req(schc_fragmentation_t* conn) {
 	// set and reset buffer
-	memset(FRAGMENTATION_BUF, 0, MAX_MTU_LENGTH);
+	memset(schc_ctx->frag_buf, 0, MAX_MTU_LENGTH);
 
 	// set fragmentation header
 	conn->fcn = 0;
-	uint16_t header_offset = set_bare_fragmentation_header(conn, conn->window, FRAGMENTATION_BUF);
+	uint16_t header_offset = set_bare_fragmentation_header(conn, conn->window, schc_ctx->frag_buf);
 
 	/* padding is already set by memsetting the buffer */
 	uint8_t packet_len = BITS_TO_BYTES(header_offset);
 
 	DEBUG_PRINTF("send_ack_req(): sending Ack-Req to device %d with length %d (%d b)\n",
 			(int) conn->device->device_id, packet_len, header_offset);
+	SCHC_TRACE_INFO(SCHC_EV_ACK_REQ_TX, conn->window, conn->dtag);
 
-	return conn->send(FRAGMENTATION_BUF, packet_len, conn->device->device_id);
+	return conn->send(schc_ctx->frag_buf, packet_len, conn->device->device_id);
 }
 
 /**
@@ -1415,19 +1416,20 @@ static uint8_t send_ack_req(schc_fragmentation_t* conn) {
  */
 int8_t schc_sender_abort(schc_fragmentation_t* conn) {
 	/* set and reset buffer */
-	memset(FRAGMENTATION_BUF, 0, MAX_MTU_LENGTH);
+	memset(schc_ctx->frag_buf, 0, MAX_MTU_LENGTH);
 	
 	conn->fcn = get_max_fcn_value(conn);
 	conn->TX_STATE = ERR;
-	uint8_t header_offset = set_bare_fragmentation_header(conn, conn->window, FRAGMENTATION_BUF);
+	uint8_t header_offset = set_bare_fragmentation_header(conn, conn->window, schc_ctx->frag_buf);
 
 	/* padding is already set by memsetting the buffer */
 	uint8_t packet_len = BITS_TO_BYTES(header_offset);
 
 	DEBUG_PRINTF("schc_sender_abort(): sending Send-Abort to device %d with length %d (%d b)\n",
 			(int) conn->device->device_id, packet_len, header_offset);
+	SCHC_TRACE_ERROR(SCHC_EV_SENDER_ABORT, conn->window, conn->dtag);
 
-	return conn->send(FRAGMENTATION_BUF, packet_len, conn->device->device_id);
+	return conn->send(schc_ctx->frag_buf, packet_len, conn->device->device_id);
 
 }
 
@@ -1455,12 +1457,15 @@ int8_t schc_receiver_abort(schc_fragmentation_t* conn) {
 
 	DEBUG_PRINTF("schc_receiver_abort(): sending Receiver-Abort with length %d (%d b) \n", packet_len, offset);
 
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
 	int i;
 	for(i = 0; i < packet_len; i++) {
 		DEBUG_PRINTF("%02X ", abort[i]);
 	}
 
 	DEBUG_PRINTF("\n");
+#endif
+	SCHC_TRACE_ERROR(SCHC_EV_RECEIVER_ABORT, conn->window, conn->dtag);
 
 	return conn->send(abort, packet_len, conn->device->device_id);
 }
@@ -1557,7 +1562,7 @@ schc_fragmentation_t* set_connection(struct schc_device* device, schc_fragmentat
  */
 schc_fragmentation_t* schc_get_rx_connection(struct schc_device* device, int16_t dtag) {
 	schc_fragmentation_t *conn = NULL;
-	conn = get_connection(device, dtag, schc_rx_conns, SCHC_CONF_RX_CONNS);
+	conn = get_connection(device, dtag, schc_ctx->rx_conns, SCHC_CONF_RX_CONNS);
 
 	if(conn) {
 		DEBUG_PRINTF("get_rx_connection(): selected connection %p for device %d with dtag %d\n", (void *) conn, (int) device->device_id, (int) dtag);
@@ -1570,7 +1575,7 @@ schc_fragmentation_t* schc_set_rx_connection(struct schc_device* device, int16_t
 	schc_fragmentation_t *conn = NULL;
 	conn = schc_get_rx_connection(device, dtag);
 	if(!conn) {
-		conn = set_connection(device, schc_rx_conns, SCHC_CONF_RX_CONNS);
+		conn = set_connection(device, schc_ctx->rx_conns, SCHC_CONF_RX_CONNS);
 		if(!conn) {
 			DEBUG_PRINTF("set_rx_connection(): no more free connections available\n");
 			return NULL;
@@ -1597,7 +1602,7 @@ schc_fragmentation_t* schc_set_rx_connection(struct schc_device* device, int16_t
  */
 schc_fragmentation_t* schc_get_tx_connection(struct schc_device* device, int16_t dtag) {
 	schc_fragmentation_t *conn = NULL;
-	conn = get_connection(device, dtag, schc_tx_conns, SCHC_CONF_TX_CONNS);
+	conn = get_connection(device, dtag, schc_ctx->tx_conns, SCHC_CONF_TX_CONNS);
 
 	if(conn) {
 		DEBUG_PRINTF("get_tx_connection(): selected connection %p for device %d with dtag %d\n", (void *) conn, (int) device->device_id, (int) conn->dtag);
@@ -1610,7 +1615,7 @@ schc_fragmentation_t* schc_set_tx_connection(struct schc_device* device, int16_t
 	schc_fragmentation_t *conn = NULL;
 	conn = schc_get_tx_connection(device, dtag);
 	if(!conn) {
-		conn = set_connection(device, schc_tx_conns, SCHC_CONF_TX_CONNS);
+		conn = set_connection(device, schc_ctx->tx_conns, SCHC_CONF_TX_CONNS);
 		if(!conn) {
 			DEBUG_PRINTF("set_tx_connection(): no more free connections available\n");
 			return NULL;
@@ -1634,13 +1639,13 @@ void schc_free_connection(schc_fragmentation_t *conn)
 	if(conn->free_conn_cb) {
 		conn->free_conn_cb(conn);
 	}
-	schc_fragmentation_t *ptr = schc_rx_conns, *last = NULL;
+	schc_fragmentation_t *ptr = schc_ctx->rx_conns, *last = NULL;
 
 	DEBUG_PRINTF("schc_free_connection(): trying to free %p\n", (void *)conn);
 	while (ptr) {
 		if (ptr == conn) {
 			if (last == NULL) {
-				schc_rx_conns = ptr->next;
+				schc_ctx->rx_conns = ptr->next;
 			}
 			else {
 				last->next = ptr->next;
@@ -1682,11 +1687,14 @@ static int8_t rcs_correct(schc_fragmentation_t* rx_conn) {
 	DEBUG_PRINTF("rcs_correct(): received RCS is %02X%02X%02X%02X\n", recv_mic[0], recv_mic[1],
 			recv_mic[2], recv_mic[3]);
 
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
 	mbuf_print(rx_conn->head);
+#endif
 	mbuf_compute_rcs(rx_conn); // compute the mic over the mbuf chain
 
 	if (!compare_bits(rx_conn->rcs, recv_mic, (rx_conn->fragmentation_rule->RCS_SIZE_BYTES * 8))) { // mic wrong
 		DEBUG_PRINTF("rcs_correct(): reassembly check sequence failed! \n");
+		SCHC_TRACE_ERROR(SCHC_EV_RCS_ERROR, get_bits(recv_mic, 0, 32), get_bits(rx_conn->rcs, 0, 32));
 		return 0;
 	}
 
@@ -2174,8 +2182,31 @@ int8_t schc_reassemble(schc_fragmentation_t* rx_conn) {
 	return 0;
 }
 
+/**
+ * Get the context of the calling thread
+ *
+ * @return ctx					the context bound with schc_ctx_set() or the default context
+ *
+ */
+schc_ctx_t* schc_ctx_get(void) {
+	return schc_ctx;
+}
+
+/**
+ * Bind a context to the calling thread
+ * the fragmenter calls of the thread work on the connections, buffers and callbacks of this context,
+ * so the connections of a device have to be handled by the same context
+ *
+ * @param ctx					the context, NULL to use the default context
+ *
+ */
+void schc_ctx_set(schc_ctx_t* ctx) {
+	schc_ctx = (ctx != NULL) ? ctx : &default_ctx;
+}
+
 /**
  * Initializes the SCHC fragmenter
+ * for the context of the calling thread
  *
  * @param tx_conn				a pointer to the tx initialization structure
  *
@@ -2185,37 +2216,40 @@ int8_t schc_reassemble(schc_fragmentation_t* rx_conn) {
 int8_t schc_fragmenter_init(struct schc_fragmentation_t* cb_conn) {
 	uint32_t i;
 
+	bit_operations_init();
+
 #if DYNAMIC_MEMORY
-	schc_rx_conns = NULL;
-	schc_tx_conns = NULL;
+	schc_ctx->rx_conns = NULL;
+	schc_ctx->tx_conns = NULL;
 #else
 	/* clear the schc rx connections */
 	for (i = 0; i < SCHC_CONF_RX_CONNS; i++) {
-		schc_reset(&schc_rx_conns[i]);
-		schc_rx_conns[i].frag_cnt = 0;
-		schc_rx_conns[i].window = 0;
-		schc_rx_conns[i].input = 0;
-		schc_rx_conns[i].dtag = -1;
-		schc_rx_conns[i].fragmentation_rule = NULL;
+		schc_reset(&schc_ctx->rx_conns[i]);
+		schc_ctx->rx_conns[i].frag_cnt = 0;
+		schc_ctx->rx_conns[i].window = 0;
+		schc_ctx->rx_conns[i].input = 0;
+		schc_ctx->rx_conns[i].dtag = -1;
+		schc_ctx->rx_conns[i].fragmentation_rule = NULL;
 	}
 	for(i = 0; i < SCHC_CONF_TX_CONNS; i++) {
 		/* clear the schc tx connections */
-		schc_reset(&schc_tx_conns[i]);
+		schc_reset(&schc_ctx->tx_conns[i]);
 	}
 #endif
 
 #if !DYNAMIC_MEMORY
-	/* initialize the mbuf pool */
+	/* initialize the mbuf pool and the fragment memory block */
+	schc_ctx->buf_ptr = 0;
 	for(i = 0; i < SCHC_CONF_MBUF_POOL_LEN; i++) {
-		MBUF_POOL[i].ptr = NULL;
-		MBUF_POOL[i].len = 0;
-		MBUF_POOL[i].next = NULL;
-		MBUF_POOL[i].offset = 0;
+		schc_ctx->mbuf_pool[i].ptr = NULL;
+		schc_ctx->mbuf_pool[i].len = 0;
+		schc_ctx->mbuf_pool[i].next = NULL;
+		schc_ctx->mbuf_pool[i].offset = 0;
 	}
 #endif
 
 	/* set callbacks */
-	memcpy(&default_conn, cb_conn, sizeof(schc_fragmentation_t));
+	memcpy(&schc_ctx->default_conn, cb_conn, sizeof(schc_fragmentation_t));
 
 	return 1;
 }
@@ -2323,8 +2357,10 @@ static void tx_fragment_resend(schc_fragmentation_t *tx_conn) {
 		}
 	}
 
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
 	DEBUG_PRINTF("schc_fragment(): sending missing fragments for bitmap: ");
 	print_bitmap(tx_conn->ack.bitmap, (tx_conn->fragmentation_rule->MAX_WND_FCN + 1));
+#endif
 	DEBUG_PRINTF("schc_fragment(): FCN=%d, window=%d, fragment counter=%d\n", tx_conn->fcn,
 			tx_conn->ack.window[0], tx_conn->frag_cnt);
 
@@ -2678,28 +2714,26 @@ schc_fragmentation_t* schc_input(uint8_t* data, uint16_t len, struct schc_device
  *
  */
 void schc_ack_input(uint8_t* data, schc_fragmentation_t* tx_conn) {
-	uint8_t bit_offset = tx_conn->device->profile->RULE_ID_SIZE;
+	uint8_t bitmap_len = (tx_conn->fragmentation_rule->MAX_WND_FCN + 1);
+	uint8_t bit_offset = tx_conn->device->profile->RULE_ID_SIZE + tx_conn->device->profile->DTAG_SIZE
+			+ tx_conn->fragmentation_rule->WINDOW_SIZE + MIC_C_SIZE_BITS;
 	tx_conn->input = 1;
 
+	schc_bitreader_t ack;
+	schc_bitreader_init(&ack, data, tx_conn->device->profile->RULE_ID_SIZE,
+			BITS_TO_BYTES(bit_offset + bitmap_len));
+
 	memset(tx_conn->ack.dtag, 0, DTAG_SIZE_BYTES); // clear dtag from prev reception
-	copy_bits(tx_conn->ack.dtag, (8 - tx_conn->device->profile->DTAG_SIZE), (uint8_t*) data,
-			bit_offset, tx_conn->device->profile->DTAG_SIZE); // get dtag
-	bit_offset += tx_conn->device->profile->DTAG_SIZE;
+	tx_conn->ack.dtag[0] = schc_bitreader_get(&ack, tx_conn->device->profile->DTAG_SIZE); // get dtag
 
 	memset(tx_conn->ack.window, 0, WINDOW_SIZE_BYTES); // clear window from prev reception
-	copy_bits(tx_conn->ack.window, (8 - tx_conn->fragmentation_rule->WINDOW_SIZE), (uint8_t*) data,
-			bit_offset, tx_conn->fragmentation_rule->WINDOW_SIZE); // get window
-	bit_offset += tx_conn->fragmentation_rule->WINDOW_SIZE;
+	tx_conn->ack.window[0] = schc_bitreader_get(&ack, tx_conn->fragmentation_rule->WINDOW_SIZE); // get window
 
-	uint8_t mic[1] = { 0 };
-	copy_bits(mic, 7, (uint8_t*) data, bit_offset, 1);
-	bit_offset += 1;
-	tx_conn->ack.mic = mic[0];
+	tx_conn->ack.mic = schc_bitreader_get(&ack, MIC_C_SIZE_BITS);
 
-	uint8_t bitmap_len = (tx_conn->fragmentation_rule->MAX_WND_FCN + 1);
 	memset(tx_conn->ack.bitmap, 0, BITMAP_SIZE_BYTES); // clear bitmap from prev reception
-
-	copy_bits(tx_conn->ack.bitmap, 0, (uint8_t*) data, bit_offset, bitmap_len);
+	schc_bitreader_get_array(&ack, tx_conn->ack.bitmap, 0, bitmap_len);
+	SCHC_TRACE_INFO(SCHC_EV_ACK_RX, tx_conn->ack.window[0], get_trace_bitmap(tx_conn->ack.bitmap, bitmap_len));
 
 	// uint8_t encoded_len = decode_bitmap(tx_conn, data); // todo
 
@@ -2749,22 +2783,23 @@ schc_fragmentation_t* schc_fragment_input(uint8_t* data, uint16_t len, struct sc
 	schc_fragmentation_t* conn = schc_set_rx_connection(device, dtag);
 
 	/* set the default callbacks */
-	if(default_conn.send == NULL || default_conn.end_rx == NULL || default_conn.remove_timer_entry == NULL || 
-		default_conn.post_timer_task == NULL || default_conn.dc == 0) {
+	const schc_fragmentation_t* cb_conn = &schc_ctx->default_conn;
+	if(cb_conn->send == NULL || cb_conn->end_rx == NULL || cb_conn->remove_timer_entry == NULL || 
+		cb_conn->post_timer_task == NULL || cb_conn->dc == 0) {
 		DEBUG_PRINTF("schc_fragment_input(): default callbacks not set\n");
 		return NULL;
 	}
-	conn->send 					= default_conn.send;
-	conn->end_rx 				= default_conn.end_rx;
-	conn->remove_timer_entry 	= default_conn.remove_timer_entry;
-	conn->post_timer_task 		= default_conn.post_timer_task;
-	conn->dc 					= default_conn.dc;
+	conn->send 					= cb_conn->send;
+	conn->end_rx 				= cb_conn->end_rx;
+	conn->remove_timer_entry 	= cb_conn->remove_timer_entry;
+	conn->post_timer_task 		= cb_conn->post_timer_task;
+	conn->dc 					= cb_conn->dc;
 #if DYNAMIC_MEMORY
-	if(default_conn.free_conn_cb == NULL) {
+	if(cb_conn->free_conn_cb == NULL) {
 		DEBUG_PRINTF("schc_fragment_input(): default callbacks not set\n");
 		return NULL;
 	}
-	conn->free_conn_cb 			= default_conn.free_conn_cb;
+	conn->free_conn_cb 			= cb_conn->free_conn_cb;
 #endif
 
 	conn->fragmentation_rule 	= get_fragmentation_rule_by_rule_id(data, device);
@@ -2778,9 +2813,9 @@ schc_fragmentation_t* schc_fragment_input(uint8_t* data, uint16_t len, struct sc
 #if DYNAMIC_MEMORY
 	fragment = (uint8_t*) malloc(len); /* allocate memory for fragment */
 #else
-	fragment = (uint8_t*) (schc_buf + buf_ptr); /* take fixed memory block */
-	buf_ptr += len;
-	if(buf_ptr > STATIC_MEMORY_BUFFER_LENGTH) {
+	fragment = (uint8_t*) (schc_ctx->buf + schc_ctx->buf_ptr); /* take fixed memory block */
+	schc_ctx->buf_ptr += len;
+	if(schc_ctx->buf_ptr > STATIC_MEMORY_BUFFER_LENGTH) {
 		/* todo implement ringbuffer */
 		DEBUG_PRINTF("schc_fragment_input(): no more memory available from pre-allocated memory block \n");
 		return NULL;
@@ -2791,7 +2826,10 @@ schc_fragmentation_t* schc_fragment_input(uint8_t* data, uint16_t len, struct sc
 
 	int8_t err = mbuf_push(&conn->head, fragment, len);
 
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
 	mbuf_print(conn->head);
+#endif
+	SCHC_TRACE_INFO(SCHC_EV_FRAGMENT_RX, dtag, len);
 
 	if(err != SCHC_SUCCESS) {
 		schc_free_connection(conn);
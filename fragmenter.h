@@ -100,7 +100,7 @@ struct schc_fragmentation_t {
 	void (*free_conn_cb)(struct schc_fragmentation_t *conn);
 #endif
 	/* the device id of the connection */
-	uint32_t device_id;
+	uint64_t device_id;
 	/* a pointer to the start of the unfragmented, compressed packet in a bit array */
 	schc_bitarray_t* bit_arr;
 	/* the start of the packet + the total length */
@@ -132,7 +132,7 @@ struct schc_fragmentation_t {
 	/* the current state for the receiving device */
 	rx_state RX_STATE;
 	/* the function to call when the fragmenter has something to send */
-	uint8_t (*send)(uint8_t* data, uint16_t length, uint32_t device_id);
+	uint8_t (*send)(uint8_t* data, uint16_t length, uint64_t device_id);
 	/* the timer task */
 	void (*post_timer_task)(struct schc_fragmentation_t *conn,
 			void (*timer_task)(void* arg), uint32_t time_ms, void *arg);
@@ -170,6 +170,32 @@ struct schc_fragmentation_t {
 	struct schc_device* device;
 };
 
+/*
+ * The mutable state of the fragmenter
+ * a thread works on the context it bound with schc_ctx_set(),
+ * the threads which did not bind a context share the default context
+ */
+typedef struct schc_ctx_t {
+	/* the buffer the fragments are formatted in */
+	uint8_t frag_buf[MAX_MTU_LENGTH];
+#if DYNAMIC_MEMORY
+	schc_fragmentation_t *rx_conns;
+	schc_fragmentation_t *tx_conns;
+#else
+	schc_fragmentation_t rx_conns[SCHC_CONF_RX_CONNS];
+	schc_fragmentation_t tx_conns[SCHC_CONF_TX_CONNS];
+	/* the memory block the received fragments are stored in */
+	uint32_t buf_ptr;
+	uint8_t buf[STATIC_MEMORY_BUFFER_LENGTH];
+	schc_mbuf_t mbuf_pool[SCHC_CONF_MBUF_POOL_LEN];
+#endif
+	/* the callbacks of the rx connections */
+	schc_fragmentation_t default_conn;
+} schc_ctx_t;
+
+schc_ctx_t* schc_ctx_get(void);
+void schc_ctx_set(schc_ctx_t* ctx);
+
 schc_fragmentation_t* schc_get_tx_connection(struct schc_device* device, int16_t dtag);
 schc_fragmentation_t* schc_set_tx_connection(struct schc_device* device, int16_t dtag);
 schc_fragmentation_t* schc_alloc_tx_connection(struct schc_device* device);
@@ -187,8 +213,8 @@ schc_fragmentation_t* schc_fragment_input(uint8_t* data, uint16_t len, struct sc
 int8_t schc_set_tile_size(schc_fragmentation_t* conn, uint16_t tile_size);
 int8_t schc_sender_abort(schc_fragmentation_t* conn);
 int8_t schc_receiver_abort(schc_fragmentation_t* conn);
-schc_fragmentation_t* schc_get_connection(uint32_t device_id);
-struct schc_fragmentation_rule_t* get_fragmentation_rule_by_reliability_mode(reliability_mode mode, uint32_t device_id);
+schc_fragmentation_t* schc_get_connection(uint64_t device_id);
+struct schc_fragmentation_rule_t* get_fragmentation_rule_by_reliability_mode(reliability_mode mode, uint64_t device_id);
 
 uint16_t get_mbuf_len(schc_fragmentation_t *conn);
 void mbuf_copy(schc_fragmentation_t *conn, uint8_t* ptr);
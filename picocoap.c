@@ -106,6 +106,83 @@ pcoap_error pcoap_validate_pkt(pcoap_pdu *pdu) //uint8_t *pkt, uint16_t pkt_len)
 	return CE_NONE;
 }
 
+pcoap_error pcoap_index_options(pcoap_pdu *pdu, pcoap_option_index *index)
+{
+	uint16_t offset, num = 0;
+
+	index->header_len = 0;
+	index->payload_len = 0;
+	index->count = 0;
+
+	if (pdu->len > pdu->max || pdu->len < 4)
+		return CE_INVALID_PACKET;
+
+	if (pcoap_get_version(pdu) != 1 || pcoap_get_tkl(pdu) > 8)
+		return CE_INVALID_PACKET;
+
+	offset = 4 + pcoap_get_tkl(pdu);
+	if (offset > pdu->len)
+		return CE_INVALID_PACKET;
+
+	while (offset < pdu->len) {
+		uint8_t *ptr = pdu->buf + offset;
+		uint16_t delta, length, ext = 0;
+
+		// Payload Marker
+		if (*ptr == 0xFF) {
+			offset++;
+			index->payload_len = pdu->len - offset;
+			break;
+		}
+
+		delta = *ptr >> 4;
+		length = *ptr & 0x0F;
+		if (delta == 15 || length == 15)
+			return CE_INVALID_PACKET;
+
+		// Extended Delta and Length
+		ext = (delta == 13) + 2 * (delta == 14) + (length == 13) + 2 * (length == 14);
+		if (offset + 1 + ext > pdu->len)
+			return CE_INVALID_PACKET;
+		ptr++;
+
+		if (delta == 13) {
+			delta = *ptr + 13;
+			ptr += 1;
+		} else if (delta == 14) {
+			delta = (*ptr << 8) + *(ptr+1) + 269;
+			ptr += 2;
+		}
+
+		if (length == 13) {
+			length = *ptr + 13;
+			ptr += 1;
+		} else if (length == 14) {
+			length = (*ptr << 8) + *(ptr+1) + 269;
+			ptr += 2;
+		}
+
+		offset = ptr - pdu->buf;
+		if (length > pdu->len - offset)
+			return CE_INVALID_PACKET;
+
+		if (index->count >= PCOAP_MAX_OPTIONS)
+			return CE_TOO_MANY_OPTIONS;
+
+		num += delta;
+		index->options[index->count].num = num;
+		index->options[index->count].offset = offset;
+		index->options[index->count].len = length;
+		index->count++;
+
+		offset += length;
+	}
+
+	index->header_len = offset;
+
+	return CE_NONE;
+}
+
 uint8_t pcoap_get_token(pcoap_pdu *pdu, uint8_t* ptr)
 {
 	uint8_t tkl;
@@ -469,6 +546,29 @@ pcoap_error pcoap_add_option(pcoap_pdu *pdu, int32_t opt_num, uint8_t* value, ui
 	return CE_NONE;
 }
 
+pcoap_error pcoap_append_option(pcoap_pdu *pdu, uint16_t last_num, uint16_t opt_num, uint8_t* value, uint16_t opt_len)
+{
+	int8_t nopt_hdr_len;
+
+	if (opt_num < last_num)
+		return CE_OUT_OF_ORDER_OPTIONS_LIST;
+
+	// Build New Header
+	nopt_hdr_len = pcoap_compute_option_header_len(opt_num - last_num, opt_len);
+
+	// Check that we were given enough buffer.
+	if (pdu->max < pdu->len + nopt_hdr_len + opt_len)
+		return CE_INSUFFICIENT_BUFFER;
+
+	// Insert the Header and the Value
+	pcoap_build_option_header(pdu->buf + pdu->len, nopt_hdr_len, opt_num - last_num, opt_len);
+	memcpy(pdu->buf + pdu->len + nopt_hdr_len, value, opt_len);
+
+	pdu->len += nopt_hdr_len + opt_len;
+
+	return CE_NONE;
+}
+
 pcoap_error pcoap_set_payload(pcoap_pdu *pdu, uint8_t *payload, uint16_t payload_len){
 	uint8_t *pkt_ptr, *fopt_val;
 	uint16_t fopt_num;
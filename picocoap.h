@@ -175,6 +175,36 @@ typedef struct pcoap_payload {
 	uint8_t *val;	/// pointer to buffer
 } pcoap_payload;
 
+///
+/// Maximum number of options in an option index
+///
+#ifndef PCOAP_MAX_OPTIONS
+#define PCOAP_MAX_OPTIONS	32
+#endif
+
+///
+/// Indexed Option
+///
+/// The position of an option value in the message buffer.
+///
+typedef struct pcoap_option_entry {
+	uint16_t num;		/// option number
+	uint16_t offset;	/// offset of the value from the start of the message
+	uint16_t len;		/// length of the value
+} pcoap_option_entry;
+
+///
+/// Option Index
+///
+/// The options of a message, decoded in a single pass over the buffer.
+///
+typedef struct pcoap_option_index {
+	uint16_t header_len;	/// length of the header, including the payload marker
+	uint16_t payload_len;	/// length of the payload
+	uint8_t count;			/// number of options
+	pcoap_option_entry options[PCOAP_MAX_OPTIONS];
+} pcoap_option_index;
+
 // Finds the length of the CoAP header
 // And consequently the length of the payload
 uint8_t pcoap_get_coap_offset(pcoap_pdu *pdu);
@@ -193,6 +223,20 @@ uint8_t pcoap_get_coap_offset(pcoap_pdu *pdu);
 ///
 pcoap_error pcoap_validate_pkt(pcoap_pdu *pdu);
 
+///
+/// Index Options
+///
+/// Validates the given packet and decodes the position of every option value,
+/// the header length and the payload length in a single pass.
+/// The values are not copied, they are read from the message buffer.
+/// A payload marker without payload is part of the header.
+/// @param  [in]  pdu    pointer to the coap message struct.
+/// @param  [out] index  pointer to the option index to fill.
+/// @return error code (CE_NONE == 0 == no error).
+/// @see    coap_error
+///
+pcoap_error pcoap_index_options(pcoap_pdu *pdu, pcoap_option_index *index);
+
 //
 // Getters
 //
@@ -393,6 +437,21 @@ pcoap_error pcoap_set_token(pcoap_pdu *pdu, uint8_t* token, uint8_t tkl);
 ///
 pcoap_error pcoap_add_option(pcoap_pdu *pdu, int32_t opt_num, uint8_t* value, uint16_t opt_len);
 
+///
+/// Append Message Option
+///
+/// Writes an option header and value at the end of the message, without
+/// walking the options already present. The options must be appended in
+/// order of option number and before the payload is set.
+/// @param  [in, out] pdu       pointer to the coap message struct.
+/// @param  [in]      last_num  number of the last option in the message, 0 for the first option.
+/// @param  [in]      opt_num   option number.
+/// @param  [in]      value     pointer to the option value.
+/// @param  [in]      opt_len   length of the option value.
+/// @return coap_error (0 == no error)
+///
+pcoap_error pcoap_append_option(pcoap_pdu *pdu, uint16_t last_num, uint16_t opt_num, uint8_t* value, uint16_t opt_len);
+
 ///
 /// Add Message Option
 ///
@@ -0,0 +1,12 @@
+/*
+ * (c) 2018 - idlab - UGent - imec
+ *
+ * Bart Moons
+ *
+ * This file is part of the SCHC stack implementation
+ *
+ * Adjust this file to taste to include rules
+ *
+ */
+
+#include "rules_example.h"
@@ -69,6 +69,26 @@ const static struct schc_ipv6_rule_t ipv6_rule3 = {
 						&mo_MSB, 		LSB},
 		}
 };
+
+const static struct schc_ipv6_rule_t ipv6_rule4 = {
+	//	id, up, down, length
+		10, 10, 10,
+		{
+			//	field, 			MO, len, pos,dir, 	val,			MO,				CDA
+				{ IP6_V,	 	0, 4,	1, BI, 		{6},			&mo_equal, 		NOTSENT },
+				{ IP6_TC, 		0, 8,	1, BI, 		{0},			&mo_equal, 		NOTSENT },
+				{ IP6_FL, 		0, 20,	1, BI, 		{0, 0, 0},		&mo_equal, 		NOTSENT },
+				{ IP6_LEN, 		0, 16,	1, BI, 		{0, 0},			&mo_ignore, 	COMPLENGTH },
+				{ IP6_NH, 		0, 8, 	1, BI, 		{17},			&mo_equal, 		NOTSENT },
+				{ IP6_HL, 		0, 8, 	1, BI, 		{64}, 			&mo_equal, 		NOTSENT },
+				{ IP6_DEVPRE,	0, 64,	1, BI,		{0xBB, 0xBB, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+						&mo_equal, 		NOTSENT },
+				{ IP6_DEVIID,	0, 64,	1, BI, 		{0},			&mo_ignore, 	DEVIID }, // derived from dev_l2_id
+				{ IP6_APPPRE,	0, 64,	1, BI,		{0xAA, 0xAA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+						&mo_equal, 		NOTSENT },
+				{ IP6_APPIID,	0, 64,	1, BI, 		{0},			&mo_ignore, 	APPIID }, // derived from app_l2_id
+		}
+};
 #endif
 
 #if USE_UDP
@@ -105,6 +125,16 @@ const static struct schc_udp_rule_t udp_rule3 = {
 				{ UDP_CHK, 		0, 	16,	 1, BI, 	{0, 0},				&mo_ignore,	COMPCHK },
 		}
 };
+
+const static struct schc_udp_rule_t udp_rule4 = {
+		4, 4, 4,
+		{
+				{ UDP_DEV, 		0,	16,	 1, BI, 	{0, 0}, 			&mo_ignore,		VALUESENT },
+				{ UDP_APP, 		0, 	16,	 1, BI, 	{0, 0}, 			&mo_ignore,		VALUESENT },
+				{ UDP_LEN, 		0, 	16,	 1, BI, 	{0, 0},				&mo_ignore,	COMPLENGTH },
+				{ UDP_CHK, 		0, 	16,	 1, BI, 	{0, 0},				&mo_ignore,	COMPCHK },
+		}
+};
 #endif
 
 #if USE_COAP
@@ -223,6 +253,47 @@ const struct schc_compression_rule_t compression_rule_4 = {
 #endif
 };
 
+const struct schc_compression_rule_t compression_rule_5 = {
+		.rule_id = 0x05,
+#if USE_IP6
+		&ipv6_rule1,
+#endif
+#if USE_UDP
+		&udp_rule3,
+#endif
+#if USE_COAP
+		&coap_rule1,
+#endif
+};
+
+/* sends the ports as is, it is matched before rule 1 */
+const struct schc_compression_rule_t compression_rule_6 = {
+		.rule_id = 0x06,
+#if USE_IP6
+		&ipv6_rule1,
+#endif
+#if USE_UDP
+		&udp_rule4,
+#endif
+#if USE_COAP
+		&coap_rule1,
+#endif
+};
+
+/* the interface identifiers are derived from the L2 identifiers of the device */
+const struct schc_compression_rule_t compression_rule_7 = {
+		.rule_id = 0x07,
+#if USE_IP6
+		&ipv6_rule4,
+#endif
+#if USE_UDP
+		&udp_rule1,
+#endif
+#if USE_COAP
+		&coap_rule1,
+#endif
+};
+
 /* now build the fragmentation rules */
 const struct schc_fragmentation_rule_t fragmentation_rule_1 = {
 		.rule_id = 0x01,
@@ -289,7 +360,8 @@ const struct schc_profile_t profile_dtag = {
 
 /* save compression rules in flash */
 const struct schc_compression_rule_t* node1_compression_rules[] = {
-		&compression_rule_1, &compression_rule_2, &compression_rule_3, &compression_rule_4
+		&compression_rule_6, &compression_rule_1, &compression_rule_2, &compression_rule_3,
+		&compression_rule_4, &compression_rule_5, &compression_rule_7
 };
 
 /* save fragmentation rules in flash */
@@ -300,15 +372,17 @@ const struct schc_fragmentation_rule_t* node1_fragmentation_rules[] = {
 /* now build the context for a particular device */
 const struct schc_device node1 = {
 		.device_id = 0x06,
-		.compression_rule_count = 4,
+		.compression_rule_count = 7,
 		.compression_context = &node1_compression_rules,
 		.fragmentation_rule_count = 4,
 		.fragmentation_context = &node1_fragmentation_rules,
-		.profile = &profile_lorawan
+		.profile = &profile_lorawan,
+		.dev_l2_id = 0x0000000000000006, /* IID 0200:0000:0000:0006 */
+		.app_l2_id = 0x0000000000000001 /* IID 0200:0000:0000:0001 */
 };
 const struct schc_device node2 = {
 		.device_id = 0x01,
-		.compression_rule_count = 4,
+		.compression_rule_count = 7,
 		.compression_context = &node1_compression_rules,
 		.fragmentation_rule_count = 4,
 		.fragmentation_context = &node1_fragmentation_rules,
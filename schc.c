@@ -7,10 +7,515 @@
  *
  */
 
+#include <string.h>
+
 #include "schc.h"
 #include "bit_operations.h"
 #include "rules/rule_config.h"
 
+#if SCHC_RULE_STORE == 1 && SCHC_RULE_STORE_MMAP == 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if SCHC_DEVICE_TABLE == 1
+/*
+ * Open addressing hash table on the device id, with room for twice the number of devices
+ * a slot holds the device index + 1, 0 marks a free slot
+ */
+#define DEVICE_TABLE_SLOTS		(2 * DEVICE_COUNT + 1)
+
+static uint32_t device_table[DEVICE_TABLE_SLOTS];
+static uint8_t device_table_ready;
+
+static uint32_t device_table_hash(uint64_t device_id) {
+	/* mix all bits of the id, EUIs of a batch share most of their bytes */
+	device_id ^= device_id >> 33;
+	device_id *= 0xFF51AFD7ED558CCDULL;
+	device_id ^= device_id >> 33;
+	device_id *= 0xC4CEB9FE1A85EC53ULL;
+	device_id ^= device_id >> 33;
+
+	return (uint32_t) (device_id % DEVICE_TABLE_SLOTS);
+}
+
+/*
+ * Build the device table
+ * if a device id is used twice, the first device in the list is found
+ */
+static void device_table_init(void) {
+	uint32_t i;
+
+	memset(device_table, 0, sizeof(device_table));
+	for (i = 0; i < DEVICE_COUNT; i++) {
+		uint32_t slot = device_table_hash(devices[i]->device_id);
+		while (device_table[slot] != 0) {
+			if (devices[device_table[slot] - 1]->device_id == devices[i]->device_id) {
+				break;
+			}
+			slot = (slot + 1) % DEVICE_TABLE_SLOTS;
+		}
+		if (device_table[slot] == 0) {
+			device_table[slot] = i + 1;
+		}
+	}
+	device_table_ready = 1;
+}
+#endif
+
+#if SCHC_RULE_STORE == 1
+/*
+ * The rule store holds the rules shared by a set of devices as a context, and the devices with their context.
+ * The store is checked as a whole at load, the rules and contexts are copied to the pools,
+ * each context as a device without device id, and the devices to an array in device id order.
+ * A device is found with a binary search on its id, the devices keep their address until the store is closed.
+ */
+#define STORE_MAX(_a, _b)		((_a) > (_b) ? (_a) : (_b))
+#define STORE_LAYER_FIELDS		STORE_MAX(STORE_MAX(IP6_FIELDS, UDP_FIELDS), COAP_FIELDS)
+
+/* a layer rule with room for the fields of any layer, laid out as the rules of the layers */
+typedef struct store_layer_rule_t {
+	uint8_t up;
+	uint8_t down;
+	uint8_t length;
+	struct schc_field content[STORE_LAYER_FIELDS];
+} store_layer_rule_t;
+
+static const uint32_t store_record_sizes[SCHC_STORE_SECTIONS] = {
+		[SCHC_STORE_PROFILES] = 4,
+		[SCHC_STORE_FIELDS] = 0, /* SCHC_STORE_FIELD_SIZE() of the target value bytes in the header */
+		[SCHC_STORE_LAYER_RULES] = 8,
+		[SCHC_STORE_COMPRESSION_RULES] = 16,
+		[SCHC_STORE_FRAGMENTATION_RULES] = 20,
+		[SCHC_STORE_CONTEXTS] = 12,
+		[SCHC_STORE_RULE_REFS] = 4,
+		[SCHC_STORE_DEVICES] = 32 };
+
+static store_layer_rule_t store_layer_rules[SCHC_RULE_STORE_LAYER_RULES];
+static uint8_t store_layers[SCHC_RULE_STORE_LAYER_RULES];
+static struct schc_compression_rule_t store_compression_rules[SCHC_RULE_STORE_COMPRESSION_RULES];
+static struct schc_fragmentation_rule_t store_fragmentation_rules[SCHC_RULE_STORE_FRAGMENTATION_RULES];
+static struct schc_profile_t store_profiles[SCHC_RULE_STORE_CONTEXTS];
+static const struct schc_compression_rule_t* store_compression_refs[SCHC_RULE_STORE_RULE_REFS];
+static const struct schc_fragmentation_rule_t* store_fragmentation_refs[SCHC_RULE_STORE_RULE_REFS];
+static struct schc_device store_contexts[SCHC_RULE_STORE_CONTEXTS];
+static uint32_t store_context_count;
+static struct schc_device* store_devices;
+static uint32_t store_device_count;
+#if SCHC_RULE_STORE_MMAP == 1
+static size_t store_devices_length;
+#else
+static struct schc_device store_device_pool[SCHC_RULE_STORE_DEVICES];
+#endif
+
+static uint16_t store_get_u16(const uint8_t* ptr) {
+	return (uint16_t) (ptr[0] | (ptr[1] << 8));
+}
+
+static uint32_t store_get_u32(const uint8_t* ptr) {
+	return (uint32_t) ptr[0] | ((uint32_t) ptr[1] << 8) | ((uint32_t) ptr[2] << 16) | ((uint32_t) ptr[3] << 24);
+}
+
+static uint64_t store_get_u64(const uint8_t* ptr) {
+	return (uint64_t) store_get_u32(ptr) | ((uint64_t) store_get_u32(ptr + 4) << 32);
+}
+
+/*
+ * Get the number of fields a rule of a layer can hold
+ * 0 if the layer is not compiled in
+ */
+static uint8_t store_layer_field_count(uint8_t layer) {
+	switch (layer) {
+#if USE_IP6 == 1
+	case SCHC_IPV6:
+		return IP6_FIELDS;
+#endif
+#if USE_UDP == 1
+	case SCHC_UDP:
+		return UDP_FIELDS;
+#endif
+#if USE_COAP == 1
+	case SCHC_COAP:
+		return COAP_FIELDS;
+#endif
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Check and copy a field of a layer rule
+ *
+ * @return 0 if the field is not valid
+ */
+static uint8_t store_load_field(struct schc_field* field, const uint8_t* record, uint8_t value_bytes) {
+	static uint8_t (* const mo[])(struct schc_field*, unsigned char*, uint16_t) = {
+			[SCHC_STORE_MO_EQUAL] = &mo_equal,
+			[SCHC_STORE_MO_IGNORE] = &mo_ignore,
+			[SCHC_STORE_MO_MSB] = &mo_MSB,
+			[SCHC_STORE_MO_MATCHMAP] = &mo_matchmap };
+
+	field->field = store_get_u16(record);
+	field->MO_param_length = record[2];
+	field->field_length = record[3];
+	field->field_pos = record[4];
+	if (record[5] > BI || record[6] > SCHC_STORE_MO_MATCHMAP || record[7] > APPIID) {
+		return 0;
+	}
+	if (record[6] == SCHC_STORE_MO_MSB && field->MO_param_length > field->field_length) {
+		return 0;
+	}
+	if (record[6] != SCHC_STORE_MO_MATCHMAP && BITS_TO_BYTES(field->field_length) > value_bytes) {
+		return 0;
+	}
+	/* the list entries take a byte each, or the bytes of the field if it is byte aligned */
+	if (record[6] == SCHC_STORE_MO_MATCHMAP && !(field->field_length % 8)
+			&& (field->MO_param_length * (field->field_length / 8)) > value_bytes) {
+		return 0;
+	}
+	if (record[6] == SCHC_STORE_MO_MATCHMAP && (field->field_length % 8) && field->MO_param_length > value_bytes) {
+		return 0;
+	}
+	field->dir = (direction) record[5];
+	field->MO = mo[record[6]];
+	field->action = (CDA) record[7];
+	memset(field->target_value, 0, MAX_FIELD_LENGTH);
+	memcpy(field->target_value, record + 8, value_bytes);
+
+	return 1;
+}
+
+/*
+ * Get the layer rule of a layer rule index
+ *
+ * @return 0 if the index does not refer to a layer rule of this layer
+ */
+static uint8_t store_get_layer_rule(uint32_t index, uint8_t layer, uint32_t layer_rule_count, const void** rule) {
+	*rule = NULL;
+	if (index == SCHC_STORE_NO_RULE) {
+		return 1;
+	}
+	if (index >= layer_rule_count || store_layers[index] != layer) {
+		return 0;
+	}
+	*rule = &store_layer_rules[index];
+
+	return 1;
+}
+
+/*
+ * Check a fragmentation rule
+ */
+static uint8_t store_fragmentation_rule_valid(const struct schc_fragmentation_rule_t* rule) {
+	return (rule->mode >= ACK_ALWAYS && rule->mode < MAX_RELIABILITY_MODES && rule->dir <= BI
+			&& rule->RCS_SIZE_BYTES <= MAX_RCS_SIZE_BYTES && rule->WINDOW_SIZE <= BYTES_TO_BITS(WINDOW_SIZE_BYTES));
+}
+
+/*
+ * Allocate the device array of the store
+ */
+static struct schc_device* store_alloc_devices(uint32_t count) {
+#if SCHC_RULE_STORE_MMAP == 1
+	/* the pages of the array are only backed once written */
+	store_devices_length = (size_t) count * sizeof(struct schc_device);
+	if (store_devices_length == 0) {
+		return NULL;
+	}
+	void* ptr = mmap(NULL, store_devices_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		store_devices_length = 0;
+		return NULL;
+	}
+
+	return (struct schc_device*) ptr;
+#else
+	if (count > SCHC_RULE_STORE_DEVICES) {
+		return NULL;
+	}
+
+	return store_device_pool;
+#endif
+}
+
+/**
+ * Close the rule store, the devices of the store are no longer found
+ * call schc_compressor_init() again before compressing packets
+ *
+ */
+void schc_store_close(void) {
+#if SCHC_RULE_STORE_MMAP == 1
+	if (store_devices_length) {
+		munmap(store_devices, store_devices_length);
+		store_devices_length = 0;
+	}
+#endif
+	store_devices = NULL;
+	store_device_count = 0;
+	store_context_count = 0;
+}
+
+/**
+ * Load the devices and rules of a rule store
+ * the store is checked and copied, so it is no longer needed after loading
+ * the rule ids of each context are revised as by rm_revise_rule_context()
+ * load the store before schc_compressor_init(), a store that was loaded before is closed
+ *
+ * @param store 		the store
+ * @param length		the length of the store in bytes
+ *
+ * @return 0 			the store is not valid, no devices are loaded
+ *         1			the store is loaded
+ *
+ */
+uint8_t schc_store_load(const uint8_t* store, uint32_t length) {
+	uint32_t offset[SCHC_STORE_SECTIONS], count[SCHC_STORE_SECTIONS];
+	uint32_t i, j;
+
+	schc_store_close();
+	if (length < SCHC_STORE_HEADER_LENGTH || store_get_u32(store) != SCHC_STORE_MAGIC
+			|| store_get_u16(store + 4) != SCHC_STORE_VERSION || store_get_u16(store + 6) != SCHC_STORE_HEADER_LENGTH
+			|| store_get_u32(store + 8) != length) {
+		DEBUG_PRINTF("schc_store_load(): not a store of version %d\n", SCHC_STORE_VERSION);
+		return 0;
+	}
+	uint8_t value_bytes = store[16];
+	if (value_bytes > MAX_FIELD_LENGTH) {
+		DEBUG_PRINTF("schc_store_load(): the target values of %d bytes exceed MAX_FIELD_LENGTH\n", value_bytes);
+		return 0;
+	}
+
+	/* the records of each section are inside the store */
+	for (i = 0; i < SCHC_STORE_SECTIONS; i++) {
+		uint32_t size = (i == SCHC_STORE_FIELDS) ? SCHC_STORE_FIELD_SIZE(value_bytes) : store_record_sizes[i];
+		offset[i] = store_get_u32(store + 20 + 8 * i);
+		count[i] = store_get_u32(store + 24 + 8 * i);
+		if (offset[i] < SCHC_STORE_HEADER_LENGTH || (offset[i] & 3)
+				|| ((uint64_t) offset[i] + (uint64_t) count[i] * size) > length) {
+			DEBUG_PRINTF("schc_store_load(): section %d exceeds the store\n", i);
+			return 0;
+		}
+	}
+	if (count[SCHC_STORE_PROFILES] > SCHC_RULE_STORE_CONTEXTS
+			|| count[SCHC_STORE_LAYER_RULES] > SCHC_RULE_STORE_LAYER_RULES
+			|| count[SCHC_STORE_COMPRESSION_RULES] > SCHC_RULE_STORE_COMPRESSION_RULES
+			|| count[SCHC_STORE_FRAGMENTATION_RULES] > SCHC_RULE_STORE_FRAGMENTATION_RULES
+			|| count[SCHC_STORE_CONTEXTS] > SCHC_RULE_STORE_CONTEXTS
+			|| count[SCHC_STORE_RULE_REFS] > SCHC_RULE_STORE_RULE_REFS) {
+		DEBUG_PRINTF("schc_store_load(): the rules exceed the SCHC_RULE_STORE pools\n");
+		return 0;
+	}
+
+	uint32_t checksum = 0x811C9DC5;
+	for (i = SCHC_STORE_HEADER_LENGTH; i < length; i++) {
+		checksum = (checksum ^ store[i]) * 0x01000193;
+	}
+	if (checksum != store_get_u32(store + 12)) {
+		DEBUG_PRINTF("schc_store_load(): checksum mismatch\n");
+		return 0;
+	}
+
+	const uint8_t* record = store + offset[SCHC_STORE_PROFILES];
+	for (i = 0; i < count[SCHC_STORE_PROFILES]; i++, record += 4) {
+		store_profiles[i].RULE_ID_SIZE = record[0];
+		store_profiles[i].UNCOMPRESSED_RULE_ID = record[1];
+		store_profiles[i].DTAG_SIZE = record[2];
+		if (record[0] == 0 || record[0] > BYTES_TO_BITS(RULE_SIZE_BYTES) || record[2] > BYTES_TO_BITS(DTAG_SIZE_BYTES)) {
+			DEBUG_PRINTF("schc_store_load(): profile %d is not valid\n", i);
+			return 0;
+		}
+	}
+
+	record = store + offset[SCHC_STORE_LAYER_RULES];
+	for (i = 0; i < count[SCHC_STORE_LAYER_RULES]; i++, record += 8) {
+		store_layer_rule_t* rule = &store_layer_rules[i];
+		uint32_t first = store_get_u32(record + 4);
+		store_layers[i] = record[0];
+		rule->up = record[1];
+		rule->down = record[2];
+		rule->length = record[3];
+		if (rule->length > store_layer_field_count(record[0]) || rule->up > rule->length || rule->down > rule->length
+				|| ((uint64_t) first + rule->length) > count[SCHC_STORE_FIELDS]) {
+			DEBUG_PRINTF("schc_store_load(): layer rule %d is not valid\n", i);
+			return 0;
+		}
+		const uint8_t* field = store + offset[SCHC_STORE_FIELDS] + first * SCHC_STORE_FIELD_SIZE(value_bytes);
+		for (j = 0; j < rule->length; j++, field += SCHC_STORE_FIELD_SIZE(value_bytes)) {
+			if (!store_load_field(&rule->content[j], field, value_bytes)) {
+				DEBUG_PRINTF("schc_store_load(): field %d of layer rule %d is not valid\n", j, i);
+				return 0;
+			}
+		}
+	}
+
+	record = store + offset[SCHC_STORE_COMPRESSION_RULES];
+	for (i = 0; i < count[SCHC_STORE_COMPRESSION_RULES]; i++, record += 16) {
+		struct schc_compression_rule_t* rule = &store_compression_rules[i];
+		const void* layer_rule[3];
+		uint8_t valid = 1;
+		schc_layer_t layer;
+		rule->rule_id = store_get_u32(record);
+		for (layer = SCHC_IPV6; layer <= SCHC_COAP; layer++) {
+			valid &= store_get_layer_rule(store_get_u32(record + 4 + 4 * layer), layer,
+					count[SCHC_STORE_LAYER_RULES], &layer_rule[layer]);
+		}
+		if (!valid) {
+			DEBUG_PRINTF("schc_store_load(): compression rule %d refers to no layer rule of its layer\n", i);
+			return 0;
+		}
+#if USE_IP6 == 1
+		rule->ipv6_rule = (const struct schc_ipv6_rule_t*) layer_rule[SCHC_IPV6];
+#endif
+#if USE_UDP == 1
+		rule->udp_rule = (const struct schc_udp_rule_t*) layer_rule[SCHC_UDP];
+#endif
+#if USE_COAP == 1
+		rule->coap_rule = (const struct schc_coap_rule_t*) layer_rule[SCHC_COAP];
+#endif
+	}
+
+	record = store + offset[SCHC_STORE_FRAGMENTATION_RULES];
+	for (i = 0; i < count[SCHC_STORE_FRAGMENTATION_RULES]; i++, record += 20) {
+		struct schc_fragmentation_rule_t* rule = &store_fragmentation_rules[i];
+		rule->rule_id = store_get_u32(record);
+		rule->inactivity_timer_ms = store_get_u32(record + 4);
+		rule->retransmission_timer_ms = store_get_u32(record + 8);
+		rule->tile_size = store_get_u16(record + 12);
+		rule->mode = (reliability_mode) record[14];
+		rule->dir = (direction) record[15];
+		rule->FCN_SIZE = record[16];
+		rule->MAX_WND_FCN = record[17];
+		rule->WINDOW_SIZE = record[18];
+		rule->RCS_SIZE_BYTES = record[19];
+		if (!store_fragmentation_rule_valid(rule)) {
+			DEBUG_PRINTF("schc_store_load(): fragmentation rule %d is not valid\n", i);
+			return 0;
+		}
+	}
+
+	/* the rule references of the contexts are copied in order, as the arrays of the contexts */
+	const uint8_t* refs = store + offset[SCHC_STORE_RULE_REFS];
+	uint32_t compression_refs = 0, fragmentation_refs = 0;
+	record = store + offset[SCHC_STORE_CONTEXTS];
+	for (i = 0; i < count[SCHC_STORE_CONTEXTS]; i++, record += 12) {
+		struct schc_device* context = &store_contexts[i];
+		uint32_t first = store_get_u32(record + 4);
+		uint16_t profile = store_get_u16(record + 8);
+		memset(context, 0, sizeof(struct schc_device));
+		context->uncomp_rule_id = store_get_u32(record);
+		context->compression_rule_count = record[10];
+		context->fragmentation_rule_count = record[11];
+		if (profile >= count[SCHC_STORE_PROFILES]
+				|| ((uint64_t) first + record[10] + record[11]) > count[SCHC_STORE_RULE_REFS]) {
+			DEBUG_PRINTF("schc_store_load(): context %d is not valid\n", i);
+			return 0;
+		}
+		context->profile = &store_profiles[profile];
+		context->compression_context = (const struct schc_compression_rule_t *(*)[]) &store_compression_refs[compression_refs];
+		context->fragmentation_context = (const struct schc_fragmentation_rule_t *(*)[]) &store_fragmentation_refs[fragmentation_refs];
+		for (j = 0; j < context->compression_rule_count; j++) {
+			uint32_t index = store_get_u32(refs + 4 * (first + j));
+			if (index >= count[SCHC_STORE_COMPRESSION_RULES]) {
+				DEBUG_PRINTF("schc_store_load(): context %d refers to no compression rule\n", i);
+				return 0;
+			}
+			/* as rm_revise_rule_context(), the uncompressed rule id is not used for other rules */
+			if (store_compression_rules[index].rule_id == context->uncomp_rule_id) {
+				DEBUG_PRINTF("schc_store_load(): context %d uses uncompressed rule id=%" PRIu32 "\n", i, context->uncomp_rule_id);
+				return 0;
+			}
+			store_compression_refs[compression_refs++] = &store_compression_rules[index];
+		}
+		for (j = 0; j < context->fragmentation_rule_count; j++) {
+			uint32_t index = store_get_u32(refs + 4 * (first + context->compression_rule_count + j));
+			if (index >= count[SCHC_STORE_FRAGMENTATION_RULES]) {
+				DEBUG_PRINTF("schc_store_load(): context %d refers to no fragmentation rule\n", i);
+				return 0;
+			}
+			store_fragmentation_refs[fragmentation_refs++] = &store_fragmentation_rules[index];
+		}
+	}
+
+	store_devices = store_alloc_devices(count[SCHC_STORE_DEVICES]);
+	if (store_devices == NULL && count[SCHC_STORE_DEVICES] > 0) {
+		DEBUG_PRINTF("schc_store_load(): no room for %" PRIu32 " devices\n", count[SCHC_STORE_DEVICES]);
+		return 0;
+	}
+	record = store + offset[SCHC_STORE_DEVICES];
+	for (i = 0; i < count[SCHC_STORE_DEVICES]; i++, record += 32) {
+		uint64_t device_id = store_get_u64(record);
+		uint32_t context = store_get_u32(record + 24);
+		if (context >= count[SCHC_STORE_CONTEXTS] || (i > 0 && device_id <= store_devices[i - 1].device_id)) {
+			DEBUG_PRINTF("schc_store_load(): device %02" PRIu64 " is not valid or not in device id order\n", device_id);
+			schc_store_close();
+			return 0;
+		}
+		store_devices[i] = store_contexts[context];
+		store_devices[i].device_id = device_id;
+		store_devices[i].dev_l2_id = store_get_u64(record + 8);
+		store_devices[i].app_l2_id = store_get_u64(record + 16);
+	}
+	store_device_count = count[SCHC_STORE_DEVICES];
+	store_context_count = count[SCHC_STORE_CONTEXTS];
+
+	return 1;
+}
+
+#if SCHC_RULE_STORE_MMAP == 1
+/**
+ * Load the devices and rules of a rule store file, see schc_store_load()
+ * the file is mapped while it is loaded
+ *
+ * @param path 			the path of the store
+ *
+ * @return 0 			the store could not be read or is not valid
+ *         1			the store is loaded
+ *
+ */
+uint8_t schc_store_open(const char* path) {
+	struct stat st;
+	uint8_t ret = 0;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		DEBUG_PRINTF("schc_store_open(): could not open %s\n", path);
+		return 0;
+	}
+	if (fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t) st.st_size <= UINT32_MAX) {
+		void* ptr = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr != MAP_FAILED) {
+			ret = schc_store_load((const uint8_t*) ptr, (uint32_t) st.st_size);
+			munmap(ptr, (size_t) st.st_size);
+		}
+	}
+	close(fd);
+
+	return ret;
+}
+#endif
+
+/*
+ * Find a device of the store with a binary search on its id
+ */
+static struct schc_device* store_get_device(uint64_t device_id) {
+	uint32_t low = 0, high = store_device_count;
+
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		if (store_devices[mid].device_id < device_id) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	if (low < store_device_count && store_devices[low].device_id == device_id) {
+		return &store_devices[low];
+	}
+
+	return NULL;
+}
+#endif
+
 /**
  * Get a device by it's id
  *
@@ -20,20 +525,285 @@
  *         NULL			if no device was found
  *
  */
-struct schc_device* get_device_by_id(uint32_t device_id) {
-	int i = 0;
+struct schc_device* get_device_by_id(uint64_t device_id) {
+#if SCHC_DEVICE_TABLE == 1
+	if (!device_table_ready) {
+		device_table_init();
+	}
+
+	uint32_t slot = device_table_hash(device_id);
+	while (device_table[slot] != 0) {
+		const struct schc_device* device = devices[device_table[slot] - 1];
+		if (device->device_id == device_id) {
+			return (struct schc_device*) device;
+		}
+		slot = (slot + 1) % DEVICE_TABLE_SLOTS;
+	}
+#else
+	uint32_t i = 0;
 
 	for (i = 0; i < DEVICE_COUNT; i++) {
 		if (devices[i]->device_id == device_id) {
 			return (struct schc_device*) devices[i];
 		}
 	}
+#endif
 
+#if SCHC_RULE_STORE == 1
+	return store_get_device(device_id);
+#else
 	return NULL;
+#endif
+}
+
+/**
+ * Get a device by it's index in the device list
+ *
+ * @param index 		the index of the device
+ *
+ * @return schc_device 	the device at this index
+ *         NULL			if the index is out of range
+ *
+ */
+struct schc_device* get_device_by_index(uint32_t index) {
+	if (index >= DEVICE_COUNT) {
+		return NULL;
+	}
+
+	return (struct schc_device*) devices[index];
 }
 
 /**
- * Revise the rules for all devices
+ * Get a rule context by it's index
+ * these are the devices in the device list, followed by the contexts of the rule store,
+ * a context is a device without device id, with the rules of the devices of this context
+ *
+ * @param index 		the index of the context
+ *
+ * @return schc_device 	the device or context at this index
+ *         NULL			if the index is out of range
+ *
+ */
+struct schc_device* get_context_by_index(uint32_t index) {
+	if (index < DEVICE_COUNT) {
+		return (struct schc_device*) devices[index];
+	}
+#if SCHC_RULE_STORE == 1
+	if ((index - DEVICE_COUNT) < store_context_count) {
+		return &store_contexts[index - DEVICE_COUNT];
+	}
+#endif
+
+	return NULL;
+}
+
+/*
+ * Get the bits a rule id is sent with
+ * the rule id is compared as it is copied to the packet, i.e. from its little endian bytes
+ */
+static uint32_t get_rule_id_key(uint32_t rule_id, uint8_t rule_id_size) {
+	uint8_t rule_id_arr[4] = { 0 };
+	little_end_uint8_from_uint32(rule_id_arr, rule_id);
+
+	return get_bits(rule_id_arr, get_position_in_first_byte(rule_id_size), rule_id_size);
+}
+
+#if SCHC_RULE_ID_TABLE == 1
+/*
+ * The rule ids of a device are indexed at init.
+ * Rule ids up to SCHC_RULE_ID_DIRECT_BITS bits index a table of 2^RULE_ID_SIZE entries,
+ * longer rule ids are looked up in an open addressing hash table.
+ * Devices sharing their rules and profile share the table.
+ */
+#define RULE_ID_NONE			0xFF
+
+typedef struct rule_id_entry_t {
+	uint32_t key;
+	/* the index of the compression and the fragmentation rule, RULE_ID_NONE if there is none */
+	uint8_t compression;
+	uint8_t fragmentation;
+} rule_id_entry_t;
+
+typedef struct rule_id_table_t {
+	const void* compression_context;
+	const void* fragmentation_context;
+	uint8_t compression_rule_count;
+	uint8_t fragmentation_rule_count;
+	uint8_t rule_id_size;
+	uint8_t direct;
+	uint32_t first;
+	uint32_t slots;
+} rule_id_table_t;
+
+static rule_id_table_t rule_id_tables[SCHC_RULE_ID_TABLES];
+static uint8_t rule_id_table_count;
+static rule_id_entry_t rule_id_entries[SCHC_RULE_ID_ENTRIES];
+static uint32_t rule_id_entry_count;
+static uint8_t rule_id_tables_ready;
+
+static uint8_t rule_id_table_uses(const rule_id_table_t* table, const struct schc_device* device) {
+	return (table->compression_context == (const void*) device->compression_context
+			&& table->fragmentation_context == (const void*) device->fragmentation_context
+			&& table->compression_rule_count == device->compression_rule_count
+			&& table->fragmentation_rule_count == device->fragmentation_rule_count
+			&& table->rule_id_size == device->profile->RULE_ID_SIZE);
+}
+
+/*
+ * Get the entry for a rule id
+ * for the hash table, a free slot is returned if the rule id is not in the table
+ */
+static rule_id_entry_t* rule_id_table_entry(const rule_id_table_t* table, uint32_t key) {
+	if (table->direct) {
+		return &rule_id_entries[table->first + key];
+	}
+
+	uint32_t slot = (key * 2654435761u) % table->slots;
+	while (rule_id_entries[table->first + slot].compression != RULE_ID_NONE
+			|| rule_id_entries[table->first + slot].fragmentation != RULE_ID_NONE) {
+		if (rule_id_entries[table->first + slot].key == key) {
+			break;
+		}
+		slot = (slot + 1) % table->slots;
+	}
+
+	return &rule_id_entries[table->first + slot];
+}
+
+/*
+ * Build the rule id table of a device
+ * if a rule id is used twice, the first rule in the list is found
+ */
+static void rule_id_table_add(const struct schc_device* device) {
+	uint8_t i;
+
+	for (i = 0; i < rule_id_table_count; i++) {
+		if (rule_id_table_uses(&rule_id_tables[i], device)) {
+			return;
+		}
+	}
+
+	uint8_t rule_id_size = device->profile->RULE_ID_SIZE;
+	uint8_t direct = (rule_id_size <= SCHC_RULE_ID_DIRECT_BITS);
+	uint32_t slots = direct ? (uint32_t) (1UL << rule_id_size)
+			: (uint32_t) (2 * (device->compression_rule_count + device->fragmentation_rule_count) + 1);
+	if (rule_id_table_count >= SCHC_RULE_ID_TABLES || rule_id_size > 32
+			|| (rule_id_entry_count + slots) > SCHC_RULE_ID_ENTRIES) {
+		DEBUG_PRINTF("rule_id_table_add(): no room left, device %02" PRIu64 " uses the rule by rule search\n", device->device_id);
+		return;
+	}
+
+	rule_id_table_t* table = &rule_id_tables[rule_id_table_count];
+	table->compression_context = device->compression_context;
+	table->fragmentation_context = device->fragmentation_context;
+	table->compression_rule_count = device->compression_rule_count;
+	table->fragmentation_rule_count = device->fragmentation_rule_count;
+	table->rule_id_size = rule_id_size;
+	table->direct = direct;
+	table->first = rule_id_entry_count;
+	table->slots = slots;
+	uint32_t slot;
+	for (slot = 0; slot < slots; slot++) {
+		rule_id_entries[table->first + slot].key = direct ? slot : 0;
+		rule_id_entries[table->first + slot].compression = RULE_ID_NONE;
+		rule_id_entries[table->first + slot].fragmentation = RULE_ID_NONE;
+	}
+
+	for (i = 0; i < device->compression_rule_count && i < RULE_ID_NONE; i++) {
+		uint32_t key = get_rule_id_key((*device->compression_context)[i]->rule_id, rule_id_size);
+		rule_id_entry_t* entry = rule_id_table_entry(table, key);
+		entry->key = key;
+		if (entry->compression == RULE_ID_NONE) {
+			entry->compression = i;
+		}
+	}
+	for (i = 0; i < device->fragmentation_rule_count && i < RULE_ID_NONE; i++) {
+		uint32_t key = get_rule_id_key((*device->fragmentation_context)[i]->rule_id, rule_id_size);
+		rule_id_entry_t* entry = rule_id_table_entry(table, key);
+		entry->key = key;
+		if (entry->fragmentation == RULE_ID_NONE) {
+			entry->fragmentation = i;
+		}
+	}
+
+	rule_id_entry_count += slots;
+	rule_id_table_count++;
+}
+
+static void rule_id_tables_init(void) {
+	const struct schc_device* device;
+	uint32_t i = 0;
+
+	rule_id_table_count = 0;
+	rule_id_entry_count = 0;
+	while ((device = get_context_by_index(i++)) != NULL) {
+		rule_id_table_add(device);
+	}
+	rule_id_tables_ready = 1;
+}
+#endif
+
+/**
+ * Find the rules a received rule id refers to
+ *
+ * @param rule_arr 		the received packet, starting with the rule id
+ * @param device		the device the packet was received for
+ * @param compression	set to the compression rule, NULL if there is none, can be NULL
+ * @param fragmentation	set to the fragmentation rule, NULL if there is none, can be NULL
+ *
+ */
+void get_rules_by_rule_id(const uint8_t* rule_arr, const struct schc_device* device,
+		struct schc_compression_rule_t** compression, struct schc_fragmentation_rule_t** fragmentation) {
+	uint8_t rule_id_size = device->profile->RULE_ID_SIZE;
+	uint32_t key = get_bits(rule_arr, 0, rule_id_size);
+	int i;
+
+	if (compression) {
+		*compression = NULL;
+	}
+	if (fragmentation) {
+		*fragmentation = NULL;
+	}
+
+#if SCHC_RULE_ID_TABLE == 1
+	if (!rule_id_tables_ready) {
+		rule_id_tables_init();
+	}
+	for (i = 0; i < rule_id_table_count; i++) {
+		const rule_id_table_t* table = &rule_id_tables[i];
+		if (!rule_id_table_uses(table, device)) {
+			continue;
+		}
+		const rule_id_entry_t* entry = rule_id_table_entry(table, key);
+		if (entry->key != key) {
+			return;
+		}
+		if (compression && entry->compression != RULE_ID_NONE) {
+			*compression = (struct schc_compression_rule_t*) (*device->compression_context)[entry->compression];
+		}
+		if (fragmentation && entry->fragmentation != RULE_ID_NONE) {
+			*fragmentation = (struct schc_fragmentation_rule_t*) (*device->fragmentation_context)[entry->fragmentation];
+		}
+		return;
+	}
+#endif
+
+	for (i = 0; compression && i < device->compression_rule_count; i++) {
+		if (get_rule_id_key((*device->compression_context)[i]->rule_id, rule_id_size) == key) {
+			*compression = (struct schc_compression_rule_t*) (*device->compression_context)[i];
+			break;
+		}
+	}
+	for (i = 0; fragmentation && i < device->fragmentation_rule_count; i++) {
+		if (get_rule_id_key((*device->fragmentation_context)[i]->rule_id, rule_id_size) == key) {
+			*fragmentation = (struct schc_fragmentation_rule_t*) (*device->fragmentation_context)[i];
+			break;
+		}
+	}
+}
+
+/**
+ * Revise the rules for all devices, and for the contexts of the rule store
  * Uncompressed rule ids should not be used for other rules
  *
  * @return 0 			the rules are not setup correctly
@@ -41,13 +811,21 @@ struct schc_device* get_device_by_id(uint32_t device_id) {
  *
  */
 uint8_t rm_revise_rule_context(void) {
+#if SCHC_DEVICE_TABLE == 1
+	device_table_init();
+#endif
+#if SCHC_RULE_ID_TABLE == 1
+	rule_id_tables_init();
+#endif
 	/* compare uncompressed rule ids and rule entries for possible duplicates */
-	for (int i = 0; i < DEVICE_COUNT; i++) {
-		for (int j = 0; j < devices[i]->compression_rule_count; j++) {
+	const struct schc_device* device;
+	uint32_t i = 0;
+	while ((device = get_context_by_index(i++)) != NULL) {
+		for (int j = 0; j < device->compression_rule_count; j++) {
 			const struct schc_compression_rule_t *curr_rule =
-					(*devices[i]->compression_context)[j];
-			if (devices[i]->uncomp_rule_id == curr_rule->rule_id) {
-				DEBUG_PRINTF("rm_revise_rule_context(): rule=%p uses device with id=%02" PRIu32 " uncompressed rule id=%d\n", (void*) curr_rule, devices[i]->device_id, devices[i]->uncomp_rule_id);
+					(*device->compression_context)[j];
+			if (device->uncomp_rule_id == curr_rule->rule_id) {
+				DEBUG_PRINTF("rm_revise_rule_context(): rule=%p uses device with id=%02" PRIu64 " uncompressed rule id=%d\n", (void*) curr_rule, device->device_id, device->uncomp_rule_id);
 				return 0;
 			}
 		}
@@ -72,3 +850,77 @@ void uint32_rule_id_to_uint8_buf(uint32_t rule_id, uint8_t* out, uint8_t len) {
 
 	copy_bits(out, 0, rule_arr, pos, len); /* set the rule id */
 }
+
+#if SCHC_TRACE_LEVEL > SCHC_TRACE_LEVEL_OFF
+#if (SCHC_TRACE_RECORDS & (SCHC_TRACE_RECORDS - 1)) != 0
+#error "SCHC_TRACE_RECORDS must be a power of 2"
+#endif
+/*
+ * The trace ring of a thread, only the owning thread writes and reads it, so no locks are required
+ * head and tail are free running counters, the oldest records are overwritten when the ring is full
+ */
+typedef struct schc_trace_ring_t {
+	uint32_t head;
+	uint32_t tail;
+	schc_trace_record_t records[SCHC_TRACE_RECORDS];
+} schc_trace_ring_t;
+
+static SCHC_THREAD_LOCAL schc_trace_ring_t trace_ring;
+#endif
+
+/**
+ * Store a binary trace record in the trace ring of the calling thread
+ * use the SCHC_TRACE_ERROR, SCHC_TRACE_INFO and SCHC_TRACE_DEBUG macros,
+ * which are removed at compile time when above SCHC_TRACE_LEVEL
+ *
+ * @param level 	the trace level of the record
+ * @param event		the schc_trace_event_t
+ * @param arg0		the first argument of the event
+ * @param arg1		the second argument of the event
+ *
+ */
+void schc_trace(uint8_t level, uint16_t event, uint32_t arg0, uint32_t arg1) {
+#if SCHC_TRACE_LEVEL > SCHC_TRACE_LEVEL_OFF
+	schc_trace_ring_t* ring = &trace_ring;
+	schc_trace_record_t* record = &ring->records[ring->head & (SCHC_TRACE_RECORDS - 1)];
+
+	record->seq = ring->head;
+	record->time = (uint32_t) SCHC_TRACE_CLOCK();
+	record->event = event;
+	record->level = level;
+	record->reserved = 0;
+	record->arg[0] = arg0;
+	record->arg[1] = arg1;
+
+	ring->head++;
+	if ((ring->head - ring->tail) > SCHC_TRACE_RECORDS) { /* overwrote the oldest record */
+		ring->tail = ring->head - SCHC_TRACE_RECORDS;
+	}
+#else
+	(void) level; (void) event; (void) arg0; (void) arg1;
+#endif
+}
+
+/**
+ * Move the trace records of the calling thread, oldest first, to a buffer
+ * gaps in the sequence numbers indicate overwritten records
+ *
+ * @param records 	the buffer to copy the records to
+ * @param max		the number of records that fit in the buffer
+ *
+ * @return 			the number of records copied
+ *
+ */
+uint32_t schc_trace_read(schc_trace_record_t* records, uint32_t max) {
+	uint32_t count = 0;
+#if SCHC_TRACE_LEVEL > SCHC_TRACE_LEVEL_OFF
+	schc_trace_ring_t* ring = &trace_ring;
+	while (ring->tail != ring->head && count < max) {
+		records[count++] = ring->records[ring->tail & (SCHC_TRACE_RECORDS - 1)];
+		ring->tail++;
+	}
+#else
+	(void) records; (void) max;
+#endif
+	return count;
+}
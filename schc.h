@@ -3,6 +3,84 @@
 
 #include "schc_config.h"
 
+/* look devices up in a hash table on the device id, instead of scanning the device list */
+#ifndef SCHC_DEVICE_TABLE
+#define SCHC_DEVICE_TABLE		1
+#endif
+/* find the rule of a received rule id with a table lookup, instead of comparing all rule ids */
+#ifndef SCHC_RULE_ID_TABLE
+#define SCHC_RULE_ID_TABLE		1
+#endif
+#ifndef SCHC_RULE_ID_TABLES
+#define SCHC_RULE_ID_TABLES		4
+#endif
+#ifndef SCHC_RULE_ID_DIRECT_BITS
+#define SCHC_RULE_ID_DIRECT_BITS	8
+#endif
+#ifndef SCHC_RULE_ID_ENTRIES
+#define SCHC_RULE_ID_ENTRIES	1024
+#endif
+/* load devices and their rules from a binary rule store, next to the devices in the device list
+ * the rules are copied to the pools below, the devices of the store share the rules of their context */
+#ifndef SCHC_RULE_STORE
+#define SCHC_RULE_STORE			0
+#endif
+/* map the store file with schc_store_open() and keep the devices in an anonymous mapping (POSIX),
+ * otherwise the devices are kept in a pool of SCHC_RULE_STORE_DEVICES */
+#ifndef SCHC_RULE_STORE_MMAP
+#define SCHC_RULE_STORE_MMAP	1
+#endif
+#ifndef SCHC_RULE_STORE_LAYER_RULES
+#define SCHC_RULE_STORE_LAYER_RULES	64
+#endif
+#ifndef SCHC_RULE_STORE_COMPRESSION_RULES
+#define SCHC_RULE_STORE_COMPRESSION_RULES	64
+#endif
+#ifndef SCHC_RULE_STORE_FRAGMENTATION_RULES
+#define SCHC_RULE_STORE_FRAGMENTATION_RULES	16
+#endif
+/* the number of contexts and of profiles */
+#ifndef SCHC_RULE_STORE_CONTEXTS
+#define SCHC_RULE_STORE_CONTEXTS	16
+#endif
+/* the number of rules referred to by all contexts */
+#ifndef SCHC_RULE_STORE_RULE_REFS
+#define SCHC_RULE_STORE_RULE_REFS	256
+#endif
+#ifndef SCHC_RULE_STORE_DEVICES
+#define SCHC_RULE_STORE_DEVICES	64
+#endif
+
+/* the per thread state of the library, i.e. the trace ring, the compressor scratch buffers and the bound context,
+ * define this empty on targets without thread local storage */
+#ifndef SCHC_THREAD_LOCAL
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define SCHC_THREAD_LOCAL		_Thread_local
+#elif defined(__GNUC__)
+#define SCHC_THREAD_LOCAL		__thread
+#else
+#define SCHC_THREAD_LOCAL
+#endif
+#endif
+
+/* the trace levels, the trace points above SCHC_TRACE_LEVEL are not compiled in
+ * the byte dumps of the packets, bitmaps and mbuf chains are only compiled in at SCHC_TRACE_LEVEL_DEBUG */
+#define SCHC_TRACE_LEVEL_OFF	0
+#define SCHC_TRACE_LEVEL_ERROR	1
+#define SCHC_TRACE_LEVEL_INFO	2
+#define SCHC_TRACE_LEVEL_DEBUG	3
+#ifndef SCHC_TRACE_LEVEL
+#define SCHC_TRACE_LEVEL		SCHC_TRACE_LEVEL_DEBUG
+#endif
+/* the number of trace records kept per thread, a power of 2 */
+#ifndef SCHC_TRACE_RECORDS
+#define SCHC_TRACE_RECORDS		64
+#endif
+/* the time stamp of a trace record, e.g. a millisecond tick */
+#ifndef SCHC_TRACE_CLOCK
+#define SCHC_TRACE_CLOCK()		0
+#endif
+
 // protocol definitions
 #define UDP_HLEN				8
 #define IP6_HLEN				40
@@ -231,8 +309,8 @@ struct schc_profile_t {
 };
 
 struct schc_device {
-	/* the device id (e.g. EUI) */
-	uint32_t device_id;
+	/* the device id (e.g. a 64-bit EUI) */
+	uint64_t device_id;
 	/* the rule id to use when a packet remains uncompressed */
 	uint32_t uncomp_rule_id;
 	/* the total number of compression rules for a device */
@@ -245,8 +323,106 @@ struct schc_device {
 	const struct schc_fragmentation_rule_t *(*fragmentation_context)[];
 	/* a pointer to the device profile */
 	const struct schc_profile_t* profile;
+	/* the L2 identifier of the device (e.g. the DevEUI) the DEVIID action derives the IID from,
+	 * 0 to use the device id */
+	uint64_t dev_l2_id;
+	/* the L2 identifier of the application (e.g. the EUI of the gateway) the APPIID action derives the IID from */
+	uint64_t app_l2_id;
 };
 
+/*
+ * The binary rule store, loaded with schc_store_load() or schc_store_open()
+ * all values are little endian, the records are referred to by their index in their section
+ * the header holds the magic (4), version (2), header length (2), store length (4),
+ * FNV-1a checksum of the bytes after the header (4), target value bytes per field (1), 0 (3),
+ * followed by the offset in the store and the number of records of each section (4 each)
+ */
+#define SCHC_STORE_MAGIC			0x43484353 /* "SCHC" */
+#define SCHC_STORE_VERSION			1
+#define SCHC_STORE_HEADER_LENGTH	(20 + 8 * SCHC_STORE_SECTIONS)
+/* a layer rule index of a compression rule without this layer */
+#define SCHC_STORE_NO_RULE			0xFFFFFFFF
+#define SCHC_STORE_FIELD_SIZE(_value_bytes)	((8u + (_value_bytes) + 3u) & ~3u)
+
+typedef enum {
+	/* 4 bytes: rule id size, uncompressed rule id, dtag size, 0 */
+	SCHC_STORE_PROFILES = 0,
+	/* SCHC_STORE_FIELD_SIZE bytes: field id (2), MO parameter, length, position, direction, schc_store_mo_t, action,
+	 * the target value */
+	SCHC_STORE_FIELDS = 1,
+	/* 8 bytes: layer, up, down, length, index of the first field (4) */
+	SCHC_STORE_LAYER_RULES = 2,
+	/* 16 bytes: rule id, index of the IPv6, UDP and CoAP layer rule or SCHC_STORE_NO_RULE (4 each) */
+	SCHC_STORE_COMPRESSION_RULES = 3,
+	/* 20 bytes: rule id, inactivity timer, retransmission timer (4 each), tile size (2),
+	 * mode, direction, fcn size, maximum window fcn, window size, rcs size */
+	SCHC_STORE_FRAGMENTATION_RULES = 4,
+	/* 12 bytes: uncompressed rule id, index of the first rule reference (4 each), profile (2),
+	 * number of compression rules, number of fragmentation rules */
+	SCHC_STORE_CONTEXTS = 5,
+	/* 4 bytes: the index of a compression rule, the fragmentation rules of a context follow its compression rules */
+	SCHC_STORE_RULE_REFS = 6,
+	/* 32 bytes: device id, dev L2 id, app L2 id (8 each), context, 0 (4 each), in ascending device id order */
+	SCHC_STORE_DEVICES = 7,
+	SCHC_STORE_SECTIONS
+} schc_store_section_t;
+
+typedef enum {
+	SCHC_STORE_MO_EQUAL = 0,
+	SCHC_STORE_MO_IGNORE = 1,
+	SCHC_STORE_MO_MSB = 2,
+	SCHC_STORE_MO_MATCHMAP = 3
+} schc_store_mo_t;
+
+typedef enum {
+	SCHC_EV_COMPRESS = 1, /* rule id, compressed length in bits */
+	SCHC_EV_COMPRESS_UNCOMPRESSED = 2, /* uncompressed rule id, compressed length in bits */
+	SCHC_EV_DECOMPRESS = 3, /* rule id, decompressed length in bytes */
+	SCHC_EV_DECOMPRESS_NO_RULE = 4, /* first byte of the rule id, compressed length in bytes */
+	SCHC_EV_FRAGMENT_TX = 5, /* window << 16 | fcn, length in bytes */
+	SCHC_EV_FRAGMENT_RETX = 6, /* window << 16 | fcn, length in bytes */
+	SCHC_EV_FRAGMENT_RX = 7, /* dtag, length in bytes */
+	SCHC_EV_ACK_TX = 8, /* window, first 32 bits of the bitmap */
+	SCHC_EV_ACK_RX = 9, /* window, first 32 bits of the bitmap */
+	SCHC_EV_ACK_REQ_TX = 10, /* window, dtag */
+	SCHC_EV_SENDER_ABORT = 11, /* window, dtag */
+	SCHC_EV_RECEIVER_ABORT = 12, /* window, dtag */
+	SCHC_EV_RCS_ERROR = 13, /* received RCS, computed RCS */
+	SCHC_EV_BITMAP = 14, /* window, first 32 bits of the bitmap */
+	SCHC_EV_MAX
+} schc_trace_event_t;
+
+/* a binary trace record, the records are stored and read in host byte order */
+typedef struct schc_trace_record_t {
+	/* the sequence number of the record in the ring of the thread */
+	uint32_t seq;
+	/* the SCHC_TRACE_CLOCK() at the time of the record */
+	uint32_t time;
+	uint16_t event;
+	uint8_t level;
+	uint8_t reserved;
+	uint32_t arg[2];
+} schc_trace_record_t;
+
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_ERROR
+#define SCHC_TRACE_ERROR(_event, _arg0, _arg1) \
+		schc_trace(SCHC_TRACE_LEVEL_ERROR, (_event), (uint32_t) (_arg0), (uint32_t) (_arg1))
+#else
+#define SCHC_TRACE_ERROR(_event, _arg0, _arg1)
+#endif
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_INFO
+#define SCHC_TRACE_INFO(_event, _arg0, _arg1) \
+		schc_trace(SCHC_TRACE_LEVEL_INFO, (_event), (uint32_t) (_arg0), (uint32_t) (_arg1))
+#else
+#define SCHC_TRACE_INFO(_event, _arg0, _arg1)
+#endif
+#if SCHC_TRACE_LEVEL >= SCHC_TRACE_LEVEL_DEBUG
+#define SCHC_TRACE_DEBUG(_event, _arg0, _arg1) \
+		schc_trace(SCHC_TRACE_LEVEL_DEBUG, (_event), (uint32_t) (_arg0), (uint32_t) (_arg1))
+#else
+#define SCHC_TRACE_DEBUG(_event, _arg0, _arg1)
+#endif
+
 typedef uint8_t schc_ip6addr_t[16];
 typedef schc_ip6addr_t schc_ipaddr_t;
 
@@ -271,8 +447,21 @@ uint8_t mo_ignore(struct schc_field* target_field, unsigned char* field_value, u
 uint8_t mo_MSB(struct schc_field* target_field, unsigned char* field_value, uint16_t field_offset);
 uint8_t mo_matchmap(struct schc_field* target_field, unsigned char* field_value, uint16_t field_offset);
 
-struct schc_device* get_device_by_id(uint32_t device_id);
+struct schc_device* get_device_by_id(uint64_t device_id);
+struct schc_device* get_device_by_index(uint32_t index);
+struct schc_device* get_context_by_index(uint32_t index);
+void get_rules_by_rule_id(const uint8_t* rule_arr, const struct schc_device* device,
+		struct schc_compression_rule_t** compression, struct schc_fragmentation_rule_t** fragmentation);
 void uint32_rule_id_to_uint8_buf(uint32_t rule_id, uint8_t* out, uint8_t len);
 uint8_t rm_revise_rule_context(void);
+#if SCHC_RULE_STORE == 1
+uint8_t schc_store_load(const uint8_t* store, uint32_t length);
+#if SCHC_RULE_STORE_MMAP == 1
+uint8_t schc_store_open(const char* path);
+#endif
+void schc_store_close(void);
+#endif
+void schc_trace(uint8_t level, uint16_t event, uint32_t arg0, uint32_t arg1);
+uint32_t schc_trace_read(schc_trace_record_t* records, uint32_t max);
 
 #endif
@@ -0,0 +1,157 @@
+#ifndef __SCHC_CONFIG_H__
+#define __SCHC_CONFIG_H__
+
+#include <stdio.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#define CLICK							0
+
+#define DYNAMIC_MEMORY					0
+#define STATIC_MEMORY_BUFFER_LENGTH		1024
+
+#define SCHC_CONF_RX_CONNS				1
+#define SCHC_CONF_TX_CONNS              1
+#define SCHC_CONF_MBUF_POOL_LEN			128
+
+#define USE_COAP						1
+#define USE_IP6_UDP						1
+
+/* the maximum length of a single header field
+ * e.g. you can use 4 ipv6 source iid addresses with match-mapping */
+#define MAX_FIELD_LENGTH				32
+
+/* set to 1 to or the copied bits into the destination (legacy behaviour)
+ * instead of overwriting the destination bits */
+#define SCHC_COPY_BITS_OR				0
+
+/* use the SSE2/AVX2 or NEON kernels for bulk bit shifting and bitmap logic,
+ * the scalar kernels are used on other targets */
+#define SCHC_BIT_SIMD					1
+
+/* compile the compression rules of each device into a decision tree at init,
+ * matching a header then takes a few field lookups, independent of the number of rules
+ * the pools are shared by all devices, a layer falls back to the rule by rule search when full
+ * SCHC_RULE_TREE_RULES holds the compression rules of all devices, so the layers are matched at once */
+#define SCHC_RULE_TREE					1
+#define SCHC_RULE_TREE_DEVICES			4
+#define SCHC_RULE_TREE_NODES			128
+#define SCHC_RULE_TREE_BRANCHES			256
+#define SCHC_RULE_TREE_LEAF_ENTRIES		256
+#define SCHC_RULE_TREE_RULES			64
+
+/* index the match-mapping lists at init, so a field is mapped with a binary search
+ * SCHC_MATCHMAP_TABLES is the number of lists that can be indexed, for all devices */
+#define SCHC_MATCHMAP_INDEX				1
+#define SCHC_MATCHMAP_TABLES			32
+
+/* compile the layer rules into compact descriptors at init, which the matcher walks instead of the rules
+ * the target values are stored once in a pool shared by all rules, a rule that does not fit is matched as is */
+#define SCHC_COMPACT_RULES				1
+#define SCHC_COMPACT_RULE_COUNT			64
+#define SCHC_COMPACT_FIELDS				512
+#define SCHC_COMPACT_POOL_BYTES			1024
+
+/* use the code generated from the rules by examples/rulegen.c (make rules_generated in examples),
+ * which writes rules/rules_generated.h, a layer rule changed since then is walked field by field
+ * SCHC_GENERATED_RULE_COUNT is the number of layer rules that can use generated code, for all devices */
+#define SCHC_GENERATED_RULES			0
+#define SCHC_GENERATED_RULE_COUNT		64
+
+/* the number of matching layer rules, per layer, of which the residue is kept while matching
+ * a layer is compressed from this record, without walking its rule again */
+#define SCHC_MATCH_RECORDS				4
+
+/* cache the rule selected for a flow, keyed on the header bits the rules match on,
+ * packets of the same flow are compressed without matching the rules again
+ * SCHC_HEADER_CACHE_COAP_BYTES bounds the cached CoAP header, longer headers are not cached */
+#define SCHC_HEADER_CACHE				0
+#define SCHC_HEADER_CACHE_ENTRIES		8
+#define SCHC_HEADER_CACHE_COAP_BYTES	32
+
+/* compute the option number order of the options in each CoAP rule at init,
+ * so decompression appends the options without searching the options already written
+ * SCHC_COAP_OPTION_ORDERS is the number of CoAP rules, for all devices */
+#define SCHC_COAP_OPTION_ORDER			1
+#define SCHC_COAP_OPTION_ORDERS			16
+
+/* the number of packets of a batch that are sorted on their device (and rule id) at once */
+#define SCHC_BATCH_GROUP				32
+/* the maximum number of payload segments schc_compress_iov() refers to, instead of copying the payload */
+#define SCHC_IOV_MAX					8
+
+/* the number of devices with rules using the DEVIID or APPIID actions,
+ * their interface identifiers are derived from the L2 identifiers at init */
+#define SCHC_IID_DEVICES				4
+
+/* run the library on a pool of POSIX threads, the tasks are sharded on the device id (workers.c)
+ * off by default, the POSIX examples enable it with -DSCHC_WORKERS=1 */
+#ifndef SCHC_WORKERS
+#define SCHC_WORKERS					0
+#endif
+#define SCHC_WORKERS_MAX				8
+#define SCHC_WORKER_QUEUE_LEN			256
+
+/* find devices through a hash table on their 64-bit id, built at init */
+#define SCHC_DEVICE_TABLE				1
+
+/* index the rule ids of each device at init, rule ids up to SCHC_RULE_ID_DIRECT_BITS bits
+ * index a table of 2^RULE_ID_SIZE entries, longer rule ids are hashed
+ * devices with the same rules share a table, SCHC_RULE_ID_ENTRIES is shared by all tables */
+#define SCHC_RULE_ID_TABLE				1
+#define SCHC_RULE_ID_TABLES				4
+#define SCHC_RULE_ID_DIRECT_BITS		8
+#define SCHC_RULE_ID_ENTRIES			1024
+
+/* load devices and their rules from a binary rule store with schc_store_open(), before schc_compressor_init(),
+ * the store is written by examples/rulestore.c from the rules in rules/rule_config.h or from YANG-JSON (RFC 9363)
+ * the rules are copied to the pools below, SCHC_RULE_STORE_CONTEXTS also bounds the number of profiles
+ * with SCHC_RULE_STORE_MMAP the file is mapped and the devices are kept in an anonymous mapping (POSIX),
+ * otherwise the store is loaded from memory with schc_store_load() and holds up to SCHC_RULE_STORE_DEVICES devices */
+#define SCHC_RULE_STORE					0
+#define SCHC_RULE_STORE_MMAP			1
+#define SCHC_RULE_STORE_LAYER_RULES		64
+#define SCHC_RULE_STORE_COMPRESSION_RULES	64
+#define SCHC_RULE_STORE_FRAGMENTATION_RULES	16
+#define SCHC_RULE_STORE_CONTEXTS		16
+#define SCHC_RULE_STORE_RULE_REFS		256
+#define SCHC_RULE_STORE_DEVICES			64
+
+/* maximum number of header fields present in a rule (vertical, top to bottom) */
+#define IP6_FIELDS						14
+#define UDP_FIELDS						4
+#define COAP_FIELDS						16
+
+#define MAX_HEADER_LENGTH				256
+
+#define MAX_COAP_HEADER_LENGTH			64
+#define MAX_PAYLOAD_LENGTH				256
+#define MAX_COAP_MSG_SIZE				(MAX_COAP_HEADER_LENGTH + MAX_PAYLOAD_LENGTH)
+
+/* the maximum transfer unit of the underlying technology */
+#define MAX_MTU_LENGTH					242
+
+/* the maximum number of tokens inside a JSON structure */
+#define JSON_TOKENS						16
+
+#define DEBUG_PRINTF(...) 				printf(__VA_ARGS__)
+
+/* compile in the trace points up to this level: 0 off, 1 errors, 2 packets and acks, 3 debug
+ * the trace points store binary records in a ring per thread, read them with schc_trace_read()
+ * the byte dumps of the packets through DEBUG_PRINTF are only compiled in at level 3 */
+#define SCHC_TRACE_LEVEL				3
+#define SCHC_TRACE_RECORDS				64
+
+/* the number of ack attempts */
+#define MAX_ACK_REQUESTS				3
+
+/* the length of the bitmap */
+#define BITMAP_SIZE_BYTES				2 // pow(2, FCN_SIZE_BITS) / 8
+
+/* the maximum allowed windows */
+#define MAX_WINDOWS                     8
+
+/* the maximum window size */
+#define MAX_WINDOW_SIZE                 64
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * (c) 2018 - 2022  idlab - UGent - imec
+ *
+ * Bart Moons
+ *
+ * This file is part of the SCHC stack implementation
+ *
+ * The worker pool runs the library on multiple threads.
+ * The tasks are sharded on the device id, so all the packets and timers of a device
+ * are handled by the same worker, in the order they were posted.
+ * Every worker binds its own fragmenter context, the compressor keeps its scratch buffers
+ * and header cache per thread and the rules are only read after schc_compressor_init().
+ *
+ */
+
+#include "workers.h"
+
+#if SCHC_WORKERS == 1
+
+/*
+ * Process the queued tasks until the worker is stopped
+ * the worker takes all queued tasks at once, so the lock is not taken for every task,
+ * the remaining tasks are run before the thread exits
+ */
+static void* worker_main(void* arg) {
+	schc_worker_t* worker = (schc_worker_t*) arg;
+
+	schc_ctx_set(&worker->ctx);
+
+	pthread_mutex_lock(&worker->lock);
+	while (1) {
+		while (worker->head == worker->tail && !worker->stop) {
+			worker->idle = 1;
+			pthread_cond_wait(&worker->cond, &worker->lock);
+			worker->idle = 0;
+		}
+		if (worker->head == worker->tail) {
+			break;
+		}
+		uint32_t head = worker->head;
+		uint32_t i;
+		pthread_mutex_unlock(&worker->lock);
+
+		/* the slots up to head are not written until the tail is moved */
+		for (i = worker->tail; i != head; i++) {
+			const schc_worker_job_t* job = &worker->queue[i % SCHC_WORKER_QUEUE_LEN];
+			job->task(job->arg);
+		}
+
+		pthread_mutex_lock(&worker->lock);
+		worker->tail = head;
+		if (worker->waiters) {
+			pthread_cond_broadcast(&worker->done);
+		}
+	}
+	pthread_mutex_unlock(&worker->lock);
+
+	return NULL;
+}
+
+/**
+ * Start a pool of worker threads
+ * schc_compressor_init() has to be called before the pool is started
+ *
+ * @param 	pool			the pool to start
+ * @param 	count			the number of worker threads, 1 up to SCHC_WORKERS_MAX
+ * @param 	cb_conn			the callbacks to initialize the fragmenter of every worker with,
+ * 							NULL if the workers only compress and decompress
+ *
+ * @return 	SCHC_SUCCESS	the workers are running
+ * 			SCHC_FAILURE	the count is not supported or a thread could not be created
+ *
+ */
+int8_t schc_workers_start(schc_worker_pool_t* pool, uint8_t count, struct schc_fragmentation_t* cb_conn) {
+	uint8_t i;
+
+	if (count == 0 || count > SCHC_WORKERS_MAX) {
+		DEBUG_PRINTF("schc_workers_start(): %d workers are not supported\n", count);
+		return SCHC_FAILURE;
+	}
+
+	pool->count = 0;
+	for (i = 0; i < count; i++) {
+		schc_worker_t* worker = &pool->workers[i];
+		worker->head = 0;
+		worker->tail = 0;
+		worker->waiters = 0;
+		worker->idle = 0;
+		worker->stop = 0;
+		if (cb_conn != NULL) {
+			/* initialize the context of the worker from this thread */
+			schc_ctx_t* ctx = schc_ctx_get();
+			schc_ctx_set(&worker->ctx);
+			schc_fragmenter_init(cb_conn);
+			schc_ctx_set(ctx);
+		}
+		pthread_mutex_init(&worker->lock, NULL);
+		pthread_cond_init(&worker->cond, NULL);
+		pthread_cond_init(&worker->done, NULL);
+		if (pthread_create(&worker->thread, NULL, worker_main, worker)) {
+			DEBUG_PRINTF("schc_workers_start(): could not create worker %d\n", i);
+			pthread_mutex_destroy(&worker->lock);
+			pthread_cond_destroy(&worker->cond);
+			pthread_cond_destroy(&worker->done);
+			schc_workers_stop(pool);
+			return SCHC_FAILURE;
+		}
+		pool->count++;
+	}
+
+	return SCHC_SUCCESS;
+}
+
+/**
+ * Get the worker handling a device
+ *
+ * @param 	pool			the running pool
+ * @param 	device_id		the id of the device
+ *
+ * @return 	index			the index of the worker in the pool
+ *
+ */
+uint8_t schc_workers_index(const schc_worker_pool_t* pool, uint64_t device_id) {
+	/* mix the bits of the id, so sequential ids are spread over the workers */
+	device_id ^= device_id >> 33;
+	device_id *= 0xFF51AFD7ED558CCDULL;
+	device_id ^= device_id >> 33;
+
+	return (uint8_t) (device_id % pool->count);
+}
+
+/**
+ * Queue a task on the worker handling a device
+ * the calling thread waits while the queue of the worker is full,
+ * so a task should not post to the pool itself
+ *
+ * @param 	pool			the running pool
+ * @param 	device_id		the id of the device the task works on
+ * @param 	task			the function to call on the worker thread
+ * @param 	arg				the argument of the function
+ *
+ * @return 	SCHC_SUCCESS	the task is queued
+ * 			SCHC_FAILURE	the pool is not running
+ *
+ */
+int8_t schc_workers_post(schc_worker_pool_t* pool, uint64_t device_id, schc_worker_task_t task, void* arg) {
+	if (pool->count == 0) {
+		return SCHC_FAILURE;
+	}
+
+	schc_worker_t* worker = &pool->workers[schc_workers_index(pool, device_id)];
+
+	pthread_mutex_lock(&worker->lock);
+	while ((worker->head - worker->tail) >= SCHC_WORKER_QUEUE_LEN && !worker->stop) {
+		worker->waiters++;
+		pthread_cond_wait(&worker->done, &worker->lock);
+		worker->waiters--;
+	}
+	if (worker->stop) {
+		pthread_mutex_unlock(&worker->lock);
+		return SCHC_FAILURE;
+	}
+	worker->queue[worker->head % SCHC_WORKER_QUEUE_LEN] = (schc_worker_job_t) { .task = task, .arg = arg };
+	worker->head++;
+	if (worker->idle) {
+		pthread_cond_signal(&worker->cond);
+	}
+	pthread_mutex_unlock(&worker->lock);
+
+	return SCHC_SUCCESS;
+}
+
+/**
+ * Wait until all the tasks queued so far are finished
+ *
+ * @param 	pool			the running pool
+ *
+ */
+void schc_workers_wait(schc_worker_pool_t* pool) {
+	uint8_t i;
+
+	for (i = 0; i < pool->count; i++) {
+		schc_worker_t* worker = &pool->workers[i];
+		pthread_mutex_lock(&worker->lock);
+		uint32_t head = worker->head;
+		while ((int32_t) (head - worker->tail) > 0) {
+			worker->waiters++;
+			pthread_cond_wait(&worker->done, &worker->lock);
+			worker->waiters--;
+		}
+		pthread_mutex_unlock(&worker->lock);
+	}
+}
+
+/**
+ * Stop the worker threads
+ * the queued tasks are finished first
+ *
+ * @param 	pool			the running pool
+ *
+ */
+void schc_workers_stop(schc_worker_pool_t* pool) {
+	uint8_t i;
+
+	for (i = 0; i < pool->count; i++) {
+		schc_worker_t* worker = &pool->workers[i];
+		pthread_mutex_lock(&worker->lock);
+		worker->stop = 1;
+		pthread_cond_broadcast(&worker->cond);
+		pthread_mutex_unlock(&worker->lock);
+	}
+	for (i = 0; i < pool->count; i++) {
+		schc_worker_t* worker = &pool->workers[i];
+		pthread_join(worker->thread, NULL);
+		pthread_mutex_destroy(&worker->lock);
+		pthread_cond_destroy(&worker->cond);
+		pthread_cond_destroy(&worker->done);
+	}
+	pool->count = 0;
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * (c) 2018 - 2022  idlab - UGent - imec
+ *
+ * Bart Moons
+ *
+ * This file is part of the SCHC stack implementation
+ *
+ */
+
+#ifndef __SCHC_WORKERS_H__
+#define __SCHC_WORKERS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "fragmenter.h"
+
+/* run the compressor and fragmenter on a pool of POSIX threads */
+#ifndef SCHC_WORKERS
+#define SCHC_WORKERS			0
+#endif
+/* the maximum number of worker threads in a pool */
+#ifndef SCHC_WORKERS_MAX
+#define SCHC_WORKERS_MAX		8
+#endif
+/* the number of tasks a worker can queue */
+#ifndef SCHC_WORKER_QUEUE_LEN
+#define SCHC_WORKER_QUEUE_LEN	256
+#endif
+
+#if SCHC_WORKERS == 1
+#include <pthread.h>
+
+typedef void (*schc_worker_task_t)(void* arg);
+
+typedef struct schc_worker_job_t {
+	schc_worker_task_t task;
+	void* arg;
+} schc_worker_job_t;
+
+typedef struct schc_worker_t {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	/* signalled when a task is queued for the idle worker or the worker has to stop */
+	pthread_cond_t cond;
+	/* signalled when the worker finished the tasks it took from the queue */
+	pthread_cond_t done;
+	/* the queued tasks, the tasks from the tail run until tail is moved */
+	schc_worker_job_t queue[SCHC_WORKER_QUEUE_LEN];
+	uint32_t head;
+	uint32_t tail;
+	/* the number of threads waiting on done */
+	uint16_t waiters;
+	uint8_t idle;
+	uint8_t stop;
+	/* the fragmenter context of the worker thread */
+	schc_ctx_t ctx;
+} schc_worker_t;
+
+typedef struct schc_worker_pool_t {
+	schc_worker_t workers[SCHC_WORKERS_MAX];
+	uint8_t count;
+} schc_worker_pool_t;
+
+int8_t schc_workers_start(schc_worker_pool_t* pool, uint8_t count, struct schc_fragmentation_t* cb_conn);
+uint8_t schc_workers_index(const schc_worker_pool_t* pool, uint64_t device_id);
+int8_t schc_workers_post(schc_worker_pool_t* pool, uint64_t device_id, schc_worker_task_t task, void* arg);
+void schc_workers_wait(schc_worker_pool_t* pool);
+void schc_workers_stop(schc_worker_pool_t* pool);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif